@@ -696,6 +696,23 @@ T Checksum(const T *data, const int n) {
 	for (int i = 0; i < n; ++i) chk += data[i];
 	return chk;
 }
+
+/*!
+ * @brief 计算modbus RTU循环冗余校验码
+ * @param data 待校验数据
+ * @param n    数组长度
+ * @return
+ * CRC16校验码. 多项式: 0xA001, 初值: 0xFFFF. 发送时低字节在前
+ */
+template <class T>
+unsigned short CRC16(const T *data, const int n) {
+	unsigned short crc(0xFFFF);
+	for (int i = 0; i < n; ++i) {
+		crc ^= (unsigned char) data[i];
+		for (int j = 0; j < 8; ++j) crc = (crc & 1) ? ((crc >> 1) ^ 0xA001) : (crc >> 1);
+	}
+	return crc;
+}
 /*--------------------------------- 校验和 ---------------------------------*/
 ///////////////////////////////////////////////////////////////////////////////
 }
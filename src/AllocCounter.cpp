@@ -0,0 +1,49 @@
+/**
+ * @file AllocCounter.cpp 内存分配计数, 替换全局operator new/delete
+ * @date 2026-10-17
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <new>
+#include "AllocCounter.h"
+
+static volatile unsigned long allocCount = 0;	//< 内存分配次数
+
+unsigned long AllocCount() {
+	return allocCount;
+}
+
+void CountAlloc() {
+	__sync_fetch_and_add(&allocCount, 1);
+}
+
+void* operator new(size_t size) {
+	CountAlloc();
+	void *ptr = malloc(size ? size : 1);
+	if (!ptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size) {
+	CountAlloc();
+	void *ptr = malloc(size ? size : 1);
+	if (!ptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void* ptr) throw() {
+	free(ptr);
+}
+
+void operator delete[](void* ptr) throw() {
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) throw() {
+	free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) throw() {
+	free(ptr);
+}
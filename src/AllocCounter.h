@@ -0,0 +1,26 @@
+/**
+ * @file AllocCounter.h 内存分配计数, 供性能测试程序统计单次操作的内存分配次数
+ * @date 2026-10-17
+ * @version 0.1
+ * @note
+ * - AllocCounter.cpp替换全局operator new/delete, 每次new计数一次
+ * - 仅链接到测试程序, 不链接到camannex
+ */
+
+#ifndef ALLOCCOUNTER_H_
+#define ALLOCCOUNTER_H_
+
+/*!
+ * @brief 查看累计内存分配次数
+ * @return
+ * 进程启动后的内存分配次数
+ */
+extern unsigned long AllocCount();
+/*!
+ * @brief 计入一次内存分配
+ * @note
+ * 供不经过operator new的分配函数使用, 如curl_global_init_mem()登记的函数
+ */
+extern void CountAlloc();
+
+#endif /* ALLOCCOUNTER_H_ */
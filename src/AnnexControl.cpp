@@ -9,9 +9,13 @@
 #include "globaldef.h"
 #include "GLog.h"
 
-AnnexControl::AnnexControl(io_service* iomain) {
+AnnexControl::AnnexControl(io_service* iomain)
+	: tmrnetwork_(*iomain) {
 	iomain_ = iomain;
+	iserver_ = 0;
+	ascproto_ = make_ascproto();
 	param_.LoadFile(gConfigPath);
+	backoff_ = param_.retryMin;
 }
 
 AnnexControl::~AnnexControl() {
@@ -22,14 +26,22 @@ bool AnnexControl::StartService() {
 	string mqname = "msgque_";
 	mqname += DAEMON_NAME;
 	register_messages();
-	if (!Start(mqname.c_str())) {
+	if (!Start(mqname.c_str(), param_.ipcMQ)) {
 		_gLog.Write(LOG_FAULT, NULL, "failed to create message queue<%s>", mqname.c_str());
 		return false;
 	}
-	if (!connect_server(false)) {
-		_gLog.Write(LOG_FAULT, NULL, "failed to connect server");
-		return false;
+	if (param_.enableDB && !param_.urlDB.empty()) {
+		UploadOption opt;
+		opt.capacity = param_.queueDB;
+		opt.batch    = param_.batchDB;
+		opt.latency  = param_.latencyDB;
+		opt.bulk     = param_.bulkDB;
+		opt.spool    = param_.spoolDB;
+		opt.budget   = param_.spoolBudget;
+		opt.replay   = param_.replayRate;
+		db_ = make_uploader(param_.urlDB, opt);
 	}
+	connect_server();
 	if (!connect_cooler(true)) {
 		_gLog.Write(LOG_FAULT, NULL, "failed to connect cooler");
 		return false;
@@ -47,44 +59,80 @@ bool AnnexControl::StartService() {
 }
 
 void AnnexControl::StopService() {
-	interrupt_thread(thrdnetwork_);
-    Stop();
+	boost::system::error_code ec;
+	tmrnetwork_.cancel(ec);
+	if (tcpconn_.use_count()) tcpconn_->Close();
+	if (tcp_.use_count()) tcp_->Close();
+	{// 停止控制接口: 释放定时器持有的对象引用
+		mutex_lock lck(mtx_cctl_);
+		for (CoolCVec::iterator it = cctl_.begin(); it != cctl_.end(); ++it) (*it)->Stop();
+		cctl_.clear();
+	}
+	{
+		mutex_lock lck(mtx_vctl_);
+		for (VacuumCVec::iterator it = vctl_.begin(); it != vctl_.end(); ++it) (*it)->Stop();
+		vctl_.clear();
+	}
+	if (db_.use_count()) db_->Stop();
+	// 控制接口与上传接口停止后不再投递消息, 最后停止消息队列
+	Stop();
 }
 
 void AnnexControl::register_messages() {
 	const CBSlot& slot1 = boost::bind(&AnnexControl::on_connect_network, this, _1, _2);
 	const CBSlot& slot2 = boost::bind(&AnnexControl::on_receive_network, this, _1, _2);
 	const CBSlot& slot3 = boost::bind(&AnnexControl::on_close_network,   this, _1, _2);
-	const CBSlot& slot4 = boost::bind(&AnnexControl::on_close_cooler,    this, _1, _2);
-	const CBSlot& slot5 = boost::bind(&AnnexControl::on_close_vacuum,    this, _1, _2);
+	const CBSlot& slot4 = boost::bind(&AnnexControl::on_retry_network,   this, _1, _2);
 
 	RegisterMessage(MSG_CONNECT_NETWORK, slot1);
 	RegisterMessage(MSG_RECEIVE_NETWORK, slot2);
 	RegisterMessage(MSG_CLOSE_NETWORK,   slot3);
-	RegisterMessage(MSG_CLOSE_COOLER,    slot4);
-	RegisterMessage(MSG_CLOSE_VACUUM,    slot5);
+	RegisterMessage(MSG_RETRY_NETWORK,   slot4);
+	RegisterMessage<CtlClosed>(MSG_CLOSE_COOLER, boost::bind(&AnnexControl::on_close_cooler, this, _1));
+	RegisterMessage<CtlClosed>(MSG_CLOSE_VACUUM, boost::bind(&AnnexControl::on_close_vacuum, this, _1));
+	RegisterMessage<CtlCommand>(MSG_COMMAND_RESULT, boost::bind(&AnnexControl::on_command_result, this, _1));
 }
 
-bool AnnexControl::connect_server(bool async) {
-	if (!param_.bServer) return true;
+void AnnexControl::connect_server() {
+	if (!param_.bServer || param_.servers.empty()) return;
 
 	const CBSlot& slot1 = boost::bind(&AnnexControl::network_receive, this, _1, _2);
 	const CBSlot& slot2 = boost::bind(&AnnexControl::network_connect, this, _1, _2);
-	tcp_ = maketcp_client();
-	tcp_->RegisterRead(slot1);
-	if (!async) {
-		if (!tcp_->Connect(param_.ipServer, param_.portServer)) {
-			_gLog.Write(LOG_WARN, NULL, "failed to connect server<%s:%d>",
-					param_.ipServer.c_str(), param_.portServer);
-			return false;
-		}
-		else _gLog.Write("SUCCEED: connection with server");
-	}
+	const ServerAddr& addr = param_.servers[iserver_];
+	TcpCPtr tcp = maketcp_client();
+	tcp->UseBuffer(); // 缓存接收数据, 由on_receive_network()按行解析
+	if (boost::iequals(param_.policyServer, "DropNewest"))
+		tcp->SetQueue(param_.queueServer, TCP_DROP_NEWEST);
+	else if (boost::iequals(param_.policyServer, "DropOldest"))
+		tcp->SetQueue(param_.queueServer, TCP_DROP_OLDEST);
+	else
+		tcp->SetQueue(param_.queueServer, TCP_COALESCE);
+	tcp->RegisterRead(slot1);
+	tcp->RegisterConnect(slot2);
+	tcpconn_ = tcp;	// 连接成功后转为tcp_, 由on_connect_network()关联串口设备
+	tcp->AsyncConnect(addr.host, addr.port, param_.timeoutServer);
+}
+
+/*
+ * @note 服务器按配置顺序尝试. 全部失败后由定时器重试, 重试间隔自retryMin起按2倍递增至retryMax
+ */
+void AnnexControl::connect_next() {
+	if (++iserver_ < int(param_.servers.size())) connect_server();
 	else {
-		tcp_->RegisterConnect(slot2);
-		tcp_->AsyncConnect(param_.ipServer, param_.portServer);
+		iserver_ = 0;
+		_gLog.Write(LOG_WARN, NULL, "no server available, retry in %.1f seconds", backoff_);
+		start_retry();
 	}
-	return true;
+}
+
+void AnnexControl::start_retry() {
+	tmrnetwork_.expires_from_now(boost::posix_time::millisec(int(backoff_ * 1000)));
+	tmrnetwork_.async_wait(boost::bind(&AnnexControl::retry_network, this, boost::asio::placeholders::error));
+	if ((backoff_ *= 2.0) > param_.retryMax) backoff_ = param_.retryMax;
+}
+
+void AnnexControl::retry_network(const boost::system::error_code& ec) {
+	if (!ec) PostMessage(MSG_RETRY_NETWORK);
 }
 
 bool AnnexControl::connect_serial(int devtype, Annex *device) {
@@ -94,8 +142,12 @@ bool AnnexControl::connect_serial(int devtype, Annex *device) {
 	int baudrate = device->baudRate;
 	if (devtype == 1) {// 温控
 		const CoolerCtl::CBSlot& slot = boost::bind(&AnnexControl::cooler_receive, this, _1, _2);
+		const CoolerCtl::CmdSlot& slotcmd = boost::bind(&AnnexControl::cooler_command, this, _1, _2);
 		CoolCPtr one = make_cooler();
 		one->RegisterResult(slot);
+		one->RegisterCommand(slotcmd);
+		one->SetRTU(boost::iequals(device->mode, "RTU"));
+		one->SetTrend(param_.trendHours, param_.trendResolution);
 		if (one->Start(portname, baudrate)) {
 			_gLog.Write(LOG_WARN, NULL, "failed to connect COOLER<%s>", portname.c_str());
 			return false;
@@ -103,18 +155,24 @@ bool AnnexControl::connect_serial(int devtype, Annex *device) {
 		else {
 			_gLog.Write("SUCCED: connection with COOLER<%s>", portname.c_str());
 			one->CoupleNetwork(tcp_, param_.groupid);
-			one->SetDatabase(param_.urlDB);
+			one->SetDatabase(db_);
 			cctl_.push_back(one);
 
 			for (vector<uint8_t>::iterator it = device->idd.begin(); it != device->idd.end(); ++it) {
 				one->AddDevice(*it);
 			}
+			for (PollCfgVec::iterator it = device->poll.begin(); it != device->poll.end(); ++it) {
+				one->SetPollRate(uint8_t(it->funcID), it->period, it->fast);
+			}
 		}
 	}
 	else {// 真空
 		const VacuumCtl::CBSlot& slot = boost::bind(&AnnexControl::vacuum_receive, this, _1, _2);
+		const VacuumCtl::CmdSlot& slotcmd = boost::bind(&AnnexControl::vacuum_command, this, _1, _2);
 		VacuumCPtr one = make_vacuum();
 		one->RegisterResult(slot);
+		one->RegisterCommand(slotcmd);
+		one->SetTrend(param_.trendHours, param_.trendResolution);
 		if (one->Start(portname, baudrate)) {
 			_gLog.Write(LOG_WARN, NULL, "failed to connect VACUUM<%s>", portname.c_str());
 			return false;
@@ -122,11 +180,15 @@ bool AnnexControl::connect_serial(int devtype, Annex *device) {
 		else {
 			_gLog.Write("SUCCED: connection with VACUUM<%s>", portname.c_str());
 			one->CoupleNetwork(tcp_, param_.groupid);
+			one->SetDatabase(db_);
 			vctl_.push_back(one);
 
 			for (vector<uint8_t>::iterator it = device->idd.begin(); it != device->idd.end(); ++it) {
 				one->AddDevice(*it);
 			}
+			for (PollCfgVec::iterator it = device->poll.begin(); it != device->poll.end(); ++it) {
+				one->SetPollRate(uint8_t(it->funcID), it->period, it->fast);
+			}
 		}
 	}
 	return true;
@@ -181,25 +243,42 @@ void AnnexControl::network_connect(const long client, const long ec) {
 }
 
 void AnnexControl::network_receive(const long client, const long ec) {
-	PostMessage(!ec ? MSG_RECEIVE_NETWORK : MSG_CLOSE_NETWORK);
+	PostMessage(!ec ? MSG_RECEIVE_NETWORK : MSG_CLOSE_NETWORK, client, ec);
 }
 
-void AnnexControl::cooler_receive(long client, long ec) {
-	PostMessage(MSG_CLOSE_COOLER, client);
+void AnnexControl::cooler_receive(ControllerBase* ctl, int ec) {
+	CtlClosed msg = { ctl, ec };
+	PostMessage(MSG_CLOSE_COOLER, msg);
+}
+
+void AnnexControl::vacuum_receive(ControllerBase* ctl, int ec) {
+	CtlClosed msg = { ctl, ec };
+	PostMessage(MSG_CLOSE_VACUUM, msg);
+}
+
+/*
+ * @note 在串口strand中执行, 转至消息队列向服务器应答
+ */
+void AnnexControl::cooler_command(long ctl, const ControllerBase::CommandResult& rslt) {
+	CtlCommand msg = { 1, rslt };
+	PostMessage(MSG_COMMAND_RESULT, msg);
 }
 
-void AnnexControl::vacuum_receive(long client, long ec) {
-	PostMessage(MSG_CLOSE_VACUUM, client);
+void AnnexControl::vacuum_command(long ctl, const ControllerBase::CommandResult& rslt) {
+	CtlCommand msg = { 2, rslt };
+	PostMessage(MSG_COMMAND_RESULT, msg);
 }
 
 void AnnexControl::on_connect_network(const long client, const long ec) {
+	if (!tcpconn_.use_count() || client != (const long) tcpconn_.get()) return; // 已废弃的连接
+
+	const ServerAddr& addr = param_.servers[iserver_];
+	TcpCPtr tcp = tcpconn_;
+	tcpconn_.reset();
 	if (!ec) {
-		_gLog.Write("SUCCEED: connection with server");
-		if (thrdnetwork_.unique()) {
-			thrdnetwork_->interrupt();
-			thrdnetwork_->join();
-			thrdnetwork_.reset();
-		}
+		tcp_ = tcp;
+		_gLog.Write("SUCCEED: connection with server<%s:%d>", addr.host.c_str(), addr.port);
+		backoff_ = param_.retryMin;
 		/* 关联串口设备 */
 		for (CoolCVec::iterator it = cctl_.begin(); it != cctl_.end(); ++it)
 			(*it)->CoupleNetwork(tcp_, param_.groupid);
@@ -207,47 +286,154 @@ void AnnexControl::on_connect_network(const long client, const long ec) {
 			(*it)->CoupleNetwork(tcp_, param_.groupid);
 	}
 	else {
-		tcp_.reset();
-		_gLog.Write(LOG_WARN, NULL, "failed to connect server<%s:%d>",
-				param_.ipServer.c_str(), param_.portServer);
+		tcp->Close();
+		_gLog.Write(LOG_WARN, NULL, "failed to connect server<%s:%d>", addr.host.c_str(), addr.port);
+		connect_next();
 	}
 }
 
 void AnnexControl::on_receive_network(const long client, const long ec) {
-
+	TcpCPtr tcp = tcp_;
+	if (!tcp.use_count()) return;
+
+	char buff[TCP_PACK_SIZE], first;
+	int pos, n;
+	while (1) {
+		if ((pos = tcp->Lookup("\n", 1)) < 0 || pos >= TCP_PACK_SIZE) {// 不完整的行, 或单行过长
+			if (tcp->Lookup(&first) < TCP_PACK_SIZE) break;
+			tcp->Read(buff, TCP_PACK_SIZE); // 丢弃
+			continue;
+		}
+		n = tcp->Read(buff, pos + 1);
+		buff[n - 1] = 0;
+		apbase proto = ascproto_->Resolve(buff);
+		if (!proto.use_count()) continue;
+		if (proto->type == "trend") respond_trend(from_apbase<ascii_proto_trend>(proto));
+		else if (proto->type == "cooler") command_cooler(from_apbase<ascii_proto_cooler>(proto));
+	}
 }
 
+/*
+ * @note 连接断开后首先尝试首选服务器
+ */
 void AnnexControl::on_close_network(const long client, const long ec) {
-	_gLog.Write("CLOSED: connection with server");
+	if (!tcp_.use_count() || client != (const long) tcp_.get()) return; // 已处理
+
+	TcpQueueStat stat = tcp_->GetQueueStat();
+	_gLog.Write("CLOSED: connection with server. messages queued: %lu, sent: %lu, dropped: %lu, coalesced: %lu",
+			(unsigned long) stat.queued, (unsigned long) stat.sent,
+			(unsigned long) stat.dropped, (unsigned long) stat.coalesced);
 	for (CoolCVec::iterator it = cctl_.begin(); it != cctl_.end(); ++it) (*it)->DecoupleNetwork();
 	for (VacuumCVec::iterator it = vctl_.begin(); it != vctl_.end(); ++it) (*it)->DecoupleNetwork();
+	tcp_->Close();
 	tcp_.reset();
-	thrdnetwork_.reset(new boost::thread(&AnnexControl::thread_network, this));
+	iserver_ = 0;
+	start_retry();
 }
 
-void AnnexControl::on_close_cooler(const long client, const long ec) {
-	CoolerCtl *ptr = (CoolerCtl*) client;
+void AnnexControl::on_retry_network(const long, const long) {
+	if (!(tcp_.use_count() || tcpconn_.use_count())) connect_server();
+}
+
+/*
+ * @note 控制接口可能连续报告多个错误, 仅响应第一条消息
+ */
+void AnnexControl::on_close_cooler(const CtlClosed& msg) {
+	mutex_lock lck(mtx_cctl_);
 	CoolCVec::iterator it, itend = cctl_.end();
 
-	_gLog.Write(LOG_WARN, NULL, "CLOSED: connection with cooler<%s>", ptr->GetPortname());
-	for (it = cctl_.begin(); it != itend && (*it).get() != ptr; ++it);
+	for (it = cctl_.begin(); it != itend && (*it).get() != msg.ctl; ++it);
+	if (it == itend) return;
+	_gLog.Write(LOG_WARN, NULL, "CLOSED: connection with cooler<%s>, error<%d>", (*it)->GetPortname(), msg.ec);
+	(*it)->Stop();
 	cctl_.erase(it);
 }
 
-void AnnexControl::on_close_vacuum(const long client, const long ec) {
-	VacuumCtl *ptr = (VacuumCtl*) client;
+void AnnexControl::on_close_vacuum(const CtlClosed& msg) {
+	mutex_lock lck(mtx_vctl_);
 	VacuumCVec::iterator it, itend = vctl_.end();
 
-	_gLog.Write(LOG_WARN, NULL, "CLOSED: connection with vacuum<%s>", ptr->GetPortname());
-	for (it = vctl_.begin(); it != itend && (*it).get() != ptr; ++it);
+	for (it = vctl_.begin(); it != itend && (*it).get() != msg.ctl; ++it);
+	if (it == itend) return;
+	_gLog.Write(LOG_WARN, NULL, "CLOSED: connection with vacuum<%s>, error<%d>", (*it)->GetPortname(), msg.ec);
+	(*it)->Stop();
 	vctl_.erase(it);
 }
 
-void AnnexControl::thread_network() {
-	boost::chrono::minutes period(1);
+void AnnexControl::respond_trend(aptrend proto) {
+	uint8_t idd = uint8_t(atoi(proto->cid.c_str()));
+	TrendStat stat;
+	bool found(false);
 
-	while(1) {
-		boost::this_thread::sleep_for(period);
-		if (!tcp_.unique()) connect_server();
+	if (boost::iequals(proto->device, "vacuum")) {
+		mutex_lock lck(mtx_vctl_);
+		for (VacuumCVec::iterator it = vctl_.begin(); !found && it != vctl_.end(); ++it)
+			found = (*it)->QueryTrend(idd, proto->channel, proto->window, stat);
 	}
+	else {
+		mutex_lock lck(mtx_cctl_);
+		for (CoolCVec::iterator it = cctl_.begin(); !found && it != cctl_.end(); ++it)
+			found = (*it)->QueryTrend(idd, proto->channel, proto->window, stat);
+	}
+
+	proto->gid   = param_.groupid;
+	proto->count = stat.count;
+	proto->min   = stat.min;
+	proto->max   = stat.max;
+	proto->mean  = stat.mean;
+	proto->slope = stat.slope;
+	proto->set_timeflag();
+
+	char tosend[ASCII_LINE_MAX];
+	int n = ascproto_->SerializeTrend(*proto, tosend, ASCII_LINE_MAX);
+	TcpCPtr tcp = tcp_;
+	if (tcp.use_count() && n) tcp->Write(tosend, n);
+}
+
+void AnnexControl::command_cooler(apcooler proto) {
+	if (proto->coolset == FLT_MIN) return; // 未指定制冷温度
+
+	uint8_t idd = uint8_t(atoi(proto->cid.c_str()));
+	{
+		mutex_lock lck(mtx_cctl_);
+		for (CoolCVec::iterator it = cctl_.begin(); it != cctl_.end(); ++it) {
+			if ((*it)->HasDevice(idd)) {
+				_gLog.Write("set coolset of cooler<%d> to %.1f", idd, proto->coolset);
+				(*it)->Write(idd, CFID_WRITE_COOLSET, double(proto->coolset));
+				return;
+			}
+		}
+	}
+	// 设备未连接: 立即应答失败
+	_gLog.Write(LOG_WARN, NULL, "cooler<%d> is not connected", idd);
+	CtlCommand msg;
+	msg.devtype = 1;
+	msg.rslt.idd = idd;
+	msg.rslt.idf = CFID_WRITE_COOLSET;
+	msg.rslt.priority = ControllerBase::PRIORITY_CONTROL;
+	msg.rslt.success = false;
+	msg.rslt.latency = msg.rslt.rtt = 0.0;
+	on_command_result(msg);
+}
+
+void AnnexControl::on_command_result(const CtlCommand& msg) {
+	TcpCPtr tcp = tcp_;
+	if (!tcp.use_count()) return;
+
+	const ControllerBase::CommandResult& rslt = msg.rslt;
+	ascii_proto_command proto;
+	char uid[8], cid[8], tosend[ASCII_LINE_MAX];
+	sprintf(uid, "%03d", rslt.idd / 10);
+	sprintf(cid, "%03d", rslt.idd);
+	proto.gid = param_.groupid;
+	proto.uid = uid;
+	proto.cid = cid;
+	proto.device   = msg.devtype == 1 ? "cooler" : "vacuum";
+	proto.function = rslt.idf;
+	proto.success  = rslt.success ? 1 : 0;
+	proto.latency  = rslt.latency;
+	proto.set_timeflag();
+
+	int n = ascproto_->SerializeCommand(proto, tosend, ASCII_LINE_MAX);
+	if (n) tcp->Write(tosend, n);
 }
@@ -25,14 +25,26 @@ public:
 protected:
 	/* 数据类型 */
 	enum MSG_AC {// 消息代码
-		MSG_CONNECT_NETWORK,		//< 连接服务器结果
+		MSG_CONNECT_NETWORK = MSG_USER,	//< 连接服务器结果
 		MSG_RECEIVE_NETWORK,		//< 收到网络消息
 		MSG_CLOSE_NETWORK,		//< 断开网络连接
+		MSG_RETRY_NETWORK,		//< 重新连接服务器
 		MSG_CLOSE_COOLER,		//< 温控控制器断开连接
 		MSG_CLOSE_VACUUM,		//< 真空度控制器断开连接
+		MSG_COMMAND_RESULT,		//< 控制指令执行完成
 		MSG_LAST		//< 占位
 	};
 
+	struct CtlClosed {// 消息MSG_CLOSE_COOLER与MSG_CLOSE_VACUUM携带的数据
+		ControllerBase *ctl;	//< 控制接口
+		int ec;					//< 错误代码
+	};
+
+	struct CtlCommand {// 消息MSG_COMMAND_RESULT携带的数据
+		int devtype;			//< 设备类型. 1: 温控; 2: 真空
+		ControllerBase::CommandResult rslt;	//< 执行结果
+	};
+
 	typedef boost::container::stable_vector<CoolCPtr> CoolCVec;		//< 矢量组: 温控
 	typedef boost::container::stable_vector<VacuumCPtr> VacuumCVec;	//< 矢量组: 真空
 
@@ -44,9 +56,14 @@ protected:
 	VacuumCVec vctl_;	//< 控制接口: 真空度
 	boost::mutex mtx_cctl_;	//< 互斥锁: 温控接口
 	boost::mutex mtx_vctl_;	//< 互斥锁: 真空度接口
-	TcpCPtr tcp_;			//< 网络接口
+	TcpCPtr tcp_;			//< 网络接口, 已建立连接
+	TcpCPtr tcpconn_;		//< 正在建立连接的网络接口
+	AscProtoPtr ascproto_;	//< 通信协议接口
 	NTPPtr  ntp_;			//< 时间接口
-	threadptr thrdnetwork_;	//< 周期线程, 监测网络状态, 重新连接服务器
+	UploaderPtr db_;		//< 数据库上传接口, 各控制器共用
+	boost::asio::deadline_timer tmrnetwork_;	//< 定时器: 重新连接服务器
+	int iserver_;			//< 正在连接的服务器在列表中的索引
+	double backoff_;		//< 全部服务器连接失败后的重试间隔, 量纲: 秒
 
 public:
 	/* 接口 */
@@ -68,9 +85,22 @@ protected:
 	 */
 	void register_messages();
 	/*!
-	 * @brief 连接服务器
+	 * @brief 异步连接服务器列表中的当前服务器
+	 */
+	void connect_server();
+	/*!
+	 * @brief 连接失败后尝试列表中的下一个服务器. 全部失败后等待重试
 	 */
-	bool connect_server(bool async = true);
+	void connect_next();
+	/*!
+	 * @brief 启动重连定时器, 并按2倍递增重试间隔
+	 */
+	void start_retry();
+	/*!
+	 * @brief 重连定时器到期
+	 * @param ec 错误代码
+	 */
+	void retry_network(const boost::system::error_code& ec);
 	/*!
 	 * @brief 尝试连接串口
 	 * @param devtype   设备类型. 1: 温控; 2: 真空
@@ -106,17 +136,29 @@ protected:
 	 */
 	void network_receive(const long client, const long ec);
 	/*!
-	 * @brief 处理收到温控信息
-	 * @param client 控制接口
-	 * @param ec     错误字. 0: 成功
+	 * @brief 处理温控接口异常
+	 * @param ctl 控制接口
+	 * @param ec  错误代码
+	 */
+	void cooler_receive(ControllerBase* ctl, int ec);
+	/*!
+	 * @brief 处理真空度接口异常
+	 * @param ctl 控制接口
+	 * @param ec  错误代码
 	 */
-	void cooler_receive(long client, long ec);
+	void vacuum_receive(ControllerBase* ctl, int ec);
 	/*!
-	 * @brief 处理收到真空度信息
-	 * @param client 控制接口
-	 * @param ec     错误字. 0: 成功
+	 * @brief 处理温控接口控制指令执行结果
+	 * @param ctl  控制接口
+	 * @param rslt 执行结果
 	 */
-	void vacuum_receive(long client, long ec);
+	void cooler_command(long ctl, const ControllerBase::CommandResult& rslt);
+	/*!
+	 * @brief 处理真空度接口控制指令执行结果
+	 * @param ctl  控制接口
+	 * @param rslt 执行结果
+	 */
+	void vacuum_command(long ctl, const ControllerBase::CommandResult& rslt);
 	/*!
 	 * @brief 与服务器异步连接结果
 	 * @param client
@@ -135,22 +177,35 @@ protected:
 	 * @param ec
 	 */
 	void on_close_network(const long client, const long ec);
+	/*!
+	 * @brief 重新连接服务器
+	 */
+	void on_retry_network(const long, const long);
 	/*!
 	 * @brief 温控控制器断开连接
-	 * @param client
-	 * @param ec
+	 * @param msg 控制接口与错误代码
 	 */
-	void on_close_cooler(const long client, const long ec);
+	void on_close_cooler(const CtlClosed& msg);
 	/*!
 	 * @brief 真空度控制器断开连接
-	 * @param client
-	 * @param ec
+	 * @param msg 控制接口与错误代码
+	 */
+	void on_close_vacuum(const CtlClosed& msg);
+	/*!
+	 * @brief 响应趋势查询, 统计内存中的监测数据
+	 * @param proto 查询协议. 填充统计结果后作为应答发送
+	 */
+	void respond_trend(aptrend proto);
+	/*!
+	 * @brief 响应温控协议: 服务器发送的cooler协议为控制指令, 目前支持设置制冷温度
+	 * @param proto 控制协议
 	 */
-	void on_close_vacuum(const long client, const long ec);
+	void command_cooler(apcooler proto);
 	/*!
-	 * @brief 线程: 定时重新连接服务器
+	 * @brief 控制指令执行完成, 向服务器发送执行结果与延时
+	 * @param msg 设备类型与执行结果
 	 */
-	void thread_network();
+	void on_command_result(const CtlCommand& msg);
 };
 
 #endif /* ANNEXCONTROL_H_ */
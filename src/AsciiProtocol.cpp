@@ -5,11 +5,16 @@
  **/
 
 #include <boost/make_shared.hpp>
-#include <boost/algorithm/string.hpp>
+#include <boost/utility/string_ref.hpp>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include "AsciiProtocol.h"
 
 using namespace boost;
+using boost::string_ref;
 
 //////////////////////////////////////////////////////////////////////////////
 /* 为各协议生成共享型指针 */
@@ -21,141 +26,424 @@ apvacuum make_apvacuum() {
 	return boost::make_shared<ascii_proto_vacuum>();
 }
 
+aptrend make_aptrend() {
+	return boost::make_shared<ascii_proto_trend>();
+}
+
+apcommand make_apcommand() {
+	return boost::make_shared<ascii_proto_command>();
+}
+
 AscProtoPtr make_ascproto() {
 	return boost::make_shared<AsciiProtocol>();
 }
 //////////////////////////////////////////////////////////////////////////////
 
-AsciiProtocol::AsciiProtocol() {
-	ibuf_ = 0;
-	buff_.reset(new char[1024 * 10]); //< 存储区
-}
+//////////////////////////////////////////////////////////////////////////////
+/*---------------- 键值对输出 ----------------*/
+/*!
+ * @brief 按%g格式输出浮点数, 6位有效数字
+ * @param buff 存储区, 不少于16字节
+ * @param x    浮点数
+ * @return
+ * 输出字符串长度
+ * @note
+ * - 常用量程[1E-4, 1E6)内以整数运算生成, 其它数值(含0和未赋值的FLT_MIN)调用snprintf
+ * - 与%g仅可能在十进制舍入边界附近相差末位1个单位
+ */
+static int format_float(char* buff, double x) {
+	static const double pow10[] = {1E-4, 1E-3, 1E-2, 1E-1, 1E0, 1E1, 1E2, 1E3, 1E4, 1E5, 1E6, 1E7, 1E8, 1E9};
+	static const uint32_t ipow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+	double ax = x < 0.0 ? -x : x;
+	if (!(ax >= 1E-4 && ax < 1E6)) return snprintf(buff, 16, "%g", x);
 
-AsciiProtocol::~AsciiProtocol() {
+	int e, f;	// e: 十进制指数; f: 小数位数
+	for (e = 5; ax < pow10[e + 4]; --e);
+	f = 5 - e;
+	double scaled = ax * pow10[f + 4];
+	uint32_t m = uint32_t(scaled);
+	double rem = scaled - m;
+	if (rem > 0.5 || (rem == 0.5 && (m & 1))) ++m;	// 与%g一致, 恰在中点时向偶数舍入
+	if (m >= 1000000) {// 进位后有效数字增加一位
+		if (--f < 0) return snprintf(buff, 16, "%g", x);
+		m /= 10;
+	}
+	uint32_t ipart = m / ipow10[f], fpart = m % ipow10[f];
+	while (f > 0 && fpart % 10 == 0) {
+		fpart /= 10;
+		--f;
+	}
+
+	char digits[12], *ptr = buff;
+	int n = 0;
+	if (x < 0.0) *ptr++ = '-';
+	do {
+		digits[n++] = char('0' + ipart % 10);
+	} while (ipart /= 10);
+	while (n) *ptr++ = digits[--n];
+	if (f) {
+		*ptr++ = '.';
+		for (n = f - 1; n >= 0; --n, fpart /= 10) ptr[n] = char('0' + fpart % 10);
+		ptr += f;
+	}
+	return int(ptr - buff);
 }
 
-const char* AsciiProtocol::output_compacted(string& output, int& n) {
-	mutex_lock lck(mtx_);
-	char* buff = buff_.get() + ibuf_ * 1024;
-	if (++ibuf_ == 10) ibuf_ = 0;
-	trim_right_if(output, is_punct() || is_space());
-	n = sprintf(buff, "%s\n", output.c_str());
-	return buff;
+/*!
+ * @brief 输出十进制整数
+ */
+static int format_int(char* buff, int x) {
+	char digits[12], *ptr = buff;
+	unsigned int ux = x < 0 ? 0u - unsigned(x) : unsigned(x);
+	int n = 0;
+	if (x < 0) *ptr++ = '-';
+	do {
+		digits[n++] = char('0' + ux % 10);
+	} while (ux /= 10);
+	while (n) *ptr++ = digits[--n];
+	return int(ptr - buff);
 }
 
-bool AsciiProtocol::resolve_kv(string& kv, string& keyword, string& value) {
-	char seps[] = "=";	// 分隔符: 等号
-	listring tokens;
+/*!
+ * @class line_writer 将协议类型与键值对依次写入存储区
+ * @note
+ * - 存储区不足时后续写入被忽略, finish()返回0
+ * - 数值先写入局部数组, 不分配内存
+ */
+class line_writer {
+protected:
+	char *ptr_;		//< 写入位置
+	char *end_;		//< 存储区结束位置
+	bool overflow_;	//< 存储区不足
+
+public:
+	line_writer(char* buff, int size) {
+		ptr_ = buff;
+		end_ = buff + size;
+		overflow_ = false;
+	}
+
+	void append(const char* data, int n) {
+		if (overflow_ || ptr_ + n > end_) overflow_ = true;
+		else {
+			memcpy(ptr_, data, n);
+			ptr_ += n;
+		}
+	}
+
+	void append(char ch) {
+		append(&ch, 1);
+	}
+
+	void kv(const char* key, const string& value) {
+		append(key, int(strlen(key)));
+		append('=');
+		append(value.data(), int(value.size()));
+		append(',');
+	}
+
+	void kv(const char* key, double value) {
+		char buff[32];
+		append(key, int(strlen(key)));
+		append('=');
+		append(buff, format_float(buff, value));
+		append(',');
+	}
+
+	void kv(const char* key, int value) {
+		char buff[16];
+		append(key, int(strlen(key)));
+		append('=');
+		append(buff, format_int(buff, value));
+		append(',');
+	}
+
+	/*!
+	 * @brief 写入协议头: 类型与可选的时间
+	 */
+	void head(const ascii_proto_base& proto) {
+		append(proto.type.data(), int(proto.type.size()));
+		append(' ');
+		if (!proto.utc.empty()) kv("time", proto.utc);
+		kv("group_id", proto.gid);
+		kv("unit_id",  proto.uid);
+		kv("cam_id",   proto.cid);
+	}
 
-	keyword = "";
-	value   = "";
-	algorithm::split(tokens, kv, is_any_of(seps), token_compress_on);
-	if (!tokens.empty()) { keyword = tokens.front(); trim(keyword); tokens.pop_front(); }
-	if (!tokens.empty()) { value   = tokens.front(); trim(value); }
-	return (!(keyword.empty() || value.empty()));
+	/*!
+	 * @brief 删除末尾分隔符, 以换行符结束
+	 * @return
+	 * 字符串长度. 存储区不足时返回0
+	 */
+	int finish(char* buff) {
+		if (overflow_) return 0;
+		while (ptr_ > buff && (ispunct(ptr_[-1]) || isspace(ptr_[-1]))) --ptr_;
+		append('\n');
+		return overflow_ ? 0 : int(ptr_ - buff);
+	}
+};
+
+//////////////////////////////////////////////////////////////////////////////
+AsciiProtocol::AsciiProtocol() {
+}
+
+AsciiProtocol::~AsciiProtocol() {
 }
 
 //////////////////////////////////////////////////////////////////////////////
 /*---------------- 封装通信协议 ----------------*/
-const char *AsciiProtocol::CompactCooler(apcooler proto, int &n) {
-	if (!proto.use_count()) return NULL;
+int AsciiProtocol::SerializeCooler(const ascii_proto_cooler& proto, char* buff, int size) {
+	line_writer writer(buff, size);
+
+	writer.head(proto);
+	writer.kv("voltage",  proto.voltage);
+	writer.kv("current",  proto.current);
+	writer.kv("hotend",   proto.hotend);
+	writer.kv("coolget",  proto.coolget);
+	writer.kv("coolset",  proto.coolset);
+
+	return writer.finish(buff);
+}
 
-	string output = proto->type + " ";
+int AsciiProtocol::SerializeVacuum(const ascii_proto_vacuum& proto, char* buff, int size) {
+	line_writer writer(buff, size);
 
-	if (!proto->utc.empty()) join_kv(output, "time", proto->utc);
-	join_kv(output, "group_id", proto->gid);
-	join_kv(output, "unit_id",  proto->uid);
-	join_kv(output, "cam_id",   proto->cid);
-	join_kv(output, "voltage",  proto->voltage);
-	join_kv(output, "current",  proto->current);
-	join_kv(output, "hotend",   proto->hotend);
-	join_kv(output, "coolget",  proto->coolget);
-	join_kv(output, "coolset",  proto->coolset);
+	writer.head(proto);
+	writer.kv("voltage",  proto.voltage);
+	writer.kv("current",  proto.current);
+	writer.kv("pressure", proto.pressure);
 
-	return output_compacted(output, n);
+	return writer.finish(buff);
 }
 
-const char *AsciiProtocol::CompactVacuum(apvacuum proto, int &n) {
-	if (!proto.use_count()) return NULL;
+int AsciiProtocol::SerializeTrend(const ascii_proto_trend& proto, char* buff, int size) {
+	line_writer writer(buff, size);
+
+	writer.head(proto);
+	writer.kv("device",  proto.device);
+	writer.kv("channel", proto.channel);
+	writer.kv("window",  proto.window);
+	writer.kv("count",   proto.count);
+	if (proto.count) {
+		writer.kv("min",   proto.min);
+		writer.kv("max",   proto.max);
+		writer.kv("mean",  proto.mean);
+		writer.kv("slope", proto.slope);
+	}
+
+	return writer.finish(buff);
+}
 
-	string output = proto->type + " ";
+int AsciiProtocol::SerializeCommand(const ascii_proto_command& proto, char* buff, int size) {
+	line_writer writer(buff, size);
 
-	if (!proto->utc.empty()) join_kv(output, "time", proto->utc);
-	join_kv(output, "group_id", proto->gid);
-	join_kv(output, "unit_id",  proto->uid);
-	join_kv(output, "cam_id",   proto->cid);
-	join_kv(output, "voltage",  proto->voltage);
-	join_kv(output, "current",  proto->current);
-	join_kv(output, "pressure", proto->pressure);
+	writer.head(proto);
+	writer.kv("device",   proto.device);
+	writer.kv("function", proto.function);
+	writer.kv("success",  proto.success);
+	writer.kv("latency",  proto.latency);
 
-	return output_compacted(output, n);
+	return writer.finish(buff);
 }
 
 //////////////////////////////////////////////////////////////////////////////
-apbase AsciiProtocol::Resolve(const char *rcvd) {
-	const char seps[] = ",", *ptr;
-	char ch;
-	listring tokens;
-	apbase proto;
-	string type;
+/*---------------- 关键字识别 ----------------*/
+enum {// 协议类型与关键字
+	KW_NONE,
+	KW_COOLER, KW_VACUUM, KW_TREND,
+	KW_TIME, KW_GROUP_ID, KW_UNIT_ID, KW_CAM_ID,
+	KW_VOLTAGE, KW_CURRENT, KW_HOTEND, KW_COOLGET, KW_COOLSET, KW_PRESSURE,
+	KW_DEVICE, KW_CHANNEL, KW_WINDOW, KW_COUNT, KW_MIN, KW_MAX, KW_MEAN, KW_SLOPE
+};
 
-	for (ptr = rcvd; *ptr && *ptr != ' '; ++ptr) type += *ptr;
-	while (*ptr && *ptr == ' ') ++ptr;
+struct keyword_entry {// 散列表单元
+	const char *name;	//< 关键字
+	int len;			//< 关键字长度
+	int id;				//< 关键字编号
+};
 
-	if (*ptr) algorithm::split(tokens, ptr, is_any_of(seps), token_compress_on);
-	if      ((ch = type[0]) == 'a') {
+/*!
+ * @brief 查找协议类型或关键字
+ * @param key 关键字, 不区分大小写
+ * @return
+ * 关键字编号. 无效关键字返回KW_NONE
+ * @note
+ * 散列值由长度、第2个与倒数第3个字符生成, 对全部协议类型与关键字无冲突.
+ * 增加关键字时需重新选择散列参数
+ */
+static int lookup_keyword(const string_ref& key) {
+	static const keyword_entry table[64] = {
+		{NULL, 0, KW_NONE}, {NULL, 0, KW_NONE}, {"coolset", 7, KW_COOLSET}, {NULL, 0, KW_NONE},
+		{NULL, 0, KW_NONE}, {NULL, 0, KW_NONE}, {NULL, 0, KW_NONE}, {NULL, 0, KW_NONE},
+		{"count", 5, KW_COUNT}, {"hotend", 6, KW_HOTEND}, {NULL, 0, KW_NONE}, {"trend", 5, KW_TREND},
+		{NULL, 0, KW_NONE}, {NULL, 0, KW_NONE}, {"pressure", 8, KW_PRESSURE}, {"device", 6, KW_DEVICE},
+		{"current", 7, KW_CURRENT}, {"time", 4, KW_TIME}, {"coolget", 7, KW_COOLGET}, {NULL, 0, KW_NONE},
+		{NULL, 0, KW_NONE}, {NULL, 0, KW_NONE}, {NULL, 0, KW_NONE}, {NULL, 0, KW_NONE},
+		{"max", 3, KW_MAX}, {NULL, 0, KW_NONE}, {NULL, 0, KW_NONE}, {NULL, 0, KW_NONE},
+		{NULL, 0, KW_NONE}, {NULL, 0, KW_NONE}, {NULL, 0, KW_NONE}, {NULL, 0, KW_NONE},
+		{"min", 3, KW_MIN}, {NULL, 0, KW_NONE}, {NULL, 0, KW_NONE}, {"cam_id", 6, KW_CAM_ID},
+		{NULL, 0, KW_NONE}, {"cooler", 6, KW_COOLER}, {NULL, 0, KW_NONE}, {"channel", 7, KW_CHANNEL},
+		{NULL, 0, KW_NONE}, {NULL, 0, KW_NONE}, {NULL, 0, KW_NONE}, {NULL, 0, KW_NONE},
+		{NULL, 0, KW_NONE}, {"slope", 5, KW_SLOPE}, {NULL, 0, KW_NONE}, {NULL, 0, KW_NONE},
+		{NULL, 0, KW_NONE}, {"unit_id", 7, KW_UNIT_ID}, {NULL, 0, KW_NONE}, {NULL, 0, KW_NONE},
+		{NULL, 0, KW_NONE}, {NULL, 0, KW_NONE}, {"group_id", 8, KW_GROUP_ID}, {NULL, 0, KW_NONE},
+		{NULL, 0, KW_NONE}, {NULL, 0, KW_NONE}, {"voltage", 7, KW_VOLTAGE}, {"vacuum", 6, KW_VACUUM},
+		{NULL, 0, KW_NONE}, {"mean", 4, KW_MEAN}, {NULL, 0, KW_NONE}, {"window", 6, KW_WINDOW}
+	};
+	int n = int(key.size());
+	if (n < 3) return KW_NONE;
+	const char *s = key.data();
+	const keyword_entry& entry = table[(n + 4 * (s[n - 3] | 0x20) + (s[1] | 0x20)) & 63];
+	return (entry.len == n && !strncasecmp(entry.name, s, n)) ? entry.id : KW_NONE;
+}
 
-	}
-	else if (ch == 'b') {
+/*!
+ * @brief 删除首尾空白字符
+ */
+static string_ref trim_ref(const char* first, const char* last) {
+	while (first < last && isspace(*first)) ++first;
+	while (last > first && isspace(last[-1])) --last;
+	return string_ref(first, last - first);
+}
 
+/*!
+ * @class kv_scanner 单次遍历协议主体, 依次给出keyword=value对
+ * @note
+ * - 键值对以逗号分隔, 关键字与数值以等号分隔. 忽略空键值对与关键字或数值为空的键值对
+ * - keyword与value指向原字符串, 不复制
+ */
+class kv_scanner {
+protected:
+	const char *ptr_;	//< 待解析位置
+
+public:
+	kv_scanner(const char* body) {
+		ptr_ = body;
 	}
-	else if (ch == 'c') {
-		if (iequals(type, "cooler")) proto = resolve_cooler(tokens);
+
+	bool next(string_ref& keyword, string_ref& value) {
+		while (*ptr_) {
+			const char *token = ptr_, *end, *eq(NULL), *first, *last;
+			for (end = token; *end && *end != ','; ++end) {
+				if (!eq && *end == '=') eq = end;
+			}
+			ptr_ = *end ? end + 1 : end;
+			if (!eq) continue;
+
+			for (first = eq; first < end && *first == '='; ++first);
+			for (last = first; last < end && *last != '='; ++last);
+			keyword = trim_ref(token, eq);
+			value   = trim_ref(first, last);
+			if (!(keyword.empty() || value.empty())) return true;
+		}
+		return false;
 	}
-	else if (ch == 'v') {
-		if (iequals(type, "vacuum")) proto = resolve_vacuum(tokens);
+};
+
+static inline void assign_ref(string& output, const string_ref& value) {
+	output.assign(value.data(), value.size());
+}
+
+/*!
+ * @brief 转换数值
+ * @note
+ * value指向以NULL结尾的原字符串, strtod在逗号或等号处停止, 无需复制
+ */
+static inline double to_double(const string_ref& value) {
+	return strtod(value.data(), NULL);
+}
+
+/*!
+ * @brief 解析各协议共有的关键字
+ * @return
+ * 关键字属于共有关键字
+ */
+static bool resolve_head(ascii_proto_base& proto, int id, const string_ref& value) {
+	switch (id) {
+	case KW_TIME:     assign_ref(proto.utc, value); break;
+	case KW_GROUP_ID: assign_ref(proto.gid, value); break;
+	case KW_UNIT_ID:  assign_ref(proto.uid, value); break;
+	case KW_CAM_ID:   assign_ref(proto.cid, value); break;
+	default: return false;
 	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+apbase AsciiProtocol::Resolve(const char *rcvd) {
+	const char *ptr;
+	apbase proto;
+
+	for (ptr = rcvd; *ptr && *ptr != ' '; ++ptr);
+	int id = lookup_keyword(string_ref(rcvd, ptr - rcvd));
+	while (*ptr == ' ') ++ptr;
+
+	if      (id == KW_COOLER) proto = resolve_cooler(ptr);
+	else if (id == KW_VACUUM) proto = resolve_vacuum(ptr);
+	else if (id == KW_TREND)  proto = resolve_trend(ptr);
 
 	return proto;
 }
 
-apbase AsciiProtocol::resolve_cooler(listring& tokens) {
+apbase AsciiProtocol::resolve_cooler(const char *body) {
 	apcooler proto = boost::make_shared<ascii_proto_cooler>();
-	listring::iterator itend = tokens.end();
-	string keyword, value;
-
-	for (listring::iterator it = tokens.begin(); it != itend; ++it) {// 遍历键值对
-		if (!resolve_kv(*it, keyword, value)) continue;
-		// 识别关键字
-		if      (iequals(keyword, "group_id")) proto->gid = value;
-		else if (iequals(keyword, "unit_id"))  proto->uid = value;
-		else if (iequals(keyword, "cam_id"))   proto->cid = value;
-		else if (iequals(keyword, "voltage"))  proto->voltage = atof(value.c_str());
-		else if (iequals(keyword, "current"))  proto->current = atof(value.c_str());
-		else if (iequals(keyword, "hotend"))   proto->hotend  = atof(value.c_str());
-		else if (iequals(keyword, "coolget"))  proto->coolget = atof(value.c_str());
-		else if (iequals(keyword, "coolset"))  proto->coolset = atof(value.c_str());
-		else if (iequals(keyword, "time"))     proto->utc = value;
+	kv_scanner scanner(body);
+	string_ref keyword, value;
+
+	while (scanner.next(keyword, value)) {// 遍历键值对
+		int id = lookup_keyword(keyword);
+		if (resolve_head(*proto, id, value)) continue;
+		switch (id) {
+		case KW_VOLTAGE: proto->voltage = to_double(value); break;
+		case KW_CURRENT: proto->current = to_double(value); break;
+		case KW_HOTEND:  proto->hotend  = to_double(value); break;
+		case KW_COOLGET: proto->coolget = to_double(value); break;
+		case KW_COOLSET: proto->coolset = to_double(value); break;
+		default: break;
+		}
 	}
 
 	return to_apbase(proto);
 }
 
-apbase AsciiProtocol::resolve_vacuum(listring& tokens) {
+apbase AsciiProtocol::resolve_vacuum(const char *body) {
 	apvacuum proto = boost::make_shared<ascii_proto_vacuum>();
-	listring::iterator itend = tokens.end();
-	string keyword, value;
-
-	for (listring::iterator it = tokens.begin(); it != itend; ++it) {// 遍历键值对
-		if (!resolve_kv(*it, keyword, value)) continue;
-		// 识别关键字
-		if      (iequals(keyword, "group_id")) proto->gid = value;
-		else if (iequals(keyword, "unit_id"))  proto->uid = value;
-		else if (iequals(keyword, "cam_id"))   proto->cid = value;
-		else if (iequals(keyword, "voltage"))  proto->voltage = atof(value.c_str());
-		else if (iequals(keyword, "current"))  proto->current = atof(value.c_str());
-		else if (iequals(keyword, "pressure")) proto->pressure = value;
-		else if (iequals(keyword, "time"))     proto->utc = value;
+	kv_scanner scanner(body);
+	string_ref keyword, value;
+
+	while (scanner.next(keyword, value)) {// 遍历键值对
+		int id = lookup_keyword(keyword);
+		if (resolve_head(*proto, id, value)) continue;
+		switch (id) {
+		case KW_VOLTAGE:  proto->voltage = to_double(value); break;
+		case KW_CURRENT:  proto->current = to_double(value); break;
+		case KW_PRESSURE: assign_ref(proto->pressure, value); break;
+		default: break;
+		}
+	}
+
+	return to_apbase(proto);
+}
+
+apbase AsciiProtocol::resolve_trend(const char *body) {
+	aptrend proto = boost::make_shared<ascii_proto_trend>();
+	kv_scanner scanner(body);
+	string_ref keyword, value;
+
+	while (scanner.next(keyword, value)) {// 遍历键值对
+		int id = lookup_keyword(keyword);
+		if (resolve_head(*proto, id, value)) continue;
+		switch (id) {
+		case KW_DEVICE:  assign_ref(proto->device, value);  break;
+		case KW_CHANNEL: assign_ref(proto->channel, value); break;
+		case KW_WINDOW:  proto->window = to_double(value); break;
+		case KW_COUNT:   proto->count  = int(strtol(value.data(), NULL, 10)); break;
+		case KW_MIN:     proto->min    = to_double(value); break;
+		case KW_MAX:     proto->max    = to_double(value); break;
+		case KW_MEAN:    proto->mean   = to_double(value); break;
+		case KW_SLOPE:   proto->slope  = to_double(value); break;
+		default: break;
+		}
 	}
 
 	return to_apbase(proto);
@@ -4,6 +4,23 @@
  * @date 2017-11-17
  * - 通信协议采用Struct声明
  * - 通信协议继承自ascii_protocol_base
+ * @version 0.2
+ * @date 2026-10-16
+ * - 增加趋势协议trend: 查询设备监测数据在最近时间窗内的统计值
+ * @version 0.3
+ * @date 2026-10-17
+ * - 封装协议直接写入调用者提供的存储区, 不构建中间字符串, 不分配内存
+ * - 浮点数按%g格式输出6位有效数字. 常用量程内以整数运算生成
+ * - 取消循环复用的10个共享存储区
+ * @version 0.4
+ * @date 2026-10-17
+ * - 解析协议单次遍历原字符串, 关键字与数值以string_ref指向原字符串, 不再拆分为string列表
+ * - 协议类型与关键字采用完美散列查表, 取代逐个iequals比较
+ * - 数值由strtod在原字符串上直接转换, 写入协议结构体
+ * - 趋势协议解析应答中的count, min, max, mean, slope
+ * @version 0.5
+ * @date 2026-10-17
+ * - 增加控制应答协议command: 控制指令完成或超时后, 向服务器报告执行结果与延时
  */
 
 #ifndef ASCIIPROTOCOL_H_
@@ -16,6 +33,8 @@
 
 using std::list;
 
+#define ASCII_LINE_MAX		1024	//< 单条协议最大长度, 量纲: 字节
+
 //////////////////////////////////////////////////////////////////////////////
 /*--------------------------------- 声明通信协议 ---------------------------------*/
 
@@ -50,6 +69,53 @@ public:
 typedef boost::shared_ptr<ascii_proto_vacuum> apvacuum;
 extern apvacuum make_apvacuum();
 
+/*
+ * 查询: trend device=cooler,cam_id=001,channel=coolget,window=3600
+ * 应答: 在查询基础上增加count, min, max, mean, slope. count=0表示无数据
+ */
+struct ascii_proto_trend : public ascii_proto_base {// 监测数据趋势
+	string device;	//< 设备类型: cooler或vacuum
+	string channel;	//< 通道名称, 与cooler/vacuum协议关键字一致
+	double window;	//< 时间窗, 量纲: 秒. <=0时统计全部已保存数据
+	int count;		//< 时间窗内数据数量
+	double min;		//< 最小值
+	double max;		//< 最大值
+	double mean;	//< 均值
+	double slope;	//< 变化率, 量纲: 单位/秒
+
+public:
+	ascii_proto_trend() {
+		type = "trend";
+		device = "cooler";
+		window = 3600.0;
+		count = 0;
+		min = max = mean = slope = 0.0;
+	}
+};
+typedef boost::shared_ptr<ascii_proto_trend> aptrend;
+extern aptrend make_aptrend();
+
+/*
+ * 控制: cooler cam_id=001,coolset=-40
+ * 应答: command time=...,group_id=001,unit_id=000,cam_id=001,device=cooler,function=22,success=1,latency=5.3
+ */
+struct ascii_proto_command : public ascii_proto_base {// 控制指令执行结果
+	string device;	//< 设备类型: cooler或vacuum
+	int function;	//< 功能编号
+	int success;	//< 1: 设备在时限内应答; 0: 重发后仍超时
+	double latency;	//< 从入队到完成的延时, 量纲: 毫秒
+
+public:
+	ascii_proto_command() {
+		type = "command";
+		device = "cooler";
+		function = success = 0;
+		latency = 0.0;
+	}
+};
+typedef boost::shared_ptr<ascii_proto_command> apcommand;
+extern apcommand make_apcommand();
+
 //////////////////////////////////////////////////////////////////////////////
 /*!
  * @class AsciiProtocol 通信协议操作接口, 封装协议解析与构建过程
@@ -63,63 +129,36 @@ public:
 	/* 数据类型 */
 	typedef boost::unique_lock<boost::mutex> mutex_lock;	//< 互斥锁
 	typedef boost::shared_array<char> charray;	//< 字符数组
-	typedef list<string> listring;	//< string列表
-
-protected:
-	/* 成员变量 */
-	boost::mutex mtx_;	//< 互斥锁
-	int ibuf_;			//< 存储区索引
-	charray buff_;		//< 存储区
 
-protected:
+public:
+	/*---------------- 封装通信协议 ----------------*/
 	/*!
-	 * @brief 输出编码后字符串
-	 * @param compacted 已编码字符串
-	 * @param n         输出字符串长度, 量纲: 字节
+	 * @brief 封装温度协议, 写入调用者提供的存储区
+	 * @param proto 协议内容
+	 * @param buff  存储区
+	 * @param size  存储区大小, 量纲: 字节
 	 * @return
-	 * 编码后字符串
-	 */
-	const char* output_compacted(string& output, int& n);
-	/*!
-	 * @brief 连接关键字和对应数值, 并将键值对加入output末尾
-	 * @param output   输出字符串
-	 * @param keyword  关键字
-	 * @param value    非字符串型数值
+	 * 封装后字符串长度. 存储区不足时返回0
 	 */
-	template <class T1, class T2>
-	void join_kv(string& output, T1& keyword, T2& value) {
-		boost::format fmt("%1%=%2%,");
-		fmt % keyword % value;
-		output += fmt.str();
-	}
+	int SerializeCooler(const ascii_proto_cooler& proto, char* buff, int size);
 	/*!
-	 * @brief 解析关键字和对应数值
-	 * @param kv       keyword=value对
-	 * @param keyword  关键字
-	 * @param value    对应数值
+	 * @brief 封装真空度协议, 写入调用者提供的存储区
 	 * @return
-	 * 关键字和数值非空
+	 * 封装后字符串长度. 存储区不足时返回0
 	 */
-	bool resolve_kv(string& kv, string& keyword, string& value);
-
-public:
-	/*---------------- 封装通信协议 ----------------*/
+	int SerializeVacuum(const ascii_proto_vacuum& proto, char* buff, int size);
 	/*!
-	 * @brief 封装温度协议为字符串
-	 * @param proto 协议内容
-	 * @param n     封装后字符串长度
+	 * @brief 封装趋势协议, 写入调用者提供的存储区
 	 * @return
-	 * 封装后字符串
+	 * 封装后字符串长度. 存储区不足时返回0
 	 */
-	const char *CompactCooler(apcooler proto, int &n);
+	int SerializeTrend(const ascii_proto_trend& proto, char* buff, int size);
 	/*!
-	 * @brief 封装真空度协议为字符串
-	 * @param proto 协议内容
-	 * @param n     封装后字符串长度
+	 * @brief 封装控制应答协议, 写入调用者提供的存储区
 	 * @return
-	 * 封装后字符串
+	 * 封装后字符串长度. 存储区不足时返回0
 	 */
-	const char *CompactVacuum(apvacuum proto, int &n);
+	int SerializeCommand(const ascii_proto_command& proto, char* buff, int size);
 
 public:
 	/*---------------- 解析通信协议 ----------------*/
@@ -135,18 +174,25 @@ protected:
 	/*---------------- 解析通信协议 ----------------*/
 	/*!
 	 * @brief 解析字符串为结构化温度协议
-	 * @param tokens 协议主体
+	 * @param body 协议主体, 即协议类型之后的键值对
 	 * @return
 	 * 转换为apbase的结构化协议
 	 */
-	apbase resolve_cooler(listring& tokens);
+	apbase resolve_cooler(const char *body);
 	/*!
 	 * @brief 解析字符串为结构化真空度协议
-	 * @param tokens 协议主体
+	 * @param body 协议主体
+	 * @return
+	 * 转换为apbase的结构化协议
+	 */
+	apbase resolve_vacuum(const char *body);
+	/*!
+	 * @brief 解析字符串为结构化趋势协议
+	 * @param body 协议主体
 	 * @return
 	 * 转换为apbase的结构化协议
 	 */
-	apbase resolve_vacuum(listring& tokens);
+	apbase resolve_trend(const char *body);
 };
 
 typedef boost::shared_ptr<AsciiProtocol> AscProtoPtr;
@@ -0,0 +1,441 @@
+/**
+ * @file AsyncTransfer.cpp 基于curl multi接口的异步HTTP上传定义文件
+ * @date 2026-10-16
+ * @version 0.1
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <boost/make_shared.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/future.hpp>
+#include "AsyncTransfer.h"
+#include "DataTransfer.h"
+#include "data.h"
+
+using namespace boost::posix_time;
+
+AsyncTransferPtr make_async_transfer(const string& rootUrl) {
+	return boost::make_shared<AsyncTransfer>(rootUrl);
+}
+
+AsyncTransfer::AsyncTransfer(const string& rootUrl)
+	: timer_(keep_.get_service()) {
+	rootUrl_  = rootUrl;
+	running_  = 0;
+	parallel_ = 0;
+	inflight_ = 0;
+
+	curlGlobalInitOnce();
+	multi_ = curl_multi_init();
+	curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, &AsyncTransfer::socket_callback);
+	curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA,     this);
+	curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION,  &AsyncTransfer::timer_callback);
+	curl_multi_setopt(multi_, CURLMOPT_TIMERDATA,      this);
+}
+
+/*
+ * @note 异步回调持有共享指针, 析构时已无待执行的回调
+ */
+AsyncTransfer::~AsyncTransfer() {
+	for (RequestMap::iterator it = requests_.begin(); it != requests_.end(); ++it) {
+		curl_multi_remove_handle(multi_, it->second->easy);
+		free_request(it->second);
+	}
+	requests_.clear();
+	for (RequestQueue::iterator it = pending_.begin(); it != pending_.end(); ++it) free_request(*it);
+	pending_.clear();
+	for (SocketMap::iterator it = sockets_.begin(); it != sockets_.end(); ++it) {
+		it->second->stream->release(); // 文件描述符归curl所有
+	}
+	sockets_.clear();
+	curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, NULL);
+	curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION,  NULL);
+	curl_multi_cleanup(multi_);
+}
+
+void AsyncTransfer::Upload(const char *action, const StringMap& params, const char *path, const StringMap& files,
+		const DoneFunc& done) {
+	Request *req = new_request(action, params);
+	if (!req) {
+		if (done) done(GWAC_SEND_DATA_ERROR, "curl_easy_init() failed");
+		return;
+	}
+
+	req->done = done;
+	for (StringMap::const_iterator it = files.begin(); it != files.end(); ++it) {
+		string filepath = path ? path : "";
+		filepath += it->second;
+		curl_mimepart *part = curl_mime_addpart(req->form);
+		curl_mime_name(part, it->first.c_str());
+		curl_mime_filedata(part, filepath.c_str());
+	}
+	submit_request(req);
+}
+
+void AsyncTransfer::UploadFiles(const char *action, const StringMap& params, const char *path, const StringMap& files,
+		const FileDoneFunc& done) {
+	Request *req = new_request(action, params);
+	if (!req) {
+		if (done) done(GWAC_SEND_DATA_ERROR, "curl_easy_init() failed", TransferStat());
+		return;
+	}
+
+	req->fdone = done;
+	for (StringMap::const_iterator it = files.begin(); it != files.end(); ++it) {
+		string filepath = path ? path : "";
+		filepath += it->second;
+		SourcePtr src = map_file(filepath);
+		if (!src.use_count()) {
+			free_request(req);
+			if (done) done(GWAC_FUNCTION_INPUT_EMPTY, "failed to open " + filepath, TransferStat());
+			return;
+		}
+		req->sources.push_back(src);
+		curl_mimepart *part = curl_mime_addpart(req->form);
+		curl_mime_name(part, it->first.c_str());
+		curl_mime_filename(part, src->name.c_str());
+		curl_mime_type(part, "application/octet-stream");
+		// 空文件无法映射, 以空数据上传
+		if (src->size) curl_mime_data_cb(part, (curl_off_t) src->size, &AsyncTransfer::read_callback,
+				&AsyncTransfer::seek_callback, NULL, src.get());
+		else curl_mime_data(part, "", 0);
+	}
+
+	CURL *easy = req->easy;
+	// 文件较大: 不等待100-continue, 以低速限制代替整体超时
+	req->headers = curl_slist_append(NULL, "Expect:");
+	curl_easy_setopt(easy, CURLOPT_HTTPHEADER,        req->headers);
+	curl_easy_setopt(easy, CURLOPT_UPLOAD_BUFFERSIZE, (long) UPLOAD_BUFFER_SIZE);
+	curl_easy_setopt(easy, CURLOPT_TIMEOUT,           0L);
+	curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT,   (long) HTTP_LOW_SPEED_LIMIT);
+	curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME,    (long) HTTP_TIMEOUT);
+	submit_request(req);
+}
+
+void AsyncTransfer::UploadTemperature(const char *groupId, const char *unitId, const char *camId, float voltage,
+		float current, float thot, float coolget, float coolset, const char *time, const DoneFunc& done) {
+	StringMap params, files;
+	char tstr[64];
+
+	params.insert(std::make_pair("groupId", groupId));
+	params.insert(std::make_pair("unitId",  unitId));
+	params.insert(std::make_pair("camId",   camId));
+	sprintf(tstr, "%f", voltage);
+	params.insert(std::make_pair("voltage", tstr));
+	sprintf(tstr, "%f", current);
+	params.insert(std::make_pair("current", tstr));
+	sprintf(tstr, "%f", thot);
+	params.insert(std::make_pair("thot",    tstr));
+	sprintf(tstr, "%f", coolget);
+	params.insert(std::make_pair("coolget", tstr));
+	sprintf(tstr, "%f", coolset);
+	params.insert(std::make_pair("coolset", tstr));
+	params.insert(std::make_pair("time",    time));
+	Upload(UPLOAD_CCD_TEMPERATURE, params, NULL, files, done);
+}
+
+void AsyncTransfer::UploadVacuum(const char *groupId, const char *unitId, const char *camId, float voltage,
+		float current, float pressure, const char *time, const DoneFunc& done) {
+	StringMap params, files;
+	char tstr[64];
+
+	params.insert(std::make_pair("groupId", groupId));
+	params.insert(std::make_pair("unitId",  unitId));
+	params.insert(std::make_pair("camId",   camId));
+	sprintf(tstr, "%f", voltage);
+	params.insert(std::make_pair("voltage",  tstr));
+	sprintf(tstr, "%f", current);
+	params.insert(std::make_pair("current",  tstr));
+	sprintf(tstr, "%f", pressure);
+	params.insert(std::make_pair("pressure", tstr));
+	params.insert(std::make_pair("time",     time));
+	Upload(UPLOAD_CCD_VACUUM, params, NULL, files, done);
+}
+
+void AsyncTransfer::SetParallel(int n) {
+	parallel_ = n;
+}
+
+int AsyncTransfer::GetInflight() {
+	mutex_lock lck(mtxStat_);
+	return inflight_;
+}
+
+void AsyncTransfer::Stop() {
+	if (keep_.get_strand().running_in_this_thread()) abort_all(NULL);
+	else {
+		boost::promise<void> done;
+		boost::unique_future<void> future = done.get_future();
+		keep_.get_strand().post(boost::bind(&AsyncTransfer::abort_all, shared_from_this(), &done));
+		future.wait();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/*---------------- curl回调函数: 在strand中由curl_multi_*()调用 ----------------*/
+int AsyncTransfer::socket_callback(CURL *, curl_socket_t s, int what, void *userp, void *) {
+	((AsyncTransfer*) userp)->watch_socket(s, what);
+	return 0;
+}
+
+int AsyncTransfer::timer_callback(CURLM *, long timeout_ms, void *userp) {
+	((AsyncTransfer*) userp)->set_timer(timeout_ms);
+	return 0;
+}
+
+size_t AsyncTransfer::write_callback(char *ptr, size_t size, size_t nmemb, void *userdata) {
+	size_t n = size * nmemb;
+	((Request*) userdata)->response.append(ptr, n);
+	return n;
+}
+
+/*
+ * @note userdata为curl_mime_data_cb()登记的FileSource
+ */
+size_t AsyncTransfer::read_callback(char *buffer, size_t size, size_t nitems, void *userdata) {
+	FileSource *src = (FileSource*) userdata;
+	size_t n = std::min(size * nitems, src->size - src->offset);
+	memcpy(buffer, src->data + src->offset, n);
+	src->offset += n;
+	return n;
+}
+
+/*
+ * @note curl在重发表单前定位至文件起始. 表单数据仅以SEEK_SET定位
+ */
+int AsyncTransfer::seek_callback(void *userdata, curl_off_t offset, int origin) {
+	FileSource *src = (FileSource*) userdata;
+	if (origin != SEEK_SET || offset < 0 || size_t(offset) > src->size) return CURL_SEEKFUNC_FAIL;
+	src->offset = size_t(offset);
+	return CURL_SEEKFUNC_OK;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+AsyncTransfer::Request* AsyncTransfer::new_request(const char *action, const StringMap& params) {
+	CURL *easy = curl_easy_init();
+	if (!easy) return NULL;
+
+	Request *req = new Request;
+	req->easy    = easy;
+	req->form    = curl_mime_init(easy);
+	req->headers = NULL;
+	req->url     = rootUrl_ + action;
+	req->error[0] = 0;
+	for (StringMap::const_iterator it = params.begin(); it != params.end(); ++it) {
+		curl_mimepart *part = curl_mime_addpart(req->form);
+		curl_mime_name(part, it->first.c_str());
+		curl_mime_data(part, it->second.c_str(), CURL_ZERO_TERMINATED);
+	}
+
+	curl_easy_setopt(easy, CURLOPT_URL,            req->url.c_str());
+	curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION,  &AsyncTransfer::write_callback);
+	curl_easy_setopt(easy, CURLOPT_WRITEDATA,      req);
+	curl_easy_setopt(easy, CURLOPT_ERRORBUFFER,    req->error);
+	curl_easy_setopt(easy, CURLOPT_PRIVATE,        req);
+	curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE,  1L);
+	curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT, (long) HTTP_CONNECT_TIMEOUT);
+	curl_easy_setopt(easy, CURLOPT_TIMEOUT,        (long) HTTP_TIMEOUT);
+	curl_easy_setopt(easy, CURLOPT_NOSIGNAL,       1L);
+	return req;
+}
+
+void AsyncTransfer::submit_request(Request *req) {
+	curl_easy_setopt(req->easy, CURLOPT_MIMEPOST, req->form);
+	{
+		mutex_lock lck(mtxStat_);
+		++inflight_;
+	}
+	keep_.get_strand().post(boost::bind(&AsyncTransfer::start_request, shared_from_this(), req));
+}
+
+void AsyncTransfer::free_request(Request *req) {
+	curl_easy_cleanup(req->easy);
+	curl_mime_free(req->form);
+	curl_slist_free_all(req->headers);
+	delete req;
+}
+
+AsyncTransfer::SourcePtr AsyncTransfer::map_file(const string& filepath) {
+	using namespace boost::interprocess;
+	struct stat st;
+	if (stat(filepath.c_str(), &st) || !S_ISREG(st.st_mode)) return SourcePtr();
+
+	SourcePtr src = boost::make_shared<FileSource>();
+	string::size_type pos = filepath.rfind('/');
+	src->name   = pos == string::npos ? filepath : filepath.substr(pos + 1);
+	src->data   = NULL;
+	src->size   = size_t(st.st_size);
+	src->offset = 0;
+	if (src->size) {
+		try {
+			file_mapping file(filepath.c_str(), read_only);
+			mapped_region region(file, read_only, 0, src->size);
+			region.advise(mapped_region::advice_sequential);
+			src->region.swap(region);
+		}
+		catch(interprocess_exception& ex) {
+			return SourcePtr();
+		}
+		src->data = (const char*) src->region.get_address();
+	}
+	return src;
+}
+
+void AsyncTransfer::start_request(Request *req) {
+	if (parallel_ > 0 && int(requests_.size()) >= parallel_) {
+		pending_.push_back(req);
+		return;
+	}
+	requests_[req->easy] = req;
+	CURLMcode code = curl_multi_add_handle(multi_, req->easy);
+	if (code != CURLM_OK) finish_request(req, GWAC_SEND_DATA_ERROR, curl_multi_strerror(code));
+}
+
+void AsyncTransfer::watch_socket(curl_socket_t s, int action) {
+	SocketMap::iterator it = sockets_.find(s);
+	if (action == CURL_POLL_REMOVE) {// curl即将关闭套接字: 放弃等待并归还文件描述符
+		if (it != sockets_.end()) {
+			it->second->stream->release();
+			sockets_.erase(it);
+		}
+		return;
+	}
+
+	SocketPtr info;
+	if (it != sockets_.end()) info = it->second;
+	else {
+		boost::system::error_code ec;
+		info = boost::make_shared<SocketInfo>();
+		info->stream.reset(new stream_descriptor(keep_.get_service()));
+		info->stream->assign(s, ec);
+		info->reading = info->writing = false;
+		if (ec) return;
+		sockets_[s] = info;
+	}
+	info->action = action;
+	wait_socket(s, info, false);
+	wait_socket(s, info, true);
+}
+
+void AsyncTransfer::wait_socket(curl_socket_t s, SocketPtr info, bool write) {
+	if (write) {
+		if (info->writing || !(info->action & CURL_POLL_OUT)) return;
+		info->writing = true;
+		info->stream->async_write_some(boost::asio::null_buffers(), keep_.get_strand().wrap(
+				boost::bind(&AsyncTransfer::on_socket, shared_from_this(), s, info, true,
+						boost::asio::placeholders::error)));
+	}
+	else {
+		if (info->reading || !(info->action & CURL_POLL_IN)) return;
+		info->reading = true;
+		info->stream->async_read_some(boost::asio::null_buffers(), keep_.get_strand().wrap(
+				boost::bind(&AsyncTransfer::on_socket, shared_from_this(), s, info, false,
+						boost::asio::placeholders::error)));
+	}
+}
+
+void AsyncTransfer::on_socket(curl_socket_t s, SocketPtr info, bool write, const boost::system::error_code& ec) {
+	if (write) info->writing = false;
+	else info->reading = false;
+	if (ec == boost::asio::error::operation_aborted) return;
+	// 套接字已被curl关闭, 或文件描述符已被新套接字复用
+	SocketMap::iterator it = sockets_.find(s);
+	if (it == sockets_.end() || it->second != info) return;
+	if (!(info->action & (write ? CURL_POLL_OUT : CURL_POLL_IN))) return;
+
+	int mask = ec ? CURL_CSELECT_ERR : (write ? CURL_CSELECT_OUT : CURL_CSELECT_IN);
+	curl_multi_socket_action(multi_, s, mask, &running_);
+	check_done();
+
+	// 套接字仍被监视时继续等待
+	it = sockets_.find(s);
+	if (it != sockets_.end() && it->second == info) wait_socket(s, info, write);
+}
+
+void AsyncTransfer::set_timer(long timeout_ms) {
+	boost::system::error_code ec;
+	if (timeout_ms < 0) timer_.cancel(ec);
+	else {
+		timer_.expires_from_now(millisec(timeout_ms));
+		timer_.async_wait(keep_.get_strand().wrap(
+				boost::bind(&AsyncTransfer::on_timer, shared_from_this(), boost::asio::placeholders::error)));
+	}
+}
+
+void AsyncTransfer::on_timer(const boost::system::error_code& ec) {
+	if (ec == boost::asio::error::operation_aborted) return;
+	curl_multi_socket_action(multi_, CURL_SOCKET_TIMEOUT, 0, &running_);
+	check_done();
+}
+
+void AsyncTransfer::check_done() {
+	CURLMsg *msg;
+	int left;
+
+	while ((msg = curl_multi_info_read(multi_, &left))) {
+		if (msg->msg != CURLMSG_DONE) continue;
+		// 移除句柄后msg失效, 先取出结果
+		CURL *easy = msg->easy_handle;
+		CURLcode code = msg->data.result;
+		RequestMap::iterator it = requests_.find(easy);
+		if (it == requests_.end()) continue;
+
+		Request *req = it->second;
+		long http(0);
+		curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &http);
+		if (code == CURLE_OK && http == 200) finish_request(req, GWAC_SUCCESS, req->response);
+		else {
+			char desc[CURL_ERROR_SIZE + 64];
+			if (code != CURLE_OK) sprintf(desc, "%s", req->error[0] ? req->error : curl_easy_strerror(code));
+			else sprintf(desc, "server responds with http code %ld", http);
+			finish_request(req, GWAC_SEND_DATA_ERROR, desc);
+		}
+	}
+}
+
+void AsyncTransfer::finish_request(Request *req, int rslt, const string& output) {
+	TransferStat stat;
+	if (req->fdone) {
+		curl_off_t bytes(0), usec(0);
+		curl_easy_getinfo(req->easy, CURLINFO_SIZE_UPLOAD_T, &bytes);
+		curl_easy_getinfo(req->easy, CURLINFO_TOTAL_TIME_T,  &usec);
+		stat.bytes   = double(bytes);
+		stat.seconds = usec * 1E-6;
+		stat.rate    = usec > 0 ? stat.bytes / stat.seconds : 0.0;
+	}
+	requests_.erase(req->easy);
+	curl_multi_remove_handle(multi_, req->easy);
+	DoneFunc done = req->done;
+	FileDoneFunc fdone = req->fdone;
+	free_request(req);
+	{
+		mutex_lock lck(mtxStat_);
+		--inflight_;
+	}
+	// 启动排队请求
+	if (!pending_.empty() && (parallel_ <= 0 || int(requests_.size()) < parallel_)) {
+		Request *next = pending_.front();
+		pending_.pop_front();
+		start_request(next);
+	}
+	if (done) done(rslt, output);
+	if (fdone) fdone(rslt, output, stat);
+}
+
+void AsyncTransfer::abort_all(boost::promise<void>* done) {
+	RequestQueue pending;
+	pending.swap(pending_);
+	for (RequestQueue::iterator it = pending.begin(); it != pending.end(); ++it)
+		finish_request(*it, GWAC_SEND_DATA_ERROR, "aborted");
+	while (!requests_.empty()) finish_request(requests_.begin()->second, GWAC_SEND_DATA_ERROR, "aborted");
+	for (SocketMap::iterator it = sockets_.begin(); it != sockets_.end(); ++it) {
+		it->second->stream->release();
+	}
+	sockets_.clear();
+	set_timer(-1);
+	if (done) done->set_value();
+}
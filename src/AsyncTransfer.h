@@ -0,0 +1,277 @@
+/**
+ * @file AsyncTransfer.h 基于curl multi接口的异步HTTP上传声明文件
+ * @date 2026-10-16
+ * @version 0.1
+ * @note
+ * - 采用curl_multi_socket_action(), 由共享IOServicePool中的io_service驱动: curl通知需要监视的套接字与
+ *   超时时间, asio在套接字可读写或定时器到期时回调curl
+ * - 全部curl调用在同一strand中串行执行, 单一线程即可同时维持数十个上传请求
+ * - 上传请求可在任意线程中提交, 立即返回. 请求完成或失败后在strand中调用完成函数
+ * - multi句柄在请求之间缓存连接, 同一服务器的后续请求复用连接
+ * - 接口与DataTransfer一致: 参数与文件采用multipart表单上传
+ * - 仅可通过make_async_transfer()创建. 异步回调持有对象的共享指针, 对象在最后一个回调完成后释放
+ * @version 0.2
+ * @note
+ * - 新增UploadFiles(): 文件以只读内存映射打开, 由curl读回调直接从映射区复制至发送缓冲区,
+ *   不经过中间缓冲区; 发送缓冲区增大为UPLOAD_BUFFER_SIZE
+ * - 新增并发上限: 执行中的请求达到上限时, 后续请求在strand中排队, 按提交顺序启动
+ * - 文件上传完成后, 完成函数收到单次传输的字节数、耗时与速率
+ * @version 0.3
+ * @note
+ * - 表单改用curl_mime_*()构建, 取代已废弃的curl_formadd(). 映射文件经curl_mime_data_cb()登记读、定位回调,
+ *   连接复用失败等需要重发时可从头读取
+ */
+
+#ifndef ASYNCTRANSFER_H_
+#define ASYNCTRANSFER_H_
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <curl/curl.h>
+#include <boost/function.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "IOServiceKeep.h"
+
+using std::string;
+using std::multimap;
+
+class AsyncTransfer : public boost::enable_shared_from_this<AsyncTransfer>, private boost::noncopyable {
+public:
+	/*!
+	 * @brief 构造函数
+	 * @param rootUrl Web服务器网址, 如http://190.168.1.25/gwebend/
+	 */
+	AsyncTransfer(const string& rootUrl);
+	virtual ~AsyncTransfer();
+
+public:
+	/* 数据类型 */
+	typedef multimap<string, string> StringMap;	//< 键值对
+	/*!
+	 * @brief 上传完成函数
+	 * @param _1 上传结果. 0: 成功; 其它: 失败
+	 * @param _2 成功时为服务器应答, 失败时为错误描述
+	 */
+	typedef boost::function<void (int, const string&)> DoneFunc;
+
+	struct TransferStat {// 单次传输统计
+		double bytes;		//< 上传字节数
+		double seconds;		//< 耗时, 量纲: 秒
+		double rate;		//< 上传速率, 量纲: 字节/秒
+
+	public:
+		TransferStat() {
+			bytes = seconds = rate = 0.0;
+		}
+	};
+	/*!
+	 * @brief 文件上传完成函数
+	 * @param _1 上传结果. 0: 成功; 其它: 失败
+	 * @param _2 成功时为服务器应答, 失败时为错误描述
+	 * @param _3 传输统计. 排队期间被中止的请求统计为0
+	 */
+	typedef boost::function<void (int, const string&, const TransferStat&)> FileDoneFunc;
+
+protected:
+	typedef boost::asio::posix::stream_descriptor stream_descriptor;
+	typedef boost::shared_ptr<stream_descriptor> StreamPtr;
+	typedef boost::asio::deadline_timer deadline_timer;
+	typedef boost::unique_lock<boost::mutex> mutex_lock;
+
+	struct FileSource {// 以内存映射读取的上传文件
+		boost::interprocess::mapped_region region;	//< 只读映射区
+		string name;		//< 上传文件名
+		const char *data;	//< 文件内容
+		size_t size;		//< 文件字节数
+		size_t offset;		//< 已读取字节数
+	};
+	typedef boost::shared_ptr<FileSource> SourcePtr;
+
+	struct Request {// 单个上传请求
+		CURL *easy;			//< curl句柄
+		curl_mime *form;	//< multipart表单
+		curl_slist *headers;	//< 附加请求头
+		string url;			//< 完整网址
+		string response;	//< 服务器应答
+		char error[CURL_ERROR_SIZE];	//< curl错误描述
+		std::vector<SourcePtr> sources;	//< 上传文件
+		DoneFunc done;		//< 完成函数
+		FileDoneFunc fdone;	//< 文件上传完成函数
+	};
+
+	struct SocketInfo {// curl需要监视的套接字
+		StreamPtr stream;	//< 借用curl的文件描述符, 不拥有
+		int action;			//< curl要求监视的事件: CURL_POLL_IN/OUT/INOUT
+		bool reading;		//< 已启动可读等待
+		bool writing;		//< 已启动可写等待
+	};
+	typedef boost::shared_ptr<SocketInfo> SocketPtr;
+	typedef std::map<curl_socket_t, SocketPtr> SocketMap;
+	typedef std::map<CURL*, Request*> RequestMap;
+	typedef std::deque<Request*> RequestQueue;
+
+protected:
+	/* 成员变量 */
+	string rootUrl_;		//< Web服务器网址
+	IOServiceKeep keep_;	//< io_service与strand
+	CURLM *multi_;			//< curl multi句柄
+	deadline_timer timer_;	//< curl超时定时器
+	SocketMap sockets_;		//< 正在监视的套接字
+	RequestMap requests_;	//< 正在执行的请求
+	RequestQueue pending_;	//< 等待执行的请求
+	int parallel_;			//< 并发请求上限. <=0: 不限制
+	int running_;			//< curl报告的执行中请求数量
+	boost::mutex mtxStat_;	//< 互斥锁: 统计信息
+	int inflight_;			//< 已提交尚未完成的请求数量
+
+public:
+	/*!
+	 * @brief 异步上传参数与文件
+	 * @param action 服务器动作, 与rootUrl组成完整网址, 如uploadTemperature.action
+	 * @param params 参数键值对<参数名, 参数值>
+	 * @param path   文件所在目录
+	 * @param files  文件键值对<上传文件名, 实际文件名>, path + 实际文件名组成文件路径
+	 * @param done   完成函数, 可为空
+	 * @note
+	 * 可在任意线程中调用, 立即返回
+	 */
+	void Upload(const char *action, const StringMap& params, const char *path, const StringMap& files,
+			const DoneFunc& done);
+	/*!
+	 * @brief 以流方式异步上传文件
+	 * @param action 服务器动作, 如commonFileUpload.action
+	 * @param params 参数键值对<参数名, 参数值>
+	 * @param path   文件所在目录
+	 * @param files  文件键值对<上传文件名, 实际文件名>, path + 实际文件名组成文件路径
+	 * @param done   完成函数, 可为空
+	 * @note
+	 * - 可在任意线程中调用, 立即返回. 文件在调用时映射, 无法打开时立即调用完成函数
+	 * - 上传完成前不可截断文件
+	 * - 不受HTTP_TIMEOUT限制. 传输速率持续HTTP_TIMEOUT秒低于HTTP_LOW_SPEED_LIMIT时失败
+	 */
+	void UploadFiles(const char *action, const StringMap& params, const char *path, const StringMap& files,
+			const FileDoneFunc& done);
+	/*!
+	 * @brief 异步上传CCD温度参数
+	 */
+	void UploadTemperature(const char *groupId, const char *unitId, const char *camId, float voltage,
+			float current, float thot, float coolget, float coolset, const char *time, const DoneFunc& done);
+	/*!
+	 * @brief 异步上传CCD真空度参数
+	 */
+	void UploadVacuum(const char *groupId, const char *unitId, const char *camId, float voltage,
+			float current, float pressure, const char *time, const DoneFunc& done);
+	/*!
+	 * @brief 设置并发请求上限
+	 * @param n 上限. <=0: 不限制
+	 * @note
+	 * 应在提交请求前调用
+	 */
+	void SetParallel(int n);
+	/*!
+	 * @brief 查看尚未完成的请求数量, 包括排队请求
+	 */
+	int GetInflight();
+	/*!
+	 * @brief 中止全部请求. 被中止请求的完成函数收到错误
+	 * @note
+	 * 等待strand执行完成. 不可在完成函数中调用
+	 */
+	void Stop();
+
+protected:
+	/* curl回调函数 */
+	static int socket_callback(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp);
+	static int timer_callback(CURLM *multi, long timeout_ms, void *userp);
+	static size_t write_callback(char *ptr, size_t size, size_t nmemb, void *userdata);
+	static size_t read_callback(char *buffer, size_t size, size_t nitems, void *userdata);
+	static int seek_callback(void *userdata, curl_off_t offset, int origin);
+
+protected:
+	/* 功能 */
+	/*!
+	 * @brief 创建请求并设置表单参数与通用选项
+	 * @param action 服务器动作
+	 * @param params 参数键值对
+	 * @return
+	 * 上传请求, 可继续向表单添加文件. 创建curl句柄失败时返回NULL
+	 */
+	Request* new_request(const char *action, const StringMap& params);
+	/*!
+	 * @brief 提交请求, 在strand中启动
+	 */
+	void submit_request(Request *req);
+	/*!
+	 * @brief 释放请求占用的资源
+	 */
+	static void free_request(Request *req);
+	/*!
+	 * @brief 以只读方式映射上传文件
+	 * @param filepath 文件路径
+	 * @return
+	 * 文件. 不是普通文件或映射失败时返回空指针
+	 */
+	static SourcePtr map_file(const string& filepath);
+	/*!
+	 * @brief 在strand中将请求加入multi句柄. 达到并发上限时排队
+	 * @param req 上传请求
+	 */
+	void start_request(Request *req);
+	/*!
+	 * @brief 更新套接字的监视事件
+	 * @param s      套接字
+	 * @param action curl要求监视的事件
+	 */
+	void watch_socket(curl_socket_t s, int action);
+	/*!
+	 * @brief 启动单一方向的等待
+	 * @param s     套接字
+	 * @param info  套接字信息
+	 * @param write true: 等待可写; false: 等待可读
+	 */
+	void wait_socket(curl_socket_t s, SocketPtr info, bool write);
+	/*!
+	 * @brief 套接字可读写
+	 */
+	void on_socket(curl_socket_t s, SocketPtr info, bool write, const boost::system::error_code& ec);
+	/*!
+	 * @brief 设置超时定时器
+	 * @param timeout_ms 超时时间, 量纲: 毫秒. <0: 取消定时器
+	 */
+	void set_timer(long timeout_ms);
+	/*!
+	 * @brief 超时定时器到期
+	 */
+	void on_timer(const boost::system::error_code& ec);
+	/*!
+	 * @brief 处理已完成的请求
+	 */
+	void check_done();
+	/*!
+	 * @brief 结束请求: 调用完成函数并释放资源
+	 * @param req    上传请求
+	 * @param rslt   上传结果
+	 * @param output 应答或错误描述
+	 */
+	void finish_request(Request *req, int rslt, const string& output);
+	/*!
+	 * @brief 在strand中中止全部请求
+	 * @param done 完成标志
+	 */
+	void abort_all(boost::promise<void>* done);
+};
+typedef boost::shared_ptr<AsyncTransfer> AsyncTransferPtr;
+/*!
+ * @brief 工厂函数, 创建异步上传接口
+ * @param rootUrl Web服务器网址
+ * @return
+ * 异步上传接口指针
+ */
+extern AsyncTransferPtr make_async_transfer(const string& rootUrl);
+
+#endif /* ASYNCTRANSFER_H_ */
@@ -11,9 +11,19 @@
 
 using namespace boost::posix_time;
 
+#define HEARTBEAT_PERIOD	30		//< 串口有效性时限, 量纲: 秒
+#define REPLY_TIMEOUT		500		//< 设备响应时限, 不含传输时间, 量纲: 毫秒
+#define MAX_RETRY			2		//< 应答超时后的最大重发次数
+#define PROBE_MIN			1		//< 失效设备的最短探测周期, 量纲: 秒
+#define PROBE_MAX			60		//< 失效设备的最长探测周期, 量纲: 秒
+
 ControllerBase::ControllerBase() {
 	nhead_ = ntail_ = 0;
-	bufrcv_.reset(new char[SERIAL_BUFF_SIZE]);
+	running_ = busy_ = false;
+	rateChanged_ = false;
+	seq_ = 0;
+	trendHours_ = TREND_HOURS;
+	trendRes_   = TREND_RESOLUTION;
 	ascproto_ = make_ascproto();
 }
 
@@ -26,10 +36,28 @@ void ControllerBase::RegisterResult(const CBSlot &slot) {
 	cbrslt_.connect(slot);
 }
 
+void ControllerBase::RegisterCommand(const CmdSlot &slot) {
+	if (!cbcmd_.empty()) cbcmd_.disconnect_all_slots();
+	cbcmd_.connect(slot);
+}
+
+void ControllerBase::RegisterTrace(const CmdSlot &slot) {
+	if (!cbtrace_.empty()) cbtrace_.disconnect_all_slots();
+	cbtrace_.connect(slot);
+}
+
+ControllerBase::PortStat ControllerBase::GetStat() {
+	mutex_lock lck(mtxStat_);
+	return stat_;
+}
+
 int ControllerBase::Start(string portname, int baudrate) {
 	if (portname.empty()) return -1;
-	const SerialComm::CBSlot& slot1 = boost::bind(&ControllerBase::serial_read,  this, _1, _2);
-	const SerialComm::CBSlot& slot2 = boost::bind(&ControllerBase::serial_write, this, _1, _2);
+	// 串口回调跟踪控制接口: 控制接口释放后不再调用
+	SerialComm::CBSlot slot1(boost::bind(&ControllerBase::serial_read,  this, _1, _2));
+	SerialComm::CBSlot slot2(boost::bind(&ControllerBase::serial_write, this, _1, _2));
+	slot1.track(shared_from_this());
+	slot2.track(shared_from_this());
 	serial_ = make_serial();
 	serial_->RegisterRead (slot1);
 	serial_->RegisterWrite(slot2);
@@ -39,17 +67,38 @@ int ControllerBase::Start(string portname, int baudrate) {
 	}
 	
 	portname_ = portname;
-	thrdCycle_.reset(new boost::thread(boost::bind(&ControllerBase::thread_cycle, this)));
-	thrdRespond_.reset(new boost::thread(boost::bind(&ControllerBase::thread_respond, this)));
-	thrdHB_.reset(new boost::thread(boost::bind(&ControllerBase::thread_heartbeat, this)));
+	// 8N1: 单字符10位. 帧间隔为3.5个字符, 波特率高于19200时固定为1.75毫秒
+	baudrate = serial_->GetBaudrate();
+	tchar_ = microseconds(10000000 / baudrate);
+	tgap_  = baudrate > 19200 ? microseconds(1750) : microseconds(35000000 / baudrate);
+
+	io_service& ios = serial_->GetService();
+	tmrCycle_.reset(new deadline_timer(ios));
+	tmrReply_.reset(new deadline_timer(ios));
+	tmrGap_.reset(new deadline_timer(ios));
+	tmrSilence_.reset(new deadline_timer(ios));
+	tmtimeout_ = tmlast_ = microsec_clock::universal_time();
+	tmreport_ = tmlast_ - seconds(CYCLE_PERIOD);
+	tmrGap_->expires_at(tmlast_);
+	running_ = true;
+	// 延时1秒启动第一轮监测
+	arm_cycle(tmlast_ + seconds(1));
 
 	return 0;
 }
 
 void ControllerBase::Stop() {
-	interrupt_thread(thrdHB_);
-	interrupt_thread(thrdRespond_);
-	interrupt_thread(thrdCycle_);
+	if (!running_) return;
+	running_ = false;
+	// 析构时已无挂起的回调(回调持有对象引用), 可直接停止定时器
+	if (serial_->GetStrand().running_in_this_thread() || weak_from_this().expired()) stop_timers(NULL);
+	else {// 定时器非线程安全, 在strand中停止定时器并等待完成
+		boost::promise<void> done;
+		boost::unique_future<void> future = done.get_future();
+		serial_->GetStrand().post(boost::bind(&ControllerBase::stop_timers, shared_from_this(), &done));
+		future.wait();
+	}
+	serial_->Close();
 }
 
 void ControllerBase::CoupleNetwork(TcpCPtr session, string grpid) {
@@ -62,33 +111,82 @@ void ControllerBase::DecoupleNetwork() {
 	tcp_.reset();
 }
 
-void ControllerBase::SetDatabase(const string& url) {
-	if (url.empty()) db_.reset();
-	else db_ = boost::make_shared<DataTransfer>(url.c_str());
+void ControllerBase::SetDatabase(UploaderPtr uploader) {
+	db_ = uploader;
 }
 
 void ControllerBase::AddDevice(uint8_t idd) {
-	int n = allDev_.size(), n1 = drct_.size(), i;
+	int n = allDev_.size(), i;
 	for (i = 0; i < n && idd != allDev_[i]; ++i);
 	if (i == n) allDev_.push_back(idd);
 }
 
+bool ControllerBase::HasDevice(uint8_t idd) {
+	int n = allDev_.size(), i;
+	for (i = 0; i < n && idd != allDev_[i]; ++i);
+	return i < n;
+}
+
 void ControllerBase::Write(uint8_t idd, uint8_t idf) {
-	Directive one(idf);
+	Directive one(idd, idf, PRIORITY_CONTROL);
 	one.len = encode_data(idd, idf, one.msg);
 	append_directive(one);
+	kick_send();
 }
 
 void ControllerBase::Write(uint8_t idd, uint8_t idf, int value) {
-	Directive one(idf);
+	Directive one(idd, idf, PRIORITY_CONTROL);
 	one.len = encode_data(idd, idf, value, one.msg);
 	append_directive(one);
+	kick_send();
 }
 
 void ControllerBase::Write(uint8_t idd, uint8_t idf, double value) {
-	Directive one(idf);
+	Directive one(idd, idf, PRIORITY_CONTROL);
 	one.len = encode_data(idd, idf, value, one.msg);
 	append_directive(one);
+	kick_send();
+}
+
+void ControllerBase::SetPollRate(uint8_t idf, double period, double fast) {
+	mutex_lock lck(mtxDrct_);
+	PollRateVec::iterator it;
+	for (it = rates_.begin(); it != rates_.end() && it->idf != idf; ++it);
+	if (period <= 0.0) {// 不再轮询
+		if (it != rates_.end()) rates_.erase(it);
+	}
+	else {
+		if (it == rates_.end()) it = rates_.insert(it, PollRate());
+		it->idf    = idf;
+		it->period = period;
+		it->fast   = fast > 0.0 && fast < period ? fast : period;
+	}
+	rateChanged_ = true;
+}
+
+void ControllerBase::SetTrend(double hours, double resolution) {
+	mutex_lock lck(mtxDrct_);
+	trendHours_ = hours;
+	trendRes_   = resolution > 0.0 ? resolution : TREND_RESOLUTION;
+	trends_.clear(); // 由schedule_poll()按新参数重建
+}
+
+bool ControllerBase::QueryTrend(uint8_t idd, const string& channel, double window, TrendStat& stat) {
+	int ich = trend_channel(channel);
+	if (ich < 0) return false;
+
+	TrendPtr trend;
+	{
+		mutex_lock lck(mtxDrct_);
+		int n = trends_.size(), i;
+		for (i = 0; i < n && allDev_[i] != idd; ++i);
+		if (i < n) trend = trends_[i];
+	}
+	if (!trend.use_count()) return false;
+
+	ptime epoch(boost::gregorian::date(1970, 1, 1));
+	double from = window > 0.0 ? (microsec_clock::universal_time() - epoch).total_microseconds() * 1E-6 - window : 0.0;
+	return trend->Query(ich, from, stat);
 }
 
 const char *ControllerBase::GetPortname() {
@@ -96,13 +194,24 @@ const char *ControllerBase::GetPortname() {
 }
 
 void ControllerBase::append_directive(Directive &drct) {
+	drct.tmqueue = microsec_clock::universal_time();
 	mutex_lock lck(mtxDrct_);
-	drct_.push_back(drct);
+	if (drct.priority == PRIORITY_CONTROL) drctCtl_.push_back(drct);
+	else drct_.push_back(drct);
 }
 
-void ControllerBase::remove_directive() {
+bool ControllerBase::next_directive(Directive &drct) {
 	mutex_lock lck(mtxDrct_);
-	drct_.pop_front();
+	DrctList &queue = drctCtl_.empty() ? drct_ : drctCtl_;
+	if (queue.empty()) return false;
+	drct = queue.front();
+	queue.pop_front();
+	return true;
+}
+
+bool ControllerBase::queue_empty() {
+	mutex_lock lck(mtxDrct_);
+	return drctCtl_.empty() && drct_.empty();
 }
 
 int ControllerBase::encode_data(uint8_t idd, uint8_t idf, char *output) {
@@ -121,6 +230,22 @@ int ControllerBase::encode_data(uint8_t idd, uint8_t idf, double value, char *ou
 	return encode_data(idd, idf, fmt.str().c_str(), fmt.size(), output);
 }
 
+bool ControllerBase::is_ramping(uint8_t idd) {
+	return false;
+}
+
+int ControllerBase::trend_width() {
+	return 0;
+}
+
+int ControllerBase::trend_channel(const string& name) {
+	return -1;
+}
+
+bool ControllerBase::trend_sample(uint8_t idd, float* values) {
+	return false;
+}
+
 uint8_t ControllerBase::decode_uint8(uint8_t b1, uint8_t b2) {
 	uint8_t val, t;
 
@@ -134,99 +259,354 @@ uint8_t ControllerBase::decode_uint8(uint8_t b1, uint8_t b2) {
 }
 
 /*
- * @note 发送列表中第一条信息
+ * @note 发送下一条指令. 控制指令在帧边界抢占尚未发送的监测指令
  */
 void ControllerBase::first_send() {
-	if (serial_.unique() && serial_->IsOpen()) {
-		Directive& one = drct_.front();
-//		_gLog.Write("tosend: %s", one.msg);
-		serial_->Write(one.msg, one.len);
+	if (busy_ || !running_) return;
+	if (tmrGap_->expires_at() > microsec_clock::universal_time()) return; // 帧间隔未结束, 由on_gap()发送
+
+	if (serial_->IsOpen()) {
+		if (!next_directive(drctCur_)) return;
+//		_gLog.Write("tosend: %s", drctCur_.msg);
+		busy_ = true;
+		drctCur_.tmsend = microsec_clock::universal_time();
+		{
+			mutex_lock lck(mtxStat_);
+			++stat_.sent;
+		}
+		serial_->Write(drctCur_.msg, drctCur_.len);
+		// 应答时限: 指令传输时间 + 设备响应时间
+		tmrReply_->expires_from_now(tchar_ * drctCur_.len + millisec(REPLY_TIMEOUT));
+		tmrReply_->async_wait(serial_->GetStrand().wrap(
+				boost::bind(&ControllerBase::on_reply_timeout, shared_from_this(), boost::asio::placeholders::error, ++seq_)));
 	}
 	else _gLog.Write("port is closed");
 }
 
-void ControllerBase::serial_read(long client, long ec) {
-	uint8_t idd(0xFF), idf(0xFF);
-	double value(0.0);
-
-	if (!ec) {// 处理收到的信息
-		int ihead(0), itail(0), len;
-		if (nhead_) ihead = serial_->Lookup(head_.c_str(), nhead_);
-		if (ihead >= 0) itail = serial_->Lookup(tail_.c_str(), ntail_, ihead);
-		if (itail > ihead) {
-			len = itail - ihead + ntail_;
-			serial_->Read(bufrcv_.get(), len, ihead);
-			if (!decode_data(len)) cndDrct_.notify_one();
+void ControllerBase::kick_send() {
+	if (running_) serial_->GetStrand().post(boost::bind(&ControllerBase::first_send, shared_from_this()));
+}
+
+void ControllerBase::complete_directive(bool success) {
+	bool control = drctCur_.priority == PRIORITY_CONTROL;
+
+	busy_ = false;
+	{
+		mutex_lock lck(mtxStat_);
+		if (success) ++stat_.reply;
+		else ++stat_.timeout;
+	}
+	if (control || !cbtrace_.empty()) {// 通知指令执行结果
+		ptime now = microsec_clock::universal_time();
+		CommandResult rslt;
+		rslt.idd = drctCur_.idd;
+		rslt.idf = drctCur_.idf;
+		rslt.priority = drctCur_.priority;
+		rslt.success = success;
+		rslt.latency = (now - drctCur_.tmqueue).total_microseconds() * 1E-3;
+		rslt.rtt     = (now - drctCur_.tmsend).total_microseconds() * 1E-3;
+		if (control) {
+			_gLog.Write("port<%s> device<%d> function<0x%02X> %s in %.1f ms", portname_.c_str(),
+					rslt.idd, rslt.idf, success ? "completed" : "timed out", rslt.latency);
+			if (!cbcmd_.empty()) cbcmd_((long) this, rslt);
 		}
+		if (!cbtrace_.empty()) cbtrace_((long) this, rslt);
 	}
-	else if (!cbrslt_.empty()) cbrslt_((long) this, 1); // 接收时遇到错误
+	poll_done(drctCur_);
+	update_health(drctCur_.idd, success);
+	send_next();
 }
 
-void ControllerBase::serial_write(long client, long ec) {
-	if (ec && !cbrslt_.empty()) cbrslt_((long) this, 2); // 发送时遇到错误
+void ControllerBase::send_next() {
+	if (!queue_empty()) {// 间隔帧间隔后发送下一条指令
+		tmrGap_->expires_from_now(tgap_);
+		tmrGap_->async_wait(serial_->GetStrand().wrap(
+				boost::bind(&ControllerBase::on_gap, shared_from_this(), boost::asio::placeholders::error)));
+	}
+	else report_status();
+}
+
+void ControllerBase::update_health(uint8_t idd, bool success) {
+	int n = health_.size(), i;
+	for (i = 0; i < n && allDev_[i] != idd; ++i);
+	if (i == n) return;
+
+	DeviceHealth& health = health_[i];
+	ptime now = microsec_clock::universal_time();
+	if (success) {
+		health.failure = 0;
+		if (health.quarantined) {// 恢复监测: 全部监测项立即到期
+			health.quarantined = false;
+			_gLog.Write("port<%s> device<%d> is online again", portname_.c_str(), idd);
+			{
+				mutex_lock lck(mtxDrct_);
+				for (PollStateVec::iterator it = polls_.begin(); it != polls_.end(); ++it) {
+					if (it->idd == idd) it->due = now;
+				}
+			}
+			arm_cycle(now);
+		}
+	}
+	else {
+		++health.failure;
+		if (health.quarantined) {// 探测失败, 延长探测周期
+			if ((health.backoff *= 2) > seconds(PROBE_MAX)) health.backoff = seconds(PROBE_MAX);
+		}
+		else {// 隔离设备, 移除其尚未发送的监测指令
+			health.quarantined = true;
+			health.backoff = seconds(PROBE_MIN);
+			mutex_lock lck(mtxDrct_);
+			for (DrctList::iterator it = drct_.begin(); it != drct_.end(); ) {
+				if (it->idd == idd) it = drct_.erase(it);
+				else ++it;
+			}
+			for (PollStateVec::iterator it = polls_.begin(); it != polls_.end(); ++it) {
+				if (it->idd == idd) it->queued = false;
+			}
+		}
+		health.probe = now + health.backoff;
+		if (tmrCycle_->expires_at() > health.probe) arm_cycle(health.probe);
+		_gLog.Write(LOG_WARN, NULL, "port<%s> device<%d> %s, next probe in %d seconds", portname_.c_str(), idd,
+				health.failure == 1 ? "is quarantined" : "does not respond to probe", health.backoff.total_seconds());
+		if (health.failure == 1) {
+			mutex_lock lck(mtxStat_);
+			++stat_.quarantine;
+		}
+	}
+}
+
+void ControllerBase::report_status() {
+	ptime now = microsec_clock::universal_time();
+	if (!tmsweep_.is_not_a_date_time()) {// 一轮监测指令全部完成
+		double t = (now - tmsweep_).total_microseconds() * 1E-3;
+		tmsweep_ = ptime(boost::posix_time::not_a_date_time);
+		mutex_lock lck(mtxStat_);
+		++stat_.sweep;
+		stat_.tsweep += t;
+		if (t > stat_.tsweepMax) stat_.tsweepMax = t;
+	}
+	record_trend(now);
+	if ((now - tmreport_).total_seconds() >= CYCLE_PERIOD) {
+		tmreport_ = now;
+		write_log();
+		if (db_.use_count()) upload_database();
+	}
+
+	mutex_lock lck(mtxNet_);
+	if (tcp_.use_count() && tcp_->IsOpen()) network_respond();
+}
+
+void ControllerBase::record_trend(const ptime& now) {
+	int n = trends_.size();
+	if (!n) return;
+
+	ptime epoch(boost::gregorian::date(1970, 1, 1));
+	double t = (now - epoch).total_microseconds() * 1E-6;
+	float values[TREND_WIDTH_MAX];
+	for (int i = 0; i < n; ++i) {
+		if (!health_[i].quarantined && trend_sample(allDev_[i], values)) trends_[i]->Append(t, values);
+	}
+}
+
+ptime ControllerBase::schedule_poll(const ptime& now) {
+	mutex_lock lck(mtxDrct_);
+	int nDev(allDev_.size()), nRate(rates_.size()), i, j, k;
+	ptime next = now + seconds(CYCLE_PERIOD);
+
+	for (i = health_.size(); i < nDev; ++i) {// 新增设备
+		DeviceHealth health;
+		health.quarantined = false;
+		health.failure = 0;
+		health_.push_back(health);
+	}
+	if (trendHours_ > 0.0 && trend_width() > 0 && trend_width() <= TREND_WIDTH_MAX) {
+		for (i = trends_.size(); i < nDev; ++i) trends_.push_back(make_trend(trend_width(), trendHours_, trendRes_));
+	}
+
+	if (rateChanged_ || int(polls_.size()) != nDev * nRate) {// 重建调度状态: 全部监测项立即到期
+		rateChanged_ = false;
+		polls_.resize(nDev * nRate);
+		for (i = 0, k = 0; i < nDev; ++i) {
+			for (j = 0; j < nRate; ++j, ++k) {
+				PollState& state = polls_[k];
+				state.idd    = allDev_[i];
+				state.idf    = rates_[j].idf;
+				state.irate  = j;
+				state.queued = false;
+				state.due    = now;
+			}
+		}
+	}
+
+	for (i = 0, k = 0; i < nDev; ++i) {
+		DeviceHealth& health = health_[i];
+		if (health.quarantined) {// 被隔离设备: 到期时发送单条探测指令, 不重发
+			PollState& state = polls_[k];
+			if (nRate && !state.queued && health.probe <= now) {
+				Directive one(state.idd, state.idf);
+				one.len = encode_data(state.idd, state.idf, one.msg);
+				one.tmqueue = now;
+				one.retry = MAX_RETRY;
+				drct_.push_back(one);
+				state.queued = true;
+			}
+			if (health.probe > now && health.probe < next) next = health.probe;
+			k += nRate;
+			continue;
+		}
+
+		for (j = 0; j < nRate; ++j, ++k) {
+			PollState& state = polls_[k];
+			if (state.queued) continue; // 下次轮询时间由poll_done()依据应答确定
+			if (state.due <= now) {
+				Directive one(state.idd, state.idf);
+				one.len = encode_data(state.idd, state.idf, one.msg);
+				one.tmqueue = now;
+				if (tmsweep_.is_not_a_date_time()) tmsweep_ = now;
+				drct_.push_back(one);
+				state.queued = true;
+			}
+			else if (state.due < next) next = state.due;
+		}
+	}
+
+	return next;
 }
 
 /*
- * @brief 周期线程, 定时检测设备状态
+ * @note
+ * 监测指令的下次轮询时间在应答解析后确定: 控制指令完成后的首轮应答即可判定设备进入变化状态,
+ * 随即采用较短周期
  */
-void ControllerBase::thread_cycle() {
-	boost::chrono::seconds period(20);	// 周期: 20秒
-	int n;
-
-	boost::this_thread::sleep_for(boost::chrono::seconds(1));
-	while(1) {
-		if (!drct_.size()) {// 为所有设备生成监测指令
-			n = allDev_.size();
-			check_data(n);
-			for (int i = 0; i < n; ++i) generate_directive(allDev_[i]);
-			first_send();
+void ControllerBase::poll_done(const Directive& drct) {
+	bool control = drct.priority == PRIORITY_CONTROL;
+	ptime now = microsec_clock::universal_time();
+	ptime due;
+	{
+		mutex_lock lck(mtxDrct_);
+		for (PollStateVec::iterator it = polls_.begin(); it != polls_.end(); ++it) {
+			if (it->idd != drct.idd) continue;
+			if (control) it->due = now;
+			else if (it->idf == drct.idf) {
+				const PollRate& rate = rates_[it->irate];
+				it->queued = false;
+				it->due = due = now + millisec(int((is_ramping(drct.idd) ? rate.fast : rate.period) * 1000));
+				break;
+			}
 		}
-
-		boost::this_thread::sleep_for(period);
 	}
+	if (control) arm_cycle(now);
+	else if (!due.is_not_a_date_time() && due < tmrCycle_->expires_at()) arm_cycle(due);
+}
+
+void ControllerBase::arm_cycle(const ptime& at) {
+	tmrCycle_->expires_at(at);
+	tmrCycle_->async_wait(serial_->GetStrand().wrap(
+			boost::bind(&ControllerBase::on_cycle, shared_from_this(), boost::asio::placeholders::error)));
 }
 
 /*
- * @brief 响应线程, 处理串口读出结果
+ * @note 在串口strand中执行
  */
-void ControllerBase::thread_respond() {
-	boost::mutex mtxDummy;	// 互斥锁哑元
-	mutex_lock lckDummy(mtxDummy);
-
-	while(1) {
-		cndDrct_.wait(lckDummy);
-		boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
-		tmlast_ = second_clock::local_time();
-		remove_directive();
-		if (drct_.size()) first_send();
-		else {
-			write_log();
-			if (db_.unique()) upload_database();
-			if (tcp_.use_count() && tcp_->IsOpen()) network_respond();
+void ControllerBase::serial_read(long client, long ec) {
+	if (!running_) return;
+	if (!ec) {
+		if (ntail_) {// 处理收到的全部完整信息帧
+			SerialComm::Frame frame;
+			while (serial_->NextFrame(head_.c_str(), nhead_, tail_.c_str(), ntail_, frame))
+				process_frame(frame);
+		}
+		else {// 静默一个帧间隔后处理
+			tmrSilence_->expires_from_now(tgap_);
+			tmrSilence_->async_wait(serial_->GetStrand().wrap(
+					boost::bind(&ControllerBase::on_silence, shared_from_this(), boost::asio::placeholders::error)));
 		}
 	}
+	else if (!cbrslt_.empty()) cbrslt_(this, 1); // 接收时遇到错误
+}
+
+void ControllerBase::process_frame(const SerialComm::Frame& frame) {
+	uint8_t idd, idf;
+
+	tmlast_ = microsec_clock::universal_time(); // 收到任意信息帧, 串口有效
+	if (decode_data(frame.data, frame.len, idd, idf)) {
+		mutex_lock lck(mtxStat_);
+		++stat_.invalid;
+	}
+	else if (busy_ && idd == drctCur_.idd && idf == drctCur_.idf) {
+		tmrReply_->cancel();
+		complete_directive(true);
+	}
+	// 其它信息帧(如已超时指令的迟到应答)不属于当前指令: 丢弃, 应答定时器继续计时
+}
+
+void ControllerBase::on_silence(const boost::system::error_code& ec) {
+	if (ec == boost::asio::error::operation_aborted || !running_) return;
+
+	SerialComm::Frame frame;
+	if (serial_->NextFrame(head_.c_str(), nhead_, NULL, 0, frame)) process_frame(frame);
+}
+
+void ControllerBase::serial_write(long client, long ec) {
+	if (ec && !cbrslt_.empty()) cbrslt_(this, 2); // 发送时遇到错误
 }
 
 /*
- * @note 心跳线程, 监测串口有效性
+ * @brief 周期定时器: 生成到期的监测指令, 检测串口有效性
  */
-void ControllerBase::thread_heartbeat() {
-	boost::chrono::seconds period(30);	// 周期: 30秒
-	time_duration td;
-	int t0 = period.count();
+void ControllerBase::on_cycle(const boost::system::error_code& ec) {
+	if (ec == boost::asio::error::operation_aborted || !running_) return;
+
+	ptime now = microsec_clock::universal_time();
+	// 监测周期可能长于心跳时限: 仅在发出的指令未获应答时判定串口失效
+	if (tmtimeout_ > tmlast_ && (now - tmlast_).total_seconds() >= HEARTBEAT_PERIOD) {
+		if (!cbrslt_.empty()) cbrslt_(this, 3); // 长时间收不到信息
+		return;
+	}
 
-	tmlast_ = second_clock::local_time();
-	do {
-		boost::this_thread::sleep_for(period);
-		td = second_clock::local_time() - tmlast_;
-	} while(td.total_seconds() < t0);
-	if (!cbrslt_.empty()) cbrslt_((long) this, 3); // 长时间收不到信息
+	check_data(allDev_.size());
+	ptime next = schedule_poll(now);
+	first_send();
+	arm_cycle(next);
 }
 
-void ControllerBase::interrupt_thread(threadptr& thrd) {
-	if (thrd.unique()) {
-		thrd->interrupt();
-		thrd->join();
-		thrd.reset();
+/*
+ * @brief 应答定时器: 设备未在时限内应答, 放弃当前指令
+ */
+void ControllerBase::on_reply_timeout(const boost::system::error_code& ec, uint32_t seq) {
+	if (ec == boost::asio::error::operation_aborted || !running_) return;
+	if (!busy_ || seq != seq_) return; // 应答已在定时器到期前完成
+
+	_gLog.Write(LOG_WARN, NULL, "port<%s> reply timeout for device<%d> function<0x%02X>",
+			portname_.c_str(), drctCur_.idd, drctCur_.idf);
+	tmtimeout_ = microsec_clock::universal_time();
+	if (drctCur_.retry < MAX_RETRY) {// 重发: 放回所属队列首位
+		++drctCur_.retry;
+		busy_ = false;
+		{
+			mutex_lock lck(mtxDrct_);
+			if (drctCur_.priority == PRIORITY_CONTROL) drctCtl_.push_front(drctCur_);
+			else drct_.push_front(drctCur_);
+		}
+		{
+			mutex_lock lck(mtxStat_);
+			++stat_.retry;
+		}
+		send_next();
 	}
+	else complete_directive(false);
+}
+
+void ControllerBase::on_gap(const boost::system::error_code& ec) {
+	if (ec == boost::asio::error::operation_aborted || !running_) return;
+	first_send();
+}
+
+void ControllerBase::stop_timers(boost::promise<void>* done) {
+	boost::system::error_code ec;
+	tmrCycle_->cancel(ec);
+	tmrReply_->cancel(ec);
+	tmrGap_->cancel(ec);
+	tmrSilence_->cancel(ec);
+	if (done) done->set_value();
 }
@@ -4,6 +4,44 @@
  * @date 2017-11-15
  * @note
  * -
+ * @version 0.2
+ * @note
+ * - 采用定时器驱动的请求/应答状态机替代周期、响应与心跳线程
+ * - 收到应答并完成解码或应答超时后, 间隔由波特率计算的帧间隔立即发送下一条指令
+ * - 定时器与串口回调共用串口strand, 状态机串行执行
+ * @version 0.3
+ * @note
+ * - 指令分为控制与监测两个优先级队列. 控制指令在当前帧结束后优先发送, 不再排在整轮监测指令之后
+ * - 记录控制指令从入队到完成的延时, 通过RegisterCommand()注册的回调函数通知调用者
+ * @version 0.4
+ * @note
+ * - 按功能编号独立设置监测周期. 设备状态变化时(如制冷过程中)采用快速周期
+ * - 周期定时器在最近一条监测指令到期时触发, 不再固定为20秒
+ * - 日志与数据库按CYCLE_PERIOD限频输出, 网络在每轮指令完成后输出
+ * @version 0.5
+ * @note
+ * - 未设置结束标志时, 采用静默间隔分帧: 接收后静默一个帧间隔, 已接收数据构成一帧(modbus RTU)
+ * @version 0.6
+ * @note
+ * - 统计已发送、应答、超时与无效信息帧数量及监测轮次耗时, 由GetStat()查看
+ * - 通过RegisterTrace()注册的回调函数获得每条指令的往返时间, 用于性能测试
+ * @version 0.7
+ * @note
+ * - 应答超时的指令重发MAX_RETRY次, 仍无应答时判定设备失效
+ * - 失效设备被隔离: 移除其监测指令, 以指数退避周期(1至60秒)发送单条探测指令, 应答后恢复正常监测.
+ *   同一串口上其它设备的监测不受影响
+ * - 收到任意信息帧即视为串口有效; 仅当发出指令后HEARTBEAT_PERIOD内收不到任何信息帧时判定串口失效
+ * @version 0.8
+ * @note
+ * - 每台设备在内存中保存最近若干小时的监测数据(TelemetryRing), 每轮监测完成后追加一条
+ * - QueryTrend()按时间窗统计单一通道的最小值、最大值、均值与变化率, 不访问磁盘
+ * @version 0.9
+ * @note
+ * - 数据库上传改由DataUploader在独立线程中完成. 串口strand仅将监测数据压入队列, 不等待HTTP应答
+ * @version 0.10
+ * @note
+ * - 定时器与strand回调持有shared_from_this(), 串口回调跟踪控制接口生命周期, 挂起的回调不再访问已释放对象
+ * - 控制接口须由make_cooler()/make_vacuum()创建; 丢弃前应调用Stop(), 否则周期定时器保持对象有效
  */
 
 #ifndef CONTROLLERBASE_H_
@@ -13,15 +51,24 @@
 #include <vector>
 #include <string.h>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/thread/future.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include "SerialComm.h"
 #include "tcpasio.h"
 #include "AsciiProtocol.h"
-#include "DataTransfer.h"
+#include "DataUploader.h"
+#include "TelemetryRing.h"
 
 using std::list;
 using std::vector;
 
-class ControllerBase {
+#define CYCLE_PERIOD		20		//< 缺省监测周期, 量纲: 秒
+#define TREND_HOURS			24		//< 缺省监测数据保存时长, 量纲: 小时
+#define TREND_RESOLUTION	10		//< 缺省监测数据时间分辨率, 量纲: 秒
+#define TREND_WIDTH_MAX		8		//< 时间序列的最大通道数量
+
+class ControllerBase : public boost::enable_shared_from_this<ControllerBase> {
 public:
 	ControllerBase();
 	virtual ~ControllerBase();
@@ -30,33 +77,108 @@ public:
 	/* 数据结构 */
 	/*!
 	 * @brief 声明CoolerCtl回调函数类型
-	 * @param _1 对象指针
-	 * @param _2 错误代码. 0: 正确
+	 * @param _1 控制接口
+	 * @param _2 错误代码. 1: 接收错误; 2: 发送错误; 3: 长时间收不到信息
 	 */
-	typedef boost::signals2::signal<void (long, long)> CallbackFunc;
+	typedef boost::signals2::signal<void (ControllerBase*, int)> CallbackFunc;
 	typedef CallbackFunc::slot_type CBSlot; // 插槽函数
 
+	enum DRCT_PRIORITY {// 指令优先级
+		PRIORITY_MONITOR,	//< 周期监测指令
+		PRIORITY_CONTROL		//< 控制指令, 优先发送
+	};
+
 	struct Directive {// 单条控制指令
+		uint8_t idd;		//< 设备编号
 		uint8_t idf;		//< 功能编号
+		int priority;		//< 优先级
+		int retry;			//< 已重发次数
 		int len;			//< 指令字符串有效长度
 		char msg[30];	//< 指令字符串存储区
+		boost::posix_time::ptime tmqueue;	//< 进入队列时间
+		boost::posix_time::ptime tmsend;	//< 发送时间
 
 	public:
 		Directive() {
-			idf = 0;
+			idd = idf = 0;
+			priority = PRIORITY_MONITOR;
+			retry = 0;
 			len = 0;
 		}
 
-		Directive(uint8_t _idf) {
+		Directive(uint8_t _idd, uint8_t _idf, int _priority = PRIORITY_MONITOR) {
+			idd = _idd;
 			idf = _idf;
+			priority = _priority;
+			retry = 0;
 			len = 0;
 		}
 	};
 
+	struct CommandResult {// 指令执行结果
+		uint8_t idd;		//< 设备编号
+		uint8_t idf;		//< 功能编号
+		int priority;		//< 优先级
+		bool success;		//< 设备是否在时限内应答
+		double latency;		//< 从入队到完成的延时, 量纲: 毫秒
+		double rtt;			//< 从发送到完成的往返时间, 量纲: 毫秒
+	};
+
+	struct PortStat {// 串口统计信息
+		uint64_t sent;		//< 已发送指令数量
+		uint64_t reply;		//< 在时限内应答的指令数量
+		uint64_t timeout;	//< 重发后仍应答超时的指令数量
+		uint64_t retry;		//< 重发次数
+		uint64_t quarantine;	//< 设备被隔离次数
+		uint64_t invalid;	//< 解码失败的信息帧数量
+		uint64_t sweep;		//< 已完成的监测轮次
+		double tsweep;		//< 监测轮次累计耗时, 量纲: 毫秒
+		double tsweepMax;	//< 监测轮次最长耗时, 量纲: 毫秒
+
+	public:
+		PortStat() {
+			sent = reply = timeout = retry = quarantine = invalid = sweep = 0;
+			tsweep = tsweepMax = 0.0;
+		}
+	};
+	/*!
+	 * @brief 声明控制指令结果回调函数类型
+	 * @param _1 对象指针
+	 * @param _2 执行结果
+	 */
+	typedef boost::signals2::signal<void (long, const CommandResult&)> CommandFunc;
+	typedef CommandFunc::slot_type CmdSlot; // 插槽函数
+
+	struct PollRate {// 单项监测指令的轮询周期
+		uint8_t idf;		//< 功能编号
+		double period;		//< 设备状态稳定时的周期, 量纲: 秒
+		double fast;		//< 设备状态变化时的周期, 量纲: 秒. <=0时与period相同
+	};
+
+	struct PollState {// 单台设备单项监测指令的调度状态
+		uint8_t idd;		//< 设备编号
+		uint8_t idf;		//< 功能编号
+		int irate;			//< 轮询周期在rates_中的索引
+		bool queued;		//< 指令已进入队列, 尚未完成
+		boost::posix_time::ptime due;	//< 下次轮询时间
+	};
+
+	struct DeviceHealth {// 设备健康状态
+		bool quarantined;	//< 设备已被隔离
+		int failure;		//< 累计失效次数, 设备应答后清零
+		boost::posix_time::time_duration backoff;	//< 探测周期
+		boost::posix_time::ptime probe;	//< 下次探测时间
+	};
+
 	typedef boost::unique_lock<boost::mutex> mutex_lock;	//< 互斥锁
-	typedef boost::shared_ptr<boost::thread> threadptr;	//< 线程指针
 	typedef boost::shared_array<char> charray;	//< 字符型数组
 	typedef list<Directive> DrctList;	//< 指令列表
+	typedef vector<PollRate> PollRateVec;	//< 轮询周期集合
+	typedef vector<PollState> PollStateVec;	//< 调度状态集合
+	typedef vector<DeviceHealth> HealthVec;	//< 设备健康状态集合
+	typedef vector<TrendPtr> TrendVec;	//< 监测数据时间序列集合
+	typedef boost::asio::deadline_timer deadline_timer;	//< 定时器
+	typedef boost::shared_ptr<deadline_timer> timerptr;	//< 定时器指针
 
 protected:
 	/* 成员变量 */
@@ -68,20 +190,40 @@ protected:
 	TcpCPtr tcp_;		//< 网络接口
 	AscProtoPtr ascproto_;	//< 通信协议接口
 	string head_, tail_;	//< 串口信息起始/结束标志
-	int nhead_, ntail_;	//< 串口信息起始/结束标志长度, 量纲: 字节
-	charray bufrcv_;		//< 串口信息接收缓冲区
+	int nhead_, ntail_;	//< 串口信息起始/结束标志长度, 量纲: 字节. ntail_为0时采用静默间隔分帧
 
-	boost::condition_variable cndDrct_;	//< 完成控制指令发送-接收流程
-	DrctList drct_;			//< 指令集合, 用于周期状态检测和发送临时控制指令
+	DrctList drct_;			//< 监测指令队列, 用于周期状态检测
+	DrctList drctCtl_;		//< 控制指令队列, 优先于监测指令发送
+	Directive drctCur_;		//< 已发送、等待应答的指令
 	CallbackFunc cbrslt_;	//< 串口访问结果, 用于通知主程序串口异常
-	threadptr thrdCycle_;	//< 周期线程, 定时检测设备工作状态
-	threadptr thrdRespond_;	//< 线程, 响应处理串口操作结果
-	threadptr thrdHB_;		//< 心跳线程, 检测串口有效性
+	CommandFunc cbcmd_;		//< 控制指令执行结果
+	CommandFunc cbtrace_;	//< 全部指令执行结果
+	PortStat stat_;			//< 统计信息
+	boost::mutex mtxStat_;	//< 统计信息互斥锁
+	boost::posix_time::ptime tmsweep_;	//< 当前监测轮次的开始时间. not_a_date_time: 无未完成轮次
+	PollRateVec rates_;		//< 各功能编号的轮询周期
+	PollStateVec polls_;	//< 各设备各功能编号的调度状态. 索引: 设备序号 * rates_.size() + 周期序号
+	bool rateChanged_;		//< 轮询周期已修改, 需要重建调度状态
+	HealthVec health_;		//< 设备健康状态. 索引与allDev_一致
+	TrendVec trends_;		//< 监测数据时间序列. 索引与allDev_一致
+	double trendHours_;		//< 监测数据保存时长, 量纲: 小时. <=0时不保存
+	double trendRes_;		//< 监测数据时间分辨率, 量纲: 秒
+	timerptr tmrCycle_;		//< 周期定时器, 定时检测设备工作状态与串口有效性
+	timerptr tmrReply_;		//< 应答定时器, 等待设备应答的时限
+	timerptr tmrGap_;		//< 帧间隔定时器, 两条指令之间的静默时间
+	timerptr tmrSilence_;	//< 静默定时器, 以静默间隔分帧时判定帧结束
+	bool running_;			//< 控制服务运行标志
+	bool busy_;				//< 已发送指令, 等待设备应答
+	uint32_t seq_;			//< 已发送指令序号, 用于识别过期的应答超时
+	boost::posix_time::time_duration tchar_;	//< 单字符传输时间
+	boost::posix_time::time_duration tgap_;	//< 帧间隔
 	boost::mutex mtxDrct_;	//< 指令互斥锁
 	boost::mutex mtxNet_;	//< 网络互斥锁
 	boost::posix_time::ptime tmlast_;	//< 最后一次通信时间
+	boost::posix_time::ptime tmtimeout_;	//< 最后一次应答超时时间
+	boost::posix_time::ptime tmreport_;	//< 最后一次输出日志与数据库时间
 
-	boost::shared_ptr<DataTransfer> db_;	//< 数据库访问接口
+	UploaderPtr db_;		//< 数据库上传接口. 多个控制器共用
 
 public:
 	/* 接口 */
@@ -92,6 +234,26 @@ public:
 	 * 通知主程序串口异常, 需要重启串口等
 	 */
 	void RegisterResult(const CBSlot &slot);
+	/*!
+	 * @brief 注册回调函数
+	 * @param slot 函数插槽
+	 * @note
+	 * 控制指令完成或应答超时后, 通知其执行结果与延时
+	 */
+	void RegisterCommand(const CmdSlot &slot);
+	/*!
+	 * @brief 注册回调函数
+	 * @param slot 函数插槽
+	 * @note
+	 * 每条指令(含监测指令)完成或应答超时后调用, 在串口strand中执行, 用于性能测试
+	 */
+	void RegisterTrace(const CmdSlot &slot);
+	/*!
+	 * @brief 查看统计信息
+	 * @return
+	 * 统计信息
+	 */
+	PortStat GetStat();
 	/*!
 	 * @brief 启动控制服务
 	 * @param portname  串口名称
@@ -118,10 +280,10 @@ public:
 	 */
 	void DecoupleNetwork();
 	/*!
-	 * @brief 设置数据库访问地址
-	 * @param url 数据库访问地址
+	 * @brief 设置数据库上传接口
+	 * @param uploader 上传接口. 空指针表示不上传
 	 */
-	void SetDatabase(const string& url);
+	void SetDatabase(UploaderPtr uploader);
 	/*!
 	 * @brief 接口: 添加与串口关联的设备编号
 	 * @param idd 设备编号
@@ -129,10 +291,19 @@ public:
 	 * 一个串口可以关联复数设备
 	 */
 	void AddDevice(uint8_t idd);
+	/*!
+	 * @brief 接口: 查看设备是否与串口关联
+	 * @param idd 设备编号
+	 * @return
+	 * 设备已由AddDevice()关联
+	 */
+	bool HasDevice(uint8_t idd);
 	/*!
 	 * @brief 向串口发送指令
 	 * @param idd 设备编号
 	 * @param idf 功能编号
+	 * @note
+	 * Write()生成的指令进入控制队列, 在当前帧结束后优先于监测指令发送
 	 */
 	void Write(uint8_t idd, uint8_t idf);
 	/*!
@@ -149,6 +320,36 @@ public:
 	 * @param value 浮点类型参数
 	 */
 	void Write(uint8_t idd, uint8_t idf, double value);
+	/*!
+	 * @brief 设置监测指令的轮询周期
+	 * @param idf    功能编号
+	 * @param period 设备状态稳定时的周期, 量纲: 秒. <=0时不再轮询该功能
+	 * @param fast   设备状态变化时的周期, 量纲: 秒. <=0时与period相同
+	 * @note
+	 * - 功能编号不在监测列表中时将其加入监测列表
+	 * - 派生类在构造函数中设置缺省监测列表, 配置文件可覆盖
+	 */
+	void SetPollRate(uint8_t idf, double period = CYCLE_PERIOD, double fast = 0.0);
+	/*!
+	 * @brief 设置监测数据时间序列
+	 * @param hours      保存时长, 量纲: 小时. <=0时不保存
+	 * @param resolution 时间分辨率, 量纲: 秒
+	 * @note
+	 * 修改后清空已保存的监测数据
+	 */
+	void SetTrend(double hours = TREND_HOURS, double resolution = TREND_RESOLUTION);
+	/*!
+	 * @brief 统计设备在最近时间窗内的监测数据
+	 * @param idd     设备编号
+	 * @param channel 通道名称, 由派生类定义, 与网络协议关键字一致
+	 * @param window  时间窗, 量纲: 秒. <=0时统计全部已保存数据
+	 * @param stat    统计结果
+	 * @return
+	 * 设备与通道有效且时间窗内有数据时返回true
+	 * @note
+	 * 可在任意线程中调用
+	 */
+	bool QueryTrend(uint8_t idd, const string& channel, double window, TrendStat& stat);
 	/*!
 	 * @brief 查看串口名称
 	 * @return
@@ -163,11 +364,6 @@ protected:
 	 * @param nDev 设备数量
 	 */
 	virtual void check_data(int nDev) = 0;
-	/*!
-	 * @brief 为指定设备生成控制指令
-	 * @param idd 设备编号
-	 */
-	virtual void generate_directive(uint8_t idd) = 0;
 	/*!
 	 * @brief 依照串口通信协议, 对数据进行编码
 	 * @param idd    设备编号
@@ -183,14 +379,20 @@ protected:
 	virtual int encode_data(uint8_t idd, uint8_t idf, const char *value, int n, char *output) = 0;
 	/*!
 	 * @brief 解码数据串
+	 * @param frame  待解码数据串, 包含起始和结束标志
 	 * @param len    待解码数据串长度, 量纲: 字节
+	 * @param idd    解码得到的设备编号
+	 * @param idf    解码得到的功能编号
 	 * @return
 	 * 数据串解码结果
 	 *  0: 成功
 	 * -1: 长度不足
 	 * -2: 数据长度不足
+	 * -3: 校验错误
+	 * @note
+	 * frame指向串口接收缓冲区, 仅在调用期间有效. 由process_frame()比对idd与idf, 判定是否为当前指令的应答
 	 */
-	virtual int decode_data(int len) = 0;
+	virtual int decode_data(const char *frame, int len, uint8_t& idd, uint8_t& idf) = 0;
 	/*!
 	 * @brief 在日志中记录最新工作状态
 	 */
@@ -203,19 +405,57 @@ protected:
 	 * @brief 通过网络发送设备状态
 	 */
 	virtual void network_respond() = 0;
+	/*!
+	 * @brief 检查设备状态是否处于变化过程中
+	 * @param idd 设备编号
+	 * @return
+	 * 处于变化过程中时返回true, 监测指令采用快速周期
+	 */
+	virtual bool is_ramping(uint8_t idd);
+	/*!
+	 * @brief 查看时间序列的通道数量
+	 * @return
+	 * 通道数量, 不大于TREND_WIDTH_MAX. 0表示不保存时间序列
+	 */
+	virtual int trend_width();
+	/*!
+	 * @brief 查找通道名称对应的通道序号
+	 * @param name 通道名称
+	 * @return
+	 * 通道序号. -1表示无效名称
+	 */
+	virtual int trend_channel(const string& name);
+	/*!
+	 * @brief 采集设备当前各通道数据
+	 * @param idd    设备编号
+	 * @param values 各通道数据, 长度为trend_width()
+	 * @return
+	 * 设备数据有效时返回true
+	 */
+	virtual bool trend_sample(uint8_t idd, float* values);
 
 protected:
 	/* 功能 */
 	/*!
-	 * @brief 在指令列表中追加一条指令
-	 * @param txt 指令信息
-	 * @param n   指令信息长度
+	 * @brief 按优先级在指令队列中追加一条指令
+	 * @param drct 指令
 	 */
 	void append_directive(Directive &drct);
 	/*!
-	 * @brief 移除指令列表首地址指令
+	 * @brief 取出下一条待发送指令
+	 * @param drct 指令
+	 * @return
+	 * 是否有待发送指令
+	 * @note
+	 * 控制队列非空时优先取出控制指令
 	 */
-	void remove_directive();
+	bool next_directive(Directive &drct);
+	/*!
+	 * @brief 检查指令队列是否为空
+	 * @return
+	 * 控制与监测队列均为空时返回true
+	 */
+	bool queue_empty();
 	/*!
 	 * @brief 编码无参数协议
 	 * @param idd    设备编号
@@ -254,15 +494,85 @@ protected:
 	 */
 	uint8_t decode_uint8(uint8_t b1, uint8_t b2);
 	/*!
-	 * @brief 发送列表中第一条信息
+	 * @brief 取出并发送下一条指令, 并启动应答定时器
+	 * @note
+	 * 在串口strand中执行. 正在等待应答或队列为空时不发送
 	 */
 	void first_send();
+	/*!
+	 * @brief 在串口strand中尝试发送列表中第一条信息
+	 * @note
+	 * 供非strand线程追加指令后调用
+	 */
+	void kick_send();
+	/*!
+	 * @brief 结束当前指令的请求/应答流程
+	 * @param success 设备是否在时限内应答
+	 * @note
+	 * 通知控制指令执行结果; 间隔帧间隔后发送下一条指令, 或在队列为空时输出监测结果
+	 */
+	void complete_directive(bool success);
+	/*!
+	 * @brief 输出一轮监测结果: 日志、数据库和网络
+	 * @note
+	 * 日志与数据库的输出间隔不小于CYCLE_PERIOD
+	 */
+	void report_status();
+	/*!
+	 * @brief 为各设备追加一条监测数据
+	 * @param now 当前时间
+	 * @note
+	 * 被隔离设备的数据已过期, 不追加
+	 */
+	void record_trend(const boost::posix_time::ptime& now);
+	/*!
+	 * @brief 将已到期的监测指令加入队列
+	 * @param now 当前时间
+	 * @return
+	 * 下一条监测指令的到期时间
+	 */
+	boost::posix_time::ptime schedule_poll(const boost::posix_time::ptime& now);
+	/*!
+	 * @brief 更新已完成指令的调度状态
+	 * @param drct 已完成指令
+	 * @note
+	 * - 控制指令完成后, 立即重新读取该设备的全部监测项
+	 * - 监测指令完成后, 依据已解析的应答确定下次轮询时间
+	 */
+	void poll_done(const Directive& drct);
+	/*!
+	 * @brief 依据指令执行结果更新设备健康状态
+	 * @param idd     设备编号
+	 * @param success 设备是否应答
+	 * @note
+	 * 设备失效时将其隔离并移除其监测指令; 被隔离设备应答后恢复监测
+	 */
+	void update_health(uint8_t idd, bool success);
+	/*!
+	 * @brief 间隔帧间隔后发送下一条指令, 或在队列为空时输出监测结果
+	 */
+	void send_next();
+	/*!
+	 * @brief 设置周期定时器的到期时间
+	 * @param at 到期时间
+	 */
+	void arm_cycle(const boost::posix_time::ptime& at);
 	/*!
 	 * @brief 串口读出回调函数
 	 * @param client 串口指针
 	 * @param ec     错误代码. 0: 无错误
 	 */
 	void serial_read(long client, long ec);
+	/*!
+	 * @brief 解码一条信息帧. 若其为当前指令的应答, 则结束当前指令
+	 * @param frame 信息帧
+	 */
+	void process_frame(const SerialComm::Frame& frame);
+	/*!
+	 * @brief 静默定时器回调函数, 将已接收数据作为一帧处理
+	 * @param ec 错误代码
+	 */
+	void on_silence(const boost::system::error_code& ec);
 	/*!
 	 * @brief 串口写入回调函数
 	 * @param client 串口指针
@@ -270,22 +580,26 @@ protected:
 	 */
 	void serial_write(long client, long ec);
 	/*!
-	 * @brief 周期线程, 定时检测系统工作状态
+	 * @brief 周期定时器回调函数, 生成到期的监测指令, 检测串口有效性
+	 * @param ec 错误代码
 	 */
-	void thread_cycle();
+	void on_cycle(const boost::system::error_code& ec);
 	/*!
-	 * @brief 线程, 响应串口反馈消息
+	 * @brief 应答定时器回调函数, 处理设备应答超时: 重发指令或判定设备失效
+	 * @param ec  错误代码
+	 * @param seq 启动定时器时的指令序号
 	 */
-	void thread_respond();
+	void on_reply_timeout(const boost::system::error_code& ec, uint32_t seq);
 	/*!
-	 * @brief 心跳线程, 监测串口连接有效性
+	 * @brief 帧间隔定时器回调函数, 发送下一条指令
+	 * @param ec 错误代码
 	 */
-	void thread_heartbeat();
+	void on_gap(const boost::system::error_code& ec);
 	/*!
-	 * @brief 中止线程
-	 * @param thrd 线程指针
+	 * @brief 在串口strand中停止定时器
+	 * @param done 完成标志. 非空时通知调用线程
 	 */
-	void interrupt_thread(threadptr& thrd);
+	void stop_timers(boost::promise<void>* done);
 };
 typedef boost::shared_ptr<ControllerBase> CtlBasePtr;
 
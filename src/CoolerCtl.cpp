@@ -7,6 +7,8 @@
 #include <boost/make_shared.hpp>
 #include <boost/format.hpp>
 #include <stdlib.h>
+#include <string.h>
+#include <boost/algorithm/string.hpp>
 #include "CoolerCtl.h"
 #include "AMath.h"
 #include "GLog.h"
@@ -15,20 +17,48 @@ using namespace AstroUtil;
 using namespace boost::posix_time;
 
 //////////////////////////////////////////////////////////////////////////////
-static uint8_t COOLER_MONITOR[] = { CFID_READ_VOL, CFID_READ_CUR, CFID_READ_T1, CFID_READ_T2, CFID_READ_COOLSET };
+/*
+ * 缺省监测列表: 功能编号, 稳定周期, 变化周期. 制冷温度仅在写入后变化, 写入后立即重读
+ */
+static ControllerBase::PollRate COOLER_MONITOR[] = {
+	{ CFID_READ_VOL,     CYCLE_PERIOD,  5.0 },
+	{ CFID_READ_CUR,     CYCLE_PERIOD,  5.0 },
+	{ CFID_READ_T1,      CYCLE_PERIOD,  1.0 },
+	{ CFID_READ_T2,      CYCLE_PERIOD,  5.0 },
+	{ CFID_READ_COOLSET, 300.0,       300.0 }
+};
+
+/*
+ * 时间序列通道名称, 与网络协议关键字一致
+ */
+static const char* COOLER_TREND[] = { "voltage", "current", "hotend", "coolget", "coolset" };
 
 CoolCPtr make_cooler() {
 	return boost::make_shared<CoolerCtl>();
 }
 
 CoolerCtl::CoolerCtl() {
-	head_ = ":";
-	tail_ = "\r\n";
-	nhead_ = head_.size();
-	ntail_ = tail_.size();
+	SetRTU(false);
+
+	int n = sizeof(COOLER_MONITOR) / sizeof(PollRate);
+	for (int i = 0; i < n; ++i) SetPollRate(COOLER_MONITOR[i].idf, COOLER_MONITOR[i].period, COOLER_MONITOR[i].fast);
 }
 
 CoolerCtl::~CoolerCtl() {
+	Stop(); // 先于派生类成员析构停止状态机
+}
+
+void CoolerCtl::SetRTU(bool rtu) {
+	if ((rtu_ = rtu)) {// 无起始/结束标志, 以静默间隔分帧
+		head_ = "";
+		tail_ = "";
+	}
+	else {
+		head_ = ":";
+		tail_ = "\r\n";
+	}
+	nhead_ = head_.size();
+	ntail_ = tail_.size();
 }
 
 void CoolerCtl::check_data(int nDev) {
@@ -38,20 +68,22 @@ void CoolerCtl::check_data(int nDev) {
 	}
 }
 
-void CoolerCtl::generate_directive(uint8_t idd) {
-	int n = sizeof(COOLER_MONITOR) / sizeof(uint8_t);
-	uint8_t idf;
-	for (int i = 0; i < n; ++i) {
-		Directive one(idf = COOLER_MONITOR[i]);
-		one.len = ControllerBase::encode_data(idd, idf, one.msg);
-		append_directive(one);
-	}
-}
-
 int CoolerCtl::encode_data(uint8_t idd, uint8_t idf, const char* value, int len, char *output) {
 	int i(-1);
 	uint8_t lrc, t, base_0(0x30), base_1(0x37);
 
+	if (rtu_) {// 设备编号 + 功能编码 + 数据 + CRC16(低字节在前)
+		unsigned short crc;
+		output[++i] = idd;
+		output[++i] = idf;
+		if (len > 0) memcpy(output + i + 1, value, len);
+		i += len;
+		crc = CRC16((const uint8_t*) output, i + 1);
+		output[++i] = crc & 0xFF;
+		output[++i] = crc >> 8;
+		return i + 1;
+	}
+
 	output[++i] = ':';	// 引导符
 	// 设备编号
 	output[++i] = ((t = idd / 16) >= 0x0A) ? (t + base_1) : (t + base_0);
@@ -77,21 +109,34 @@ int CoolerCtl::encode_data(uint8_t idd, uint8_t idf, const char* value, int len,
 	return i;
 }
 
-int CoolerCtl::decode_data(int len) {
-	if ((len < 9)) return -1;	// 格式错误
-	if ((len - 9) % 2) return -2;	// 格式错误
-
-	char *ptr = bufrcv_.get();
-	int first(5), last(len - 5), i, j;
-	string strval;
-	uint8_t idd, idf;
-	double value;
-
-	idd = decode_uint8(ptr[1], ptr[2]);
-	idf = decode_uint8(ptr[3], ptr[4]);
-	if (len > 9) {
-		for (i = first, j = 0; i <= last; i += 2, ++j) strval += decode_uint8(ptr[i], ptr[i + 1]);
-		value = atof(strval.c_str());
+int CoolerCtl::decode_data(const char *frame, int len, uint8_t& idd, uint8_t& idf) {
+	const char *ptr = frame;
+	int last, i, j;
+	char strval[32];
+	double value(0.0);
+
+	if (rtu_) {
+		if (len < 4) return -1;	// 格式错误
+		if (len - 4 >= 32) return -2;	// 数据超出存储区
+		unsigned short crc = CRC16((const uint8_t*) ptr, len - 2);
+		if (uint8_t(ptr[len - 2]) != (crc & 0xFF) || uint8_t(ptr[len - 1]) != (crc >> 8)) return -3;
+
+		idd = ptr[0];
+		idf = ptr[1];
+		if ((j = len - 4) > 0) memcpy(strval, ptr + 2, j);
+	}
+	else {
+		if ((len < 9)) return -1;	// 格式错误
+		if ((len - 9) % 2) return -2;	// 格式错误
+		if ((len - 9) / 2 >= 32) return -2;	// 数据超出存储区
+
+		idd = decode_uint8(ptr[1], ptr[2]);
+		idf = decode_uint8(ptr[3], ptr[4]);
+		for (i = 5, last = len - 5, j = 0; i < last; i += 2, ++j) strval[j] = decode_uint8(ptr[i], ptr[i + 1]);
+	}
+	if (j > 0) {
+		strval[j] = 0;
+		value = atof(strval);
 	}
 
 	CoolerData *data = find_device(idd);
@@ -117,43 +162,51 @@ void CoolerCtl::write_log() {
 	}
 }
 
+/*
+ * @note 仅压入上传队列, 由DataUploader线程上传
+ */
 void CoolerCtl::upload_database() {
-//	  int uploadTemperature(const char *groupId, const char *unitId, const char *camId,
-//	          float voltage, float current, float thot, float coolget, float coolset, const char *time, char statusstr[]);
 	string now = to_iso_extended_string(second_clock::universal_time());
 	int n = data_.size();
-	char uid[10], cid[10], status[200];
+	UploadSample sample;
+
+	sample.type = UPLOAD_TEMPERATURE;
+	strncpy(sample.gid, grpid_.c_str(), sizeof(sample.gid) - 1);
+	strncpy(sample.utc, now.c_str(), sizeof(sample.utc) - 1);
 	for (int i = 0; i < n; ++i) {
 		CoolerData& x = data_[i];
-		sprintf(uid, "%03d", x.idd / 10);
-		sprintf(cid, "%03d", x.idd);
-		if (db_->uploadTemperature(grpid_.c_str(), uid, cid, x.vol, x.cur, x.thot, x.coolget,
-				x.coolset, now.c_str(), status)) {
-			_gLog.Write(LOG_WARN, NULL, "cooler[%s] upload to database failed: %s", cid, status);
-		}
+		sprintf(sample.uid, "%03d", x.idd / 10);
+		sprintf(sample.cid, "%03d", x.idd);
+		sample.voltage = x.vol;
+		sample.current = x.cur;
+		sample.thot    = x.thot;
+		sample.coolget = x.coolget;
+		sample.coolset = x.coolset;
+		db_->Push(sample);
 	}
 }
 
 void CoolerCtl::network_respond() {
 	int n = data_.size(), len;
-	boost::format fmt("%03d");
-	apcooler proto = boost::make_shared<ascii_proto_cooler>();
-	uint8_t idd;
-	const char *tosend;
+	ascii_proto_cooler proto;
+	char uid[8], cid[8], tosend[ASCII_LINE_MAX];
 
+	proto.gid = grpid_;
 	for (int i = 0; i < n; ++i) {
 		CoolerData& data = data_[i];
-		proto->gid = grpid_;
-		proto->uid = (fmt % (data.idd / 10)).str();
-		proto->cid = (fmt % data.idd).str();
-		proto->voltage = data.vol;
-		proto->current = data.cur;
-		proto->hotend  = data.thot;
-		proto->coolget = data.coolget;
-		proto->coolset = data.coolset;
-		tosend = ascproto_->CompactCooler(proto, len);
-		tcp_->Write(tosend, len);
+		sprintf(uid, "%03d", data.idd / 10);
+		sprintf(cid, "%03d", data.idd);
+		proto.uid = uid;
+		proto.cid = cid;
+		proto.voltage = data.vol;
+		proto.current = data.cur;
+		proto.hotend  = data.thot;
+		proto.coolget = data.coolget;
+		proto.coolset = data.coolset;
+		if ((len = ascproto_->SerializeCooler(proto, tosend, ASCII_LINE_MAX)))
+			tcp_->Write(tosend, len, false, 0x100 | data.idd); // 键值: 设备类型与编号
 	}
+	tcp_->Flush(); // 全部设备的数据合并发送
 }
 
 CoolerData* CoolerCtl::find_device(uint8_t idd) {
@@ -161,3 +214,29 @@ CoolerData* CoolerCtl::find_device(uint8_t idd) {
 	for (i = 0; i < n && data_[i].idd != idd; ++i);
 	return i == n ? NULL : &data_[i];
 }
+
+bool CoolerCtl::is_ramping(uint8_t idd) {
+	CoolerData *data = find_device(idd);
+	return data && data->ramping;
+}
+
+int CoolerCtl::trend_width() {
+	return sizeof(COOLER_TREND) / sizeof(char*);
+}
+
+int CoolerCtl::trend_channel(const string& name) {
+	int n = trend_width(), i;
+	for (i = 0; i < n && !boost::iequals(name, COOLER_TREND[i]); ++i);
+	return i == n ? -1 : i;
+}
+
+bool CoolerCtl::trend_sample(uint8_t idd, float* values) {
+	CoolerData *data = find_device(idd);
+	if (!data) return false;
+	values[0] = data->vol;
+	values[1] = data->cur;
+	values[2] = data->thot;
+	values[3] = data->coolget;
+	values[4] = data->coolset;
+	return true;
+}
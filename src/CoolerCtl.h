@@ -9,14 +9,30 @@
  * - 维护串口连接
  * - 串行化发送编码数据
  * - 解析接收数据
+ *
+ * @version 0.2
+ * - 探测器温度与制冷温度偏差较大或变化较快时, 判定为制冷过程, 缩短温度轮询周期
+ *
+ * @version 0.3
+ * - 增加modbus RTU模式: 二进制帧, CRC16校验, 以3.5字符静默间隔分帧. 数据区与ASCII模式相同
+ *
+ * @version 0.4
+ * - 在时间序列中保存电压、电流、热端温度、探测器温度与制冷温度
+ *
+ * @version 0.5
+ * - 监测数据压入DataUploader队列后异步上传, 不阻塞串口
  */
 
 #ifndef COOLERCTL_H_
 #define COOLERCTL_H_
 
+#include <math.h>
 #include <boost/container/stable_vector.hpp>
 #include "ControllerBase.h"
 
+#define RAMP_OFFSET		1.0		//< 探测器温度与制冷温度偏差大于该值时判定为制冷过程, 量纲: 摄氏度
+#define RAMP_DELTA		0.2		//< 相邻两次探测器温度之差大于该值时判定为制冷过程, 量纲: 摄氏度
+
 //////////////////////////////////////////////////////////////////////////////
 /* 数据类型 -- 温控 */
 enum CoolerFuncID {// 温控功能编码
@@ -36,8 +52,16 @@ struct CoolerData {// 单个温控器数据
 	double	thot;	//< 热端温度
 	double	coolset;//< 制冷温度
 	double	coolget;//< 探测器温度
+	bool ramping;	//< 温度变化过程中
 
 public:
+	CoolerData() {
+		dirty = false;
+		idd = 0;
+		vol = cur = thot = coolset = coolget = 0.0;
+		ramping = false;
+	}
+
 	void set_voltage(double value) {
 		if (vol != value) {
 			vol = value;
@@ -67,6 +91,7 @@ public:
 	}
 
 	void set_coolget(double value) {
+		ramping = fabs(value - coolget) > RAMP_DELTA || fabs(value - coolset) > RAMP_OFFSET;
 		if (coolget != value) {
 			coolget = value;
 			dirty = true;
@@ -82,6 +107,16 @@ public:
 
 protected:
 	CoolDVec data_;	//< 温控数据
+	bool rtu_;		//< 通信模式. true: modbus RTU; false: modbus ASCII
+
+public:
+	/*!
+	 * @brief 设置通信模式
+	 * @param rtu true: modbus RTU; false: modbus ASCII
+	 * @note
+	 * 应在Start()之前调用
+	 */
+	void SetRTU(bool rtu);
 
 protected:
 	/* 功能: 数据编码与解码 */
@@ -90,11 +125,6 @@ protected:
 	 * @param nDev 设备数量
 	 */
 	void check_data(int nDev);
-	/*!
-	 * @brief 为指定设备生成控制指令
-	 * @param idd 设备编号
-	 */
-	void generate_directive(uint8_t idd);
 	/*!
 	 * @brief 依照串口通信协议, 对数据进行编码
 	 * @param idd    设备编号
@@ -110,14 +140,18 @@ protected:
 	int encode_data(uint8_t idd, uint8_t idf, const char *value, int n, char *output);
 	/*!
 	 * @brief 解码数据串
+	 * @param frame  待解码数据串, 包含起始和结束标志
 	 * @param len    待解码数据串长度, 量纲: 字节
+	 * @param idd    解码得到的设备编号
+	 * @param idf    解码得到的功能编号
 	 * @return
 	 * 数据串解码结果
 	 *  0: 成功
 	 * -1: 长度不足
 	 * -2: 数据长度不足
+	 * -3: 校验错误
 	 */
-	int decode_data(int len);
+	int decode_data(const char *frame, int len, uint8_t& idd, uint8_t& idf);
 	/*!
 	 * @brief 在日志中记录最新工作状态
 	 */
@@ -137,6 +171,34 @@ protected:
 	 * 与设备编号对应的数据存储区指针
 	 */
 	CoolerData* find_device(uint8_t idd);
+	/*!
+	 * @brief 检查温控器是否处于制冷过程中
+	 * @param idd 设备编号
+	 * @return
+	 * 处于制冷过程中时返回true
+	 */
+	bool is_ramping(uint8_t idd);
+	/*!
+	 * @brief 查看时间序列的通道数量
+	 * @return
+	 * 通道数量
+	 */
+	int trend_width();
+	/*!
+	 * @brief 查找通道名称对应的通道序号
+	 * @param name 通道名称: voltage, current, hotend, coolget, coolset
+	 * @return
+	 * 通道序号. -1表示无效名称
+	 */
+	int trend_channel(const string& name);
+	/*!
+	 * @brief 采集设备当前各通道数据
+	 * @param idd    设备编号
+	 * @param values 各通道数据
+	 * @return
+	 * 设备数据有效时返回true
+	 */
+	bool trend_sample(uint8_t idd, float* values);
 };
 typedef boost::shared_ptr<CoolerCtl> CoolCPtr;
 extern CoolCPtr make_cooler();
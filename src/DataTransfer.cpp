@@ -7,10 +7,13 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <curl/curl.h>
 #include "DataTransfer.h"
 #include "data.h"
 
+static pthread_once_t curlOnce = PTHREAD_ONCE_INIT;
+static void curlGlobalInit();
 static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp);
 static int joinStr(const char *s1, const char *s2, char **s3);
 static int dateToStr(struct timeval tv, char *dateStr);
@@ -26,9 +29,17 @@ static int dateToStr(struct timeval tv, char *dateStr);
 DataTransfer::DataTransfer(const char *url) {
     rootUrl = url;
     initParameter();
+    /* libcurl global state is initialized once per process and never cleaned up,
+     * curl_global_cleanup() is not thread safe while other objects still use curl */
+    curlGlobalInitOnce();
+    curlSession = curl_easy_init();
 }
 
 DataTransfer::~DataTransfer() {
+    if (curlSession != NULL) {
+        curl_easy_cleanup(curlSession);
+    }
+
     if (ot1ListUrl != NULL) {
         free(ot1ListUrl);
     }
@@ -81,6 +92,7 @@ DataTransfer::~DataTransfer() {
     }
 
     if (tmpChunk != NULL) {
+        free(tmpChunk->memory);
         free(tmpChunk);
     }
 }
@@ -107,6 +119,9 @@ void DataTransfer::initParameter() {
     joinStr(rootUrl.c_str(), UPLOAD_OBS_CTL_SYS_STATUS, &updateObsCtlSysStatusUrl);
 
     tmpChunk = (struct CurlCache *) malloc(sizeof (struct CurlCache));
+    tmpChunk->memory = NULL;
+    tmpChunk->size = 0;
+    tmpChunk->capacity = 0;
 }
 
 /***
@@ -387,8 +402,8 @@ int DataTransfer::sendLogMsg(ST_MSGBUF *msg, char statusstr[]) {
  */
 int DataTransfer::uploadDatas(const char url[],
         const char path[],
-        multimap<string, string> params,
-        multimap<string, string> files,
+        const multimap<string, string> &params,
+        const multimap<string, string> &files,
         char statusstr[]) {
 
     int rstCode = GWAC_SUCCESS;
@@ -407,48 +422,16 @@ int DataTransfer::uploadDatas(const char url[],
         return GWAC_FUNCTION_INPUT_EMPTY;
     }
 
-    CURL *curlSession;
-    CURLcode curlCode;
-
-    struct curl_httppost *formpost = NULL;
-    struct curl_httppost *lastptr = NULL;
-    struct curl_slist *headerlist = NULL;
-    static const char buf[] = "Expect:";
-
-    tmpChunk->memory = (char*) malloc(1); /* will be grown as needed by realloc above */
-    tmpChunk->size = 0; /* no data at this point */
-
-    curl_global_init(CURL_GLOBAL_ALL);
-
-    for (multimap<string, string>::iterator iter = params.begin(); iter != params.end(); iter++) {
-        curl_formadd(&formpost,
-                &lastptr,
-                CURLFORM_COPYNAME, iter->first.data(),
-                CURLFORM_COPYCONTENTS, iter->second.data(),
-                CURLFORM_END);
-    }
-
-    for (multimap<string, string>::iterator iter = files.begin(); iter != files.end(); iter++) {
-        string filePath(path, path + strlen(path));
-        filePath.append(iter->second.data());
-        //cout << iter->first.data() << ":" << filePath.data() << endl;
-        curl_formadd(&formpost,
-                &lastptr,
-                CURLFORM_COPYNAME, iter->first.data(),
-                CURLFORM_FILE, filePath.data(),
-                CURLFORM_END);
-    }
-
 #ifdef DEBUG  
     string conStr = "{";
-    for (multimap<string, string>::iterator iter = params.begin(); iter != params.end(); iter++) {
+    for (multimap<string, string>::const_iterator iter = params.begin(); iter != params.end(); iter++) {
         conStr.append(iter->first);
         conStr.append(":");
         conStr.append(iter->second);
         conStr.append(",");
     }
 
-    for (multimap<string, string>::iterator iter = files.begin(); iter != files.end(); iter++) {
+    for (multimap<string, string>::const_iterator iter = files.begin(); iter != files.end(); iter++) {
         string filePath(path, path + strlen(path));
         filePath.append(iter->second.data());
 
@@ -461,105 +444,199 @@ int DataTransfer::uploadDatas(const char url[],
     cout << "conStr: " << conStr << endl;
 #endif
 
-    curlSession = curl_easy_init();
-    /* initialize custom header list (stating that Expect: 100-continue is not wanted */
-    headerlist = curl_slist_append(headerlist, buf);
+    /* the handle is created once and kept, a failed creation is retried here */
+    if (curlSession == NULL) {
+        curlSession = curl_easy_init();
+    }
     if (curlSession) {
-        char *reqErrorBuf = (char*) malloc(sizeof (char)*CURL_ERROR_BUFFER);
-        memset(reqErrorBuf, 0, sizeof (char)*CURL_ERROR_BUFFER);
+        /* clear the options of last request, live connections and DNS cache are kept */
+        curl_easy_reset(curlSession);
+        curlError[0] = 0;
+        tmpChunk->size = 0; /* memory of last response is reused */
+
+        /* the form carries this request's values, it is rebuilt every time */
+        curl_mime *form = curl_mime_init(curlSession);
+        curl_mimepart *part;
+
+        for (multimap<string, string>::const_iterator iter = params.begin(); iter != params.end(); iter++) {
+            part = curl_mime_addpart(form);
+            curl_mime_name(part, iter->first.data());
+            curl_mime_data(part, iter->second.data(), CURL_ZERO_TERMINATED);
+        }
+
+        for (multimap<string, string>::const_iterator iter = files.begin(); iter != files.end(); iter++) {
+            string filePath(path, path + strlen(path));
+            filePath.append(iter->second.data());
+            //cout << iter->first.data() << ":" << filePath.data() << endl;
+            part = curl_mime_addpart(form);
+            curl_mime_name(part, iter->first.data());
+            curl_mime_filedata(part, filePath.data());
+        }
 
 #ifdef DEBUG
         curl_easy_setopt(curlSession, CURLOPT_VERBOSE, 1);
         char *encodeParm = curl_easy_escape(curlSession, conStr.data(), conStr.length());
-        char *fullUrl = (char*) malloc(sizeof (char)*URL_MAX_LENGTH);
-        memset(fullUrl, 0, sizeof (char)*URL_MAX_LENGTH);
-        sprintf(fullUrl, "%s?rqp=%s", url, encodeParm);
+        string fullUrl = url;
+        fullUrl.append("?rqp=");
+        fullUrl.append(encodeParm);
         cout << "fullUrl: " << fullUrl << endl;
         curl_free(encodeParm);
+        curl_easy_setopt(curlSession, CURLOPT_URL, fullUrl.c_str());
 #else
-        char *fullUrl = (char*) malloc(sizeof (char)*URL_MAX_LENGTH);
-        memset(fullUrl, 0, sizeof (char)*URL_MAX_LENGTH);
-        sprintf(fullUrl, "%s", url);
+        /* what URL that receives this POST */
+        curl_easy_setopt(curlSession, CURLOPT_URL, url);
 #endif
 
-        /* what URL that receives this POST */
-        curl_easy_setopt(curlSession, CURLOPT_URL, fullUrl);
+        curl_easy_setopt(curlSession, CURLOPT_MIMEPOST, form);
+        if (!files.empty()) {
+            /* read files in large blocks instead of the 64KB default */
+            curl_easy_setopt(curlSession, CURLOPT_UPLOAD_BUFFERSIZE, (long) UPLOAD_BUFFER_SIZE);
+            /* a large file may outlast HTTP_TIMEOUT on a slow link, only abort a stalled upload */
+            curl_easy_setopt(curlSession, CURLOPT_LOW_SPEED_LIMIT, (long) HTTP_LOW_SPEED_LIMIT);
+            curl_easy_setopt(curlSession, CURLOPT_LOW_SPEED_TIME, (long) HTTP_TIMEOUT);
+        } else {
+            curl_easy_setopt(curlSession, CURLOPT_TIMEOUT, (long) HTTP_TIMEOUT);
+        }
 
-        /* send all data to this function  */
-        curl_easy_setopt(curlSession, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+        rstCode = performRequest(statusstr);
 
-        /* we pass our 'chunk' struct to the callback function */
-        curl_easy_setopt(curlSession, CURLOPT_WRITEDATA, (void *) tmpChunk);
+        curl_mime_free(form);
+    } else {
+        rstCode = GWAC_SEND_DATA_ERROR;
+        sprintf(statusstr, "File %s line %d, Error Code: %d\n"
+                "In uploadDatas, the input parameter objvec is empty!\n",
+                __FILE__, __LINE__, GWAC_SEND_DATA_ERROR);
+    }
 
-        curl_easy_setopt(curlSession, CURLOPT_ERRORBUFFER, (void *) reqErrorBuf);
+    return rstCode;
+}
 
-        if (false) {
-            curl_easy_setopt(curlSession, CURLOPT_HTTPHEADER, headerlist);
-        }
-        curl_easy_setopt(curlSession, CURLOPT_HTTPPOST, formpost);
+int DataTransfer::uploadBulk(const char action[], const char contentType[], const char *body, size_t size,
+        char statusstr[]) {
 
-        /* Perform the request, curlCode will get the return code */
-        curlCode = curl_easy_perform(curlSession);
+    int rstCode;
 
-        /* curl执行出错 */
-        if (curlCode != CURLE_OK) {
-            rstCode = GWAC_SEND_DATA_ERROR;
-            sprintf(statusstr, "File %s line %d, Error Code: %d\n"
-                    "curl_easy_perform() failed: %s\n",
-                    __FILE__, __LINE__, GWAC_SEND_DATA_ERROR,
-                    curl_easy_strerror(curlCode));
-        } else {
-            long http_code = 0;
-            CURLcode curlCode2 = curl_easy_getinfo(curlSession, CURLINFO_RESPONSE_CODE, &http_code);
-            /**curl执行正确，且http服务器正确执行，并正常返回*/
-            //      if (http_code == 200 && curlCode != CURLE_ABORTED_BY_CALLBACK) {
-            if (http_code == 200 && curlCode2 == CURLE_OK) {
-                rstCode = GWAC_SUCCESS;
-                sprintf(statusstr, "%s\n", tmpChunk->memory);
-            } else {
-                /**curl执行正确，且http服务器执行异常，并返回错误*/
-                rstCode = GWAC_SEND_DATA_ERROR;
-                sprintf(statusstr, "File %s line %d, Error Code of http: %ld\n"
-                        "curl_easy_perform() error: %s, server response: %s\n",
-                        __FILE__, __LINE__, http_code, curl_easy_strerror(curlCode), reqErrorBuf);
-            }
-        }
+    CHECK_STATUS_STR_IS_NULL(statusstr);
+    CHECK_STRING_NULL_OR_EMPTY(action, "action");
+    if (body == NULL || size == 0) {
+        sprintf(statusstr, "File %s line %d, Error Code: %d\n"
+                "the input parameter body is empty!\n",
+                __FILE__, __LINE__, GWAC_FUNCTION_INPUT_EMPTY);
+        return GWAC_FUNCTION_INPUT_EMPTY;
+    }
 
-        free(fullUrl);
-        free(reqErrorBuf);
+    if (curlSession == NULL) {
+        curlSession = curl_easy_init();
+    }
+    if (curlSession == NULL) {
+        sprintf(statusstr, "File %s line %d, Error Code: %d\n"
+                "curl_easy_init() failed!\n",
+                __FILE__, __LINE__, GWAC_SEND_DATA_ERROR);
+        return GWAC_SEND_DATA_ERROR;
+    }
 
-        /* always cleanup */
-        curl_easy_cleanup(curlSession);
+    curl_easy_reset(curlSession);
+    curlError[0] = 0;
+    tmpChunk->size = 0;
 
-        /* then cleanup the formpost chain */
-        curl_formfree(formpost);
-        /* free slist */
-        curl_slist_free_all(headerlist);
+    string url = rootUrl + action;
+    string type = "Content-Type: ";
+    type.append(contentType);
+    struct curl_slist *headerlist = curl_slist_append(NULL, type.c_str());
+    /* a bulk body is usually larger than 1KB, skip the 100-continue round trip */
+    headerlist = curl_slist_append(headerlist, "Expect:");
 
+    curl_easy_setopt(curlSession, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curlSession, CURLOPT_HTTPHEADER, headerlist);
+    curl_easy_setopt(curlSession, CURLOPT_POSTFIELDS, body);
+    curl_easy_setopt(curlSession, CURLOPT_POSTFIELDSIZE, (long) size);
+    curl_easy_setopt(curlSession, CURLOPT_TIMEOUT, (long) HTTP_TIMEOUT);
 
-        free(tmpChunk->memory);
+    rstCode = performRequest(statusstr);
 
-        /* we're done with libcurl, so clean it up */
-        curl_global_cleanup();
-    } else {
+    curl_slist_free_all(headerlist);
+    return rstCode;
+}
+
+/**
+ * 执行已设置网址与请求体的curlSession, 解析应答
+ * @param statusstr 函数返回状态字符串
+ * @return 成功返回GWAC_SUCCESS
+ */
+int DataTransfer::performRequest(char statusstr[]) {
+    int rstCode;
+    CURLcode curlCode;
+
+    /* send all data to this function  */
+    curl_easy_setopt(curlSession, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+
+    /* we pass our 'chunk' struct to the callback function */
+    curl_easy_setopt(curlSession, CURLOPT_WRITEDATA, (void *) tmpChunk);
+
+    curl_easy_setopt(curlSession, CURLOPT_ERRORBUFFER, curlError);
+
+    /* keep the connection alive between samples, and never hang the caller.
+     * the caller sets the request timeout: a whole request limit, or a low speed limit for files */
+    curl_easy_setopt(curlSession, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curlSession, CURLOPT_CONNECTTIMEOUT, (long) HTTP_CONNECT_TIMEOUT);
+    curl_easy_setopt(curlSession, CURLOPT_NOSIGNAL, 1L);
+
+    /* Perform the request, curlCode will get the return code */
+    curlCode = curl_easy_perform(curlSession);
+
+    /* curl执行出错 */
+    if (curlCode != CURLE_OK) {
         rstCode = GWAC_SEND_DATA_ERROR;
         sprintf(statusstr, "File %s line %d, Error Code: %d\n"
-                "In uploadDatas, the input parameter objvec is empty!\n",
-                __FILE__, __LINE__, GWAC_SEND_DATA_ERROR);
+                "curl_easy_perform() failed: %s\n",
+                __FILE__, __LINE__, GWAC_SEND_DATA_ERROR,
+                curl_easy_strerror(curlCode));
+    } else {
+        long http_code = 0;
+        CURLcode curlCode2 = curl_easy_getinfo(curlSession, CURLINFO_RESPONSE_CODE, &http_code);
+        /**curl执行正确，且http服务器正确执行，并正常返回*/
+        //      if (http_code == 200 && curlCode != CURLE_ABORTED_BY_CALLBACK) {
+        if (http_code == 200 && curlCode2 == CURLE_OK) {
+            rstCode = GWAC_SUCCESS;
+            sprintf(statusstr, "%.512s\n", tmpChunk->size ? tmpChunk->memory : "");
+        } else {
+            /**curl执行正确，且http服务器执行异常，并返回错误*/
+            rstCode = GWAC_SEND_DATA_ERROR;
+            sprintf(statusstr, "File %s line %d, Error Code of http: %ld\n"
+                    "curl_easy_perform() error: %s, server response: %s\n",
+                    __FILE__, __LINE__, http_code, curl_easy_strerror(curlCode), curlError);
+        }
     }
 
     return rstCode;
 }
 
+static void curlGlobalInit() {
+    curl_global_init(CURL_GLOBAL_ALL);
+}
+
+void curlGlobalInitOnce() {
+    pthread_once(&curlOnce, curlGlobalInit);
+}
+
 static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp) {
     size_t realsize = size * nmemb;
     struct CurlCache *mem = (struct CurlCache *) userp;
 
-    mem->memory = (char*) realloc(mem->memory, mem->size + realsize + 1);
-    if (mem->memory == NULL) {
-        /* out of memory! */
-        printf("not enough memory (realloc returned NULL)\n");
-        return 0;
+    /* grow geometrically, the buffer is reused by following requests */
+    if (mem->size + realsize + 1 > mem->capacity) {
+        size_t capacity = mem->capacity ? mem->capacity : 1024;
+        while (capacity < mem->size + realsize + 1) {
+            capacity *= 2;
+        }
+        char *memory = (char*) realloc(mem->memory, capacity);
+        if (memory == NULL) {
+            /* out of memory! */
+            printf("not enough memory (realloc returned NULL)\n");
+            return 0;
+        }
+        mem->memory = memory;
+        mem->capacity = capacity;
     }
 
     memcpy(&(mem->memory[mem->size]), contents, realsize);
@@ -11,6 +11,7 @@
 #include <map> 
 #include <string> 
 #include <vector>
+#include <curl/curl.h>
 #include "AllHeader.h"
 
 using namespace std;
@@ -19,6 +20,10 @@ using namespace std;
 
 #define URL_MAX_LENGTH 10240
 #define CURL_ERROR_BUFFER 10240
+#define HTTP_CONNECT_TIMEOUT 5  //connect timeout, in seconds
+#define HTTP_TIMEOUT 30         //whole request timeout, in seconds
+#define HTTP_LOW_SPEED_LIMIT 1024 //file uploads fail below this rate for HTTP_TIMEOUT seconds, in bytes/s
+#define UPLOAD_BUFFER_SIZE (512 * 1024) //send buffer of file uploads, in bytes
 #define ROOT_URL "http://127.0.0.1/"
 
 #define SEND_OT1_LIST_URL "commonFileUpload.action"
@@ -54,8 +59,14 @@ curl http://10.36.1.77:8080/gwebend/uploadVacuum.action  -F groupId=001 -F unitI
 struct CurlCache {
   char *memory;
   size_t size;
+  size_t capacity; //allocated bytes, memory is kept between requests
 };
 
+/**
+ * 每个对象持有一个长期有效的curl句柄, 在请求之间保持HTTP连接(keep-alive)与DNS缓存.
+ * curl_global_init()在进程内只执行一次.
+ * 同一对象不可在多个线程中同时使用, 多线程上传时每个线程创建各自的对象.
+ */
 class DataTransfer {
 public:
 
@@ -239,16 +250,37 @@ public:
    * @param statusstr 函数返回状态字符串
    * @return 函数返回状态值
    */
-  int uploadDatas(const char url[], const char path[], multimap<string, string> params, multimap<string, string> files, char statusstr[]);
+  int uploadDatas(const char url[], const char path[], const multimap<string, string> &params,
+          const multimap<string, string> &files, char statusstr[]);
   int sendParameters(const char url[], multimap<string, string> params, char statusstr[]);
   int sendFiles(const char url[], const char path[], multimap<string, string> files, char statusstr[]);
+  /**
+   * 批量上传: 多条数据组成一个请求体, 以一次POST上传
+   * @param action 服务器动作, 与rootUrl组成完整网址
+   * @param contentType 请求体类型，如application/x-ndjson
+   * @param body 请求体
+   * @param size 请求体字节数
+   * @param statusstr 函数返回状态字符串
+   * @return 成功返回GWAC_SUCCESS
+   */
+  int uploadBulk(const char action[], const char contentType[], const char *body, size_t size,
+          char statusstr[]);
 
 private:
   struct CurlCache *tmpChunk;
+  CURL *curlSession; //reused by all requests of this object
+  char curlError[CURL_ERROR_SIZE];
   int initGwacMem(char *path);
   void initParameter();
+  int performRequest(char statusstr[]);
 
 };
 
+/**
+ * 在进程内执行一次curl_global_init(), 可在任意线程中重复调用.
+ * 直接使用curl接口的模块(如AsyncTransfer)在创建curl句柄前调用.
+ */
+void curlGlobalInitOnce();
+
 #endif	/* DataTransfer_H */
 
@@ -0,0 +1,252 @@
+/**
+ * @file DataUploader.cpp 异步上传监测数据至数据库的接口定义文件
+ * @date 2026-10-16
+ * @version 0.1
+ */
+
+#include <string.h>
+#include <boost/make_shared.hpp>
+#include <boost/bind.hpp>
+#include "DataUploader.h"
+#include "UploadSpool.h"
+#include "UploadAdapter.h"
+#include "GLog.h"
+
+#define BACKOFF_MAX		60		//< 最长重试周期, 量纲: 秒
+
+UploaderPtr make_uploader(const string& url, int capacity) {
+	UploaderPtr uploader = boost::make_shared<DataUploader>(url, capacity);
+	uploader->Start();
+	return uploader;
+}
+
+UploaderPtr make_uploader(const string& url, const UploadOption& opt) {
+	UploaderPtr uploader = boost::make_shared<DataUploader>(url, opt.capacity);
+	uploader->EnableBatch(opt.bulk, opt.batch, opt.latency);
+	if (!opt.spool.empty()) uploader->EnableSpool(opt.spool, opt.budget, opt.replay);
+	uploader->Start();
+	return uploader;
+}
+
+DataUploader::DataUploader(const string& url, int capacity) {
+	url_ = url;
+	queue_.set_capacity(capacity > 0 ? capacity : UPLOAD_CAPACITY);
+	batch_      = UPLOAD_BATCH;
+	latency_    = boost::chrono::milliseconds(0);
+	adapter_    = make_adapter("");
+	replayRate_ = REPLAY_RATE;
+	backoff_    = 0;
+	headFail_   = 0;
+	liveOk_     = false;
+}
+
+DataUploader::~DataUploader() {
+	Stop();
+}
+
+bool DataUploader::EnableSpool(const string& dir, int budget, int rate) {
+	if (thrd_.unique()) return false;
+	SpoolPtr spool = boost::make_shared<UploadSpool>(dir, budget > 0 ? budget : SPOOL_BUDGET);
+	if (!spool->Open()) {
+		_gLog.Write(LOG_WARN, NULL, "failed to access upload spool<%s>", dir.c_str());
+		return false;
+	}
+	if (spool->GetPending()) _gLog.Write("%d samples in upload spool to replay", spool->GetPending());
+	spool_ = spool;
+	replayRate_ = rate > 0 ? rate : REPLAY_RATE;
+	mutex_lock lck(mtx_);
+	stat_.spool = spool_->GetPending();
+	return true;
+}
+
+void DataUploader::EnableBatch(const string& bulk, int batch, double latency) {
+	if (thrd_.unique()) return;
+	adapter_ = make_adapter(bulk);
+	batch_   = batch > 0 ? batch : UPLOAD_BATCH;
+	latency_ = boost::chrono::milliseconds(latency > 0.0 ? int(latency * 1000.0) : 0);
+}
+
+void DataUploader::Start() {
+	if (!thrd_.unique()) thrd_.reset(new boost::thread(boost::bind(&DataUploader::thread_upload, this)));
+}
+
+/*
+ * @note 正在执行的HTTP请求不可中断, 等待其完成
+ */
+void DataUploader::Stop() {
+	if (thrd_.unique()) {
+		thrd_->interrupt();
+		thrd_->join();
+		thrd_.reset();
+	}
+}
+
+bool DataUploader::Push(const UploadSample& sample) {
+	bool full;
+	{
+		mutex_lock lck(mtx_);
+		if (queue_.empty()) flushAt_ = steady_clock::now() + latency_;
+		if ((full = queue_.full())) ++stat_.dropped;
+		queue_.push_back(sample); // 队列已满时覆盖最早的数据
+		++stat_.queued;
+	}
+	cvpush_.notify_one();
+	return !full;
+}
+
+DataUploader::UploadStat DataUploader::GetStat() {
+	mutex_lock lck(mtx_);
+	stat_.pending = queue_.size();
+	return stat_;
+}
+
+/*
+ * @note
+ * 未启用磁盘缓存时, 退避期间数据留在队列中;
+ * 启用磁盘缓存时, 退避期间取出的数据直接写入磁盘, 退避结束后由实时数据或回放数据探测服务器
+ */
+void DataUploader::thread_upload() {
+	DataTransfer db(url_.c_str());
+	SampleVec batch;
+	char status[CURL_ERROR_BUFFER];
+	int n, i;
+
+	batch.reserve(batch_);
+	retryAt_ = replayAt_ = steady_clock::now();
+	while (1) {
+		{// 等待数据, 或等待重试、回放时刻
+			mutex_lock lck(mtx_);
+			while (1) {
+				steady_clock::time_point now = steady_clock::now(), wake = steady_clock::time_point::max();
+				bool hold = offline();
+				if (hold) wake = retryAt_;
+				if (!queue_.empty() && !(hold && !spool_.use_count())) {
+					if (hold || flush_due(now)) break;
+					wake = flushAt_;
+				}
+				if (!hold && spool_.use_count() && spool_->GetPending()) {
+					if (now >= replayAt_) break;
+					if (replayAt_ < wake) wake = replayAt_;
+				}
+				if (wake == steady_clock::time_point::max()) cvpush_.wait(lck);
+				else cvpush_.wait_until(lck, wake);
+			}
+			for (n = 0; n < batch_ && !queue_.empty(); ++n) {
+				batch.push_back(queue_.front());
+				queue_.pop_front();
+			}
+		}
+
+		if (n && offline()) spool(batch, 0); // 服务器不可用: 写入磁盘缓存
+		else if (n) {
+			status[0] = 0;
+			i = adapter_->Upload(db, &batch[0], n, status);
+			{
+				mutex_lock lck(mtx_);
+				stat_.sent += i;
+			}
+			if ((liveOk_ = i == n)) on_success();
+			else if (spool_.use_count()) {// 上传失败: 未完成数据写入磁盘缓存
+				on_failure(status);
+				spool(batch, i);
+			}
+			else {// 上传失败: 保留未完成数据, 退避后重试
+				bool giveup = ++batch[i].retry >= UPLOAD_RETRY;
+				{
+					mutex_lock lck(mtx_);
+					if (giveup) ++stat_.failed;
+					else ++stat_.retry;
+				}
+				on_failure(status);
+				requeue(batch, giveup ? i + 1 : i);
+			}
+		}
+		batch.clear();
+
+		if (spool_.use_count() && spool_->GetPending() && !offline() && steady_clock::now() >= replayAt_)
+			replay(db, batch, status);
+	}
+}
+
+void DataUploader::requeue(SampleVec& batch, int from) {
+	mutex_lock lck(mtx_);
+	for (int i = batch.size() - 1; i >= from; --i) {
+		if (queue_.full()) ++stat_.dropped; // 队列已被新数据填满, 丢弃较早的数据
+		else queue_.push_front(batch[i]);
+	}
+}
+
+void DataUploader::spool(SampleVec& batch, int from) {
+	uint64_t dropped = spool_->GetDropped();
+	int n = batch.size(), i;
+	for (i = from; i < n && spool_->Append(batch[i]); ++i);
+	spool_->Flush();
+
+	mutex_lock lck(mtx_);
+	stat_.spooled += i - from;
+	stat_.dropped += n - i + spool_->GetDropped() - dropped;	// 无法创建段文件或超出磁盘预算
+	stat_.spool    = spool_->GetPending();
+}
+
+/*
+ * @note
+ * 服务器失效时实时数据与回放数据均上传失败, 不计入单条数据的拒绝次数
+ */
+void DataUploader::replay(DataTransfer& db, SampleVec& batch, char* status) {
+	uint64_t dropped = spool_->GetDropped();
+	int n = spool_->Peek(batch, replayRate_ < batch_ ? replayRate_ : batch_), i;
+	bool giveup(false);
+
+	status[0] = 0;
+	i = adapter_->Upload(db, &batch[0], n, status);
+	if (i) headFail_ = 0;
+	if (i < n && (i || liveOk_) && ++headFail_ >= UPLOAD_RETRY) {
+		giveup = true;
+		headFail_ = 0;
+	}
+	spool_->Consume(giveup ? i + 1 : i);
+	spool_->Flush();
+	batch.clear();
+	// 限制回放速率
+	replayAt_ = steady_clock::now() + boost::chrono::milliseconds(1000 * (i ? i : 1) / replayRate_);
+
+	{
+		mutex_lock lck(mtx_);
+		stat_.replayed += i;
+		if (giveup) ++stat_.failed;
+		stat_.dropped += spool_->GetDropped() - dropped;
+		stat_.spool    = spool_->GetPending();
+	}
+	if (i == n) on_success();
+	else on_failure(status);
+}
+
+void DataUploader::on_success() {
+	if (backoff_) {
+		if (spool_.use_count() && spool_->GetPending())
+			_gLog.Write("database upload recovered, %d samples in spool to replay", spool_->GetPending());
+		else _gLog.Write("database upload recovered");
+	}
+	backoff_ = 0;
+}
+
+void DataUploader::on_failure(char* status) {
+	if (!backoff_) {// 仅记录首次失败, 避免服务器失效期间日志膨胀
+		char *eol = strchr(status, '\n');
+		if (eol) *eol = 0;
+		_gLog.Write(LOG_WARN, NULL, "database upload failed: %s", status);
+	}
+	backoff_ = backoff_ ? (backoff_ * 2 > BACKOFF_MAX ? BACKOFF_MAX : backoff_ * 2) : 1;
+	retryAt_ = steady_clock::now() + boost::chrono::seconds(backoff_);
+}
+
+/*
+ * @note 在持有mtx_时调用
+ */
+bool DataUploader::flush_due(steady_clock::time_point now) {
+	return int(queue_.size()) >= batch_ || now >= flushAt_;
+}
+
+bool DataUploader::offline() {
+	return backoff_ && steady_clock::now() < retryAt_;
+}
@@ -0,0 +1,249 @@
+/**
+ * @file DataUploader.h 异步上传监测数据至数据库的接口声明文件
+ * @date 2026-10-16
+ * @version 0.1
+ * @note
+ * - 串口状态机将监测数据压入有界队列后立即返回, 不等待HTTP应答
+ * - 独立线程批量取出队列中的数据, 通过DataTransfer逐条上传
+ * - 上传失败时, 未完成的数据保留在队首, 以指数退避周期(1至60秒)重试. 单条数据最多上传UPLOAD_RETRY次
+ * - 队列已满时丢弃最早的数据
+ * - 多个串口控制器共用一个上传接口
+ * @version 0.2
+ * @note
+ * - 启用磁盘缓存(UploadSpool)时, 上传失败及退避期间的数据写入磁盘, 不再丢弃
+ * - 服务器恢复后, 磁盘缓存以不超过回放速率的节奏与实时数据交替上传
+ * - 服务器可接收其它数据、但持续拒绝的缓存数据, 上传UPLOAD_RETRY次后放弃
+ * @version 0.3
+ * @note
+ * - 上传方式由UploadAdapter实现: 逐条上传, 或多条数据组成一个批量请求
+ * - 队列中的数据达到批量数量, 或最早的数据等待超过时延上限时取出上传
+ * - 通过UploadOption配置队列、批量与磁盘缓存参数
+ */
+
+#ifndef DATAUPLOADER_H_
+#define DATAUPLOADER_H_
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include <boost/circular_buffer.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread.hpp>
+#include "DataTransfer.h"
+
+class UploadSpool;
+class UploadAdapter;
+
+#define UPLOAD_CAPACITY		1024	//< 缺省队列容量
+#define UPLOAD_BATCH		32		//< 单次从队列中取出的最大数据数量
+#define UPLOAD_RETRY		3		//< 单条数据的最大上传次数
+#define SPOOL_BUDGET		64		//< 缺省磁盘缓存预算, 量纲: MB
+#define REPLAY_RATE			20		//< 缺省磁盘缓存回放速率, 量纲: 条/秒
+#define UPLOAD_LATENCY		1.0		//< 缺省批量上传时延上限, 量纲: 秒
+
+enum UPLOAD_TYPE {// 监测数据类型
+	UPLOAD_TEMPERATURE,	//< 温控
+	UPLOAD_VACUUM		//< 真空度
+};
+
+struct UploadSample {// 单台设备的一条监测数据
+	int type;			//< 数据类型, UPLOAD_TYPE
+	char gid[8];		//< 组编号
+	char uid[8];		//< 单元编号
+	char cid[8];		//< 相机编号
+	char utc[24];		//< 时间标签. 格式: YYYY-MM-DDThh:mm:ss
+	float voltage;		//< 工作电压
+	float current;		//< 工作电流
+	float thot;			//< 热端温度
+	float coolget;		//< 探测器温度
+	float coolset;		//< 制冷温度
+	float pressure;		//< 气压
+	int retry;			//< 已上传失败次数
+
+public:
+	UploadSample() {
+		memset(this, 0, sizeof(UploadSample));
+	}
+};
+
+struct UploadOption {// 上传接口配置参数
+	int capacity;		//< 队列容量
+	int batch;			//< 单次上传的最大数据数量
+	double latency;		//< 数据在队列中等待凑批的最长时间, 量纲: 秒. <=0: 立即上传
+	string bulk;		//< 服务器批量上传动作. 空: 逐条上传
+	string spool;		//< 磁盘缓存目录. 空: 不缓存
+	int budget;			//< 磁盘预算, 量纲: MB
+	int replay;			//< 回放速率, 量纲: 条/秒
+
+public:
+	UploadOption() {
+		capacity = UPLOAD_CAPACITY;
+		batch    = UPLOAD_BATCH;
+		latency  = UPLOAD_LATENCY;
+		budget   = SPOOL_BUDGET;
+		replay   = REPLAY_RATE;
+	}
+};
+
+class DataUploader : private boost::noncopyable {
+public:
+	/*!
+	 * @brief 构造函数
+	 * @param url      数据库访问地址
+	 * @param capacity 队列容量
+	 */
+	DataUploader(const string& url, int capacity = UPLOAD_CAPACITY);
+	virtual ~DataUploader();
+
+public:
+	/* 数据类型 */
+	struct UploadStat {// 上传统计信息
+		uint64_t queued;	//< 进入队列的数据数量
+		uint64_t sent;		//< 上传成功的数据数量
+		uint64_t retry;		//< 重试次数
+		uint64_t failed;	//< 达到最大上传次数后放弃的数据数量
+		uint64_t dropped;	//< 因队列已满或超出磁盘预算丢弃的数据数量
+		uint64_t spooled;	//< 写入磁盘缓存的数据数量
+		uint64_t replayed;	//< 从磁盘缓存回放成功的数据数量
+		int pending;		//< 队列中等待上传的数据数量
+		int spool;			//< 磁盘缓存中等待回放的数据数量
+
+	public:
+		UploadStat() {
+			queued = sent = retry = failed = dropped = spooled = replayed = 0;
+			pending = spool = 0;
+		}
+	};
+
+protected:
+	typedef boost::unique_lock<boost::mutex> mutex_lock;	//< 互斥锁
+	typedef boost::shared_ptr<boost::thread> threadptr;	//< 线程指针
+	typedef boost::circular_buffer<UploadSample> SampleQueue;	//< 数据队列
+	typedef std::vector<UploadSample> SampleVec;	//< 数据集合
+	typedef boost::shared_ptr<UploadSpool> SpoolPtr;	//< 磁盘缓存指针
+	typedef boost::shared_ptr<UploadAdapter> AdapterPtr;	//< 上传方式指针
+	typedef boost::chrono::steady_clock steady_clock;	//< 单调时钟
+
+protected:
+	/* 成员变量 */
+	string url_;			//< 数据库访问地址
+	SampleQueue queue_;		//< 待上传数据
+	UploadStat stat_;		//< 统计信息
+	boost::mutex mtx_;		//< 互斥锁: 队列与统计信息
+	boost::condition_variable cvpush_;	//< 条件变量: 数据进入队列
+	threadptr thrd_;		//< 上传线程
+	int batch_;				//< 单次上传的最大数据数量
+	boost::chrono::milliseconds latency_;	//< 批量上传时延上限
+	steady_clock::time_point flushAt_;	//< 队列中最早数据的上传时限
+	/* 由上传线程访问 */
+	AdapterPtr adapter_;	//< 上传方式
+	SpoolPtr spool_;		//< 磁盘缓存
+	int replayRate_;		//< 回放速率, 量纲: 条/秒
+	int backoff_;			//< 重试周期, 量纲: 秒. 0: 服务器可用
+	steady_clock::time_point retryAt_;	//< 重试时刻
+	steady_clock::time_point replayAt_;	//< 下次回放时刻
+	int headFail_;			//< 磁盘缓存首条数据被拒绝次数
+	bool liveOk_;			//< 最近一批实时数据上传成功
+
+public:
+	/*!
+	 * @brief 启用磁盘缓存. 在Start()之前调用
+	 * @param dir    缓存目录
+	 * @param budget 磁盘预算, 量纲: MB
+	 * @param rate   回放速率, 量纲: 条/秒
+	 * @return
+	 * 目录不可访问时返回false, 上传失败的数据仅在内存中重试
+	 */
+	bool EnableSpool(const string& dir, int budget = SPOOL_BUDGET, int rate = REPLAY_RATE);
+	/*!
+	 * @brief 设置批量上传方式. 在Start()之前调用
+	 * @param bulk    服务器批量上传动作. 空: 逐条上传
+	 * @param batch   单次上传的最大数据数量
+	 * @param latency 数据在队列中等待凑批的最长时间, 量纲: 秒
+	 */
+	void EnableBatch(const string& bulk, int batch = UPLOAD_BATCH, double latency = UPLOAD_LATENCY);
+	/*!
+	 * @brief 启动上传线程
+	 */
+	void Start();
+	/*!
+	 * @brief 停止上传线程. 丢弃队列中尚未上传的数据
+	 */
+	void Stop();
+	/*!
+	 * @brief 将一条数据压入队列
+	 * @param sample 监测数据
+	 * @return
+	 * 队列已满、丢弃最早的数据时返回false
+	 * @note
+	 * 不阻塞, 可在串口strand中调用
+	 */
+	bool Push(const UploadSample& sample);
+	/*!
+	 * @brief 查看统计信息
+	 * @return
+	 * 统计信息
+	 */
+	UploadStat GetStat();
+
+protected:
+	/*!
+	 * @brief 线程: 批量取出并上传数据
+	 */
+	void thread_upload();
+	/*!
+	 * @brief 队列中的数据是否应取出上传
+	 */
+	bool flush_due(steady_clock::time_point now);
+	/*!
+	 * @brief 将未完成的数据放回队首
+	 * @param batch 已取出的数据
+	 * @param from  第一条未完成数据在batch中的索引
+	 */
+	void requeue(SampleVec& batch, int from);
+	/*!
+	 * @brief 将未完成的数据写入磁盘缓存
+	 * @param batch 已取出的数据
+	 * @param from  第一条未完成数据在batch中的索引
+	 */
+	void spool(SampleVec& batch, int from);
+	/*!
+	 * @brief 回放一批磁盘缓存数据
+	 * @param db     数据库访问接口
+	 * @param batch  数据存储区
+	 * @param status 错误信息
+	 */
+	void replay(DataTransfer& db, SampleVec& batch, char* status);
+	/*!
+	 * @brief 上传成功, 结束退避
+	 */
+	void on_success();
+	/*!
+	 * @brief 上传失败, 延长退避周期
+	 * @param status 错误信息
+	 */
+	void on_failure(char* status);
+	/*!
+	 * @brief 服务器是否处于退避周期内
+	 */
+	bool offline();
+};
+typedef boost::shared_ptr<DataUploader> UploaderPtr;
+/*!
+ * @brief 工厂函数, 创建上传接口并启动上传线程
+ * @param url      数据库访问地址
+ * @param capacity 队列容量
+ * @return
+ * 上传接口指针
+ */
+extern UploaderPtr make_uploader(const string& url, int capacity = UPLOAD_CAPACITY);
+/*!
+ * @brief 工厂函数, 按配置参数创建上传接口并启动上传线程
+ * @param url 数据库访问地址
+ * @param opt 配置参数
+ * @return
+ * 上传接口指针
+ */
+extern UploaderPtr make_uploader(const string& url, const UploadOption& opt);
+
+#endif /* DATAUPLOADER_H_ */
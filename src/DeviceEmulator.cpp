@@ -0,0 +1,337 @@
+/**
+ * @file DeviceEmulator.cpp 温控器与真空计仿真器定义文件
+ * @date 2026-10-16
+ * @version 0.2
+ */
+
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <boost/make_shared.hpp>
+#include <boost/bind.hpp>
+#include "DeviceEmulator.h"
+#include "CoolerCtl.h"
+#include "VacuumCtl.h"
+#include "AMath.h"
+
+using namespace AstroUtil;
+using namespace boost::posix_time;
+
+#define RAMP_RATE	0.5		//< 探测器温度变化速率, 量纲: 摄氏度/秒
+
+//////////////////////////////////////////////////////////////////////////////
+/*!
+ * @brief 将两个十六进制字符解码为一个字节
+ */
+static uint8_t hex2uint8(char b1, char b2) {
+	uint8_t t1 = b1 >= 'A' ? b1 - 0x37 : b1 - 0x30;
+	uint8_t t2 = b2 >= 'A' ? b2 - 0x37 : b2 - 0x30;
+	return uint8_t((t1 << 4) + t2);
+}
+
+EmulatorPtr make_emulator(const EmulatorParam& param) {
+	return boost::make_shared<DeviceEmulator>(param);
+}
+
+DeviceEmulator::DeviceEmulator(const EmulatorParam& param) {
+	param_ = param;
+	if (param_.type != EMU_COOLER_RTU) param_.bad = 0.0; // 控制接口不校验, 错误校验码应答无从检出
+	fdm_ = fds_ = -1;
+	nrcv_ = 0;
+	seed_ = (unsigned int) time(NULL);
+
+	ptime now = microsec_clock::universal_time();
+	for (int i = 1; i <= param_.ndev; ++i) {
+		SimDevice dev;
+		dev.idd     = uint8_t(i);
+		dev.vol     = 11.9;
+		dev.cur     = 2.5;
+		dev.thot    = 20.1;
+		dev.coolset = -40.0;
+		dev.coolget = 15.0;
+		dev.pres    = "2.3E-06";
+		dev.tmlast  = now;
+		devs_.push_back(dev);
+	}
+}
+
+DeviceEmulator::~DeviceEmulator() {
+	Stop();
+	if (fds_ >= 0) close(fds_);
+	if (fdm_ >= 0) close(fdm_);
+}
+
+bool DeviceEmulator::Open() {
+	if (fdm_ >= 0) return true;
+
+	char name[64];
+	struct termios tio;
+	if (openpty(&fdm_, &fds_, name, NULL, NULL)) return false;
+	// 关闭回显与换行转换
+	tcgetattr(fds_, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(fds_, TCSANOW, &tio);
+	portname_ = name;
+	seed_ ^= (unsigned int) fdm_ << 16;
+	return true;
+}
+
+bool DeviceEmulator::Start() {
+	if (fdm_ < 0 || stream_.use_count()) return false;
+
+	keep_.reset(new IOServiceKeep);
+	stream_.reset(new stream_descriptor(keep_->get_service(), fdm_));
+	fdm_ = -1; // 由stream_descriptor关闭
+	keep_->get_strand().post(boost::bind(&DeviceEmulator::start_read, shared_from_this()));
+	return true;
+}
+
+void DeviceEmulator::Stop() {
+	if (!stream_.use_count()) return;
+	if (keep_->get_strand().running_in_this_thread()) close_stream(NULL);
+	else {
+		boost::promise<void> done;
+		boost::unique_future<void> future = done.get_future();
+		keep_->get_strand().post(boost::bind(&DeviceEmulator::close_stream, this, &done));
+		future.wait();
+	}
+}
+
+const char* DeviceEmulator::GetPortname() {
+	return portname_.c_str();
+}
+
+EmulatorStat DeviceEmulator::GetStat() {
+	mutex_lock lck(mtxStat_);
+	return stat_;
+}
+
+void DeviceEmulator::close_stream(boost::promise<void>* done) {
+	boost::system::error_code ec;
+	stream_->close(ec);
+	stream_.reset();
+	if (done) done->set_value();
+}
+
+void DeviceEmulator::start_read() {
+	if (!stream_.use_count()) return;
+	stream_->async_read_some(boost::asio::buffer(bufin_, sizeof(bufin_)),
+			keep_->get_strand().wrap(boost::bind(&DeviceEmulator::handle_read, shared_from_this(),
+					boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+}
+
+void DeviceEmulator::handle_read(const boost::system::error_code& ec, size_t n) {
+	if (ec || !stream_.use_count()) return;
+
+	if (nrcv_ + int(n) > int(sizeof(bufrcv_))) nrcv_ = 0; // 长时间无法构成指令, 丢弃
+	memcpy(bufrcv_ + nrcv_, bufin_, n);
+	nrcv_ += n;
+	process_buffer();
+	start_read();
+}
+
+void DeviceEmulator::process_buffer() {
+	char value[32];
+	int first, last, len, i, j;
+	uint8_t idd, idf, chk;
+
+	if (param_.type == EMU_COOLER_RTU) {// 设备编号 + 功能编码 + 数据 + CRC16
+		if (nrcv_ < 4) return;
+		unsigned short crc = CRC16((const uint8_t*) bufrcv_, nrcv_ - 2);
+		if (uint8_t(bufrcv_[nrcv_ - 2]) != (crc & 0xFF) || uint8_t(bufrcv_[nrcv_ - 1]) != (crc >> 8)) {
+			if (nrcv_ >= 36) {// 超出最大指令长度
+				nrcv_ = 0;
+				mutex_lock lck(mtxStat_);
+				++stat_.invalid;
+			}
+			return;
+		}
+		if ((len = nrcv_ - 4) >= int(sizeof(value))) len = 0;
+		else if (len > 0) memcpy(value, bufrcv_ + 2, len);
+		nrcv_ = 0;
+		process_request(uint8_t(bufrcv_[0]), uint8_t(bufrcv_[1]), value, len);
+		return;
+	}
+
+	bool cooler = param_.type == EMU_COOLER_ASCII;
+	char head = cooler ? ':' : '~';
+	char tail = cooler ? '\n' : '\r';
+	while (nrcv_ > 0) {
+		for (first = 0; first < nrcv_ && bufrcv_[first] != head; ++first);
+		for (last = first; last < nrcv_ && bufrcv_[last] != tail; ++last);
+		if (last == nrcv_) {// 无完整指令
+			if (first) memmove(bufrcv_, bufrcv_ + first, nrcv_ -= first);
+			return;
+		}
+
+		const char *ptr = bufrcv_ + first;
+		bool valid;
+		len = last - first + 1;
+		if (cooler) {// :IIFF[数据]LLCRLF, 校验和包含回车换行
+			if ((valid = len >= 9 && !((len - 9) % 2) && (len - 9) / 2 < int(sizeof(value)))) {
+				chk = LRC((const uint8_t*) ptr, len - 4) - 0x0D - 0x0A;
+				valid = chk == hex2uint8(ptr[len - 4], ptr[len - 3]);
+			}
+			if (valid) {
+				idd = hex2uint8(ptr[1], ptr[2]);
+				idf = hex2uint8(ptr[3], ptr[4]);
+				for (i = 5, j = 0; i < len - 4; i += 2, ++j) value[j] = hex2uint8(ptr[i], ptr[i + 1]);
+			}
+		}
+		else {// ~ II FF CC\r, 校验和为'~'与校验和之间字符的和
+			if ((valid = len == 11)) {
+				chk = Checksum((const uint8_t*) ptr + 1, 7);
+				valid = chk == hex2uint8(ptr[8], ptr[9]);
+			}
+			if (valid) {
+				idd = hex2uint8(ptr[2], ptr[3]);
+				idf = hex2uint8(ptr[5], ptr[6]);
+				j = 0;
+			}
+		}
+
+		if (valid) process_request(idd, idf, value, j);
+		else {
+			mutex_lock lck(mtxStat_);
+			++stat_.invalid;
+		}
+		if ((nrcv_ -= last + 1) > 0) memmove(bufrcv_, bufrcv_ + last + 1, nrcv_);
+	}
+}
+
+void DeviceEmulator::process_request(uint8_t idd, uint8_t idf, const char* value, int n) {
+	SimDevice *dev = find_device(idd);
+	if (!dev) return; // 总线上的其它设备
+
+	char data[32];
+	int len(0);
+	if (param_.type == EMU_VACUUM) {
+		if      (idf == VFID_READ_CUR)  len = sprintf(data, "%.2f", dev->cur);
+		else if (idf == VFID_READ_VOL)  len = sprintf(data, "%.1f", dev->vol);
+		else if (idf == VFID_READ_PRES) len = sprintf(data, "%s", dev->pres.c_str());
+		else len = sprintf(data, "0");
+	}
+	else {
+		if (idf == CFID_READ_T1) {// 探测器温度以固定速率趋近制冷温度
+			ptime now = microsec_clock::universal_time();
+			double step = (now - dev->tmlast).total_microseconds() * 1E-6 * RAMP_RATE;
+			double diff = dev->coolset - dev->coolget;
+			if (fabs(diff) <= step) dev->coolget = dev->coolset;
+			else dev->coolget += diff > 0 ? step : -step;
+			dev->tmlast = now;
+		}
+
+		if      (idf == CFID_READ_CUR)     len = sprintf(data, "%.1f", dev->cur);
+		else if (idf == CFID_READ_VOL)     len = sprintf(data, "%.1f", dev->vol);
+		else if (idf == CFID_READ_T1)      len = sprintf(data, "%.1f", dev->coolget);
+		else if (idf == CFID_READ_T2)      len = sprintf(data, "%.1f", dev->thot);
+		else if (idf == CFID_READ_COOLSET) len = sprintf(data, "%.1f", dev->coolset);
+		else if (idf == CFID_WRITE_COOLSET && n > 0) {
+			char str[32];
+			memcpy(str, value, n);
+			str[n] = 0;
+			dev->coolset = atof(str);
+		}
+	}
+
+	bool drop = param_.drop > 0.0 && uniform() < param_.drop;
+	bool bad  = !drop && param_.bad > 0.0 && uniform() < param_.bad;
+	{
+		mutex_lock lck(mtxStat_);
+		++stat_.request;
+		if (drop) ++stat_.drop;
+		if (bad)  ++stat_.bad;
+	}
+	if (drop) return;
+
+	boost::shared_array<char> reply(new char[80]);
+	int nreply = encode_reply(idd, idf, data, len, bad, reply.get());
+	int delay = param_.latency;
+	if (param_.jitter > 0) delay += int((2.0 * uniform() - 1.0) * param_.jitter);
+	if (delay <= 0) handle_reply(boost::system::error_code(), timerptr(), reply, nreply);
+	else {
+		timerptr timer(new deadline_timer(keep_->get_service()));
+		timer->expires_from_now(millisec(delay));
+		timer->async_wait(keep_->get_strand().wrap(boost::bind(&DeviceEmulator::handle_reply, shared_from_this(),
+				boost::asio::placeholders::error, timer, reply, nreply)));
+	}
+}
+
+int DeviceEmulator::encode_reply(uint8_t idd, uint8_t idf, const char* value, int n, bool bad, char* output) {
+	const char hex[] = "0123456789ABCDEF";
+	int i(-1), j;
+	uint8_t chk;
+
+	if (param_.type == EMU_COOLER_RTU) {// 设备编号 + 功能编码 + 数据 + CRC16
+		unsigned short crc;
+		output[++i] = idd;
+		output[++i] = idf;
+		for (j = 0; j < n; ++j) output[++i] = value[j];
+		crc = CRC16((const uint8_t*) output, i + 1);
+		if (bad) crc ^= 0x5A5A;
+		output[++i] = crc & 0xFF;
+		output[++i] = crc >> 8;
+	}
+	else if (param_.type == EMU_COOLER_ASCII) {// :IIFF[数据]LLCRLF
+		output[++i] = ':';
+		output[++i] = hex[idd >> 4];
+		output[++i] = hex[idd & 0x0F];
+		output[++i] = hex[idf >> 4];
+		output[++i] = hex[idf & 0x0F];
+		for (j = 0; j < n; ++j) {
+			output[++i] = hex[uint8_t(value[j]) >> 4];
+			output[++i] = hex[value[j] & 0x0F];
+		}
+		chk = LRC((const uint8_t*) output, i + 1) - 0x0D - 0x0A;
+		if (bad) chk ^= 0x5A;
+		output[++i] = hex[chk >> 4];
+		output[++i] = hex[chk & 0x0F];
+		output[++i] = 0x0D;
+		output[++i] = 0x0A;
+	}
+	else {// II OK [数据] CC\r, 校验和为校验和之前字符的和
+		output[++i] = hex[idd >> 4];
+		output[++i] = hex[idd & 0x0F];
+		output[++i] = ' ';
+		output[++i] = 'O';
+		output[++i] = 'K';
+		output[++i] = ' ';
+		for (j = 0; j < n; ++j) {
+			output[++i] = hex[uint8_t(value[j]) >> 4];
+			output[++i] = hex[value[j] & 0x0F];
+		}
+		output[++i] = ' ';
+		chk = Checksum((const uint8_t*) output, i + 1);
+		if (bad) chk ^= 0x5A;
+		output[++i] = hex[chk >> 4];
+		output[++i] = hex[chk & 0x0F];
+		output[++i] = 0x0D;
+	}
+
+	return i + 1;
+}
+
+void DeviceEmulator::handle_reply(const boost::system::error_code& ec, timerptr timer,
+		boost::shared_array<char> reply, int n) {
+	if (ec || !stream_.use_count()) return;
+
+	boost::system::error_code ec1;
+	boost::asio::write(*stream_, boost::asio::buffer(reply.get(), n), ec1);
+	if (!ec1) {
+		mutex_lock lck(mtxStat_);
+		++stat_.reply;
+	}
+}
+
+double DeviceEmulator::uniform() {
+	return rand_r(&seed_) / (RAND_MAX + 1.0);
+}
+
+DeviceEmulator::SimDevice* DeviceEmulator::find_device(uint8_t idd) {
+	int n = devs_.size(), i;
+	for (i = 0; i < n && devs_[i].idd != idd; ++i);
+	return i == n ? NULL : &devs_[i];
+}
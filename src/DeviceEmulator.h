@@ -0,0 +1,210 @@
+/**
+ * @file DeviceEmulator.h 温控器与真空计仿真器声明文件
+ * @date 2026-10-16
+ * @version 0.1
+ * @note
+ * - 每个仿真器打开一对伪终端, 从端(/dev/pts/N)供camannex作为串口使用
+ * - 应答CoolerCtl::encode_data与VacuumCtl::encode_data生成的指令: 温控支持modbus ASCII与RTU,
+ *   真空计采用'~'起始、'\r'结束的ASCII协议
+ * - 单一串口可挂接多台设备, 只应答与设备编号匹配的指令
+ * - 可设置应答延时与抖动, 并按比例丢弃应答或生成错误校验码. 控制接口仅在RTU模式下校验应答(CRC16),
+ *   因此仅RTU模式生成错误校验码, 其它模式忽略该比例
+ * - 所有仿真器共用IOServicePool线程池, 单机可仿真数百个串口
+ * @version 0.2
+ * @note
+ * - 读出与延时应答回调持有shared_from_this(), 仿真器在挂起的回调完成后释放. 仅可通过make_emulator()创建
+ */
+
+#ifndef DEVICEEMULATOR_H_
+#define DEVICEEMULATOR_H_
+
+#include <string>
+#include <vector>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/future.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include "IOServiceKeep.h"
+
+using std::string;
+using std::vector;
+
+//////////////////////////////////////////////////////////////////////////////
+enum EMU_DEVICE {// 仿真设备类型
+	EMU_COOLER_ASCII,	//< 温控器, modbus ASCII
+	EMU_COOLER_RTU,		//< 温控器, modbus RTU
+	EMU_VACUUM			//< 真空计
+};
+
+struct EmulatorParam {// 仿真参数
+	int type;			//< 设备类型, EMU_DEVICE
+	int ndev;			//< 串口挂接设备数量. 设备编号从1开始连续编号
+	int latency;		//< 应答延时, 量纲: 毫秒
+	int jitter;			//< 应答延时抖动幅度, 量纲: 毫秒
+	double drop;		//< 丢弃应答的比例, [0, 1]
+	double bad;			//< 应答校验码错误的比例, [0, 1]. 仅用于EMU_COOLER_RTU
+
+public:
+	EmulatorParam() {
+		type    = EMU_COOLER_ASCII;
+		ndev    = 1;
+		latency = 5;
+		jitter  = 0;
+		drop    = 0.0;
+		bad     = 0.0;
+	}
+};
+
+struct EmulatorStat {// 仿真器统计信息
+	uint64_t request;	//< 收到的有效指令数量
+	uint64_t reply;		//< 发出的应答数量
+	uint64_t drop;		//< 丢弃的应答数量
+	uint64_t bad;		//< 发出的错误校验码应答数量
+	uint64_t invalid;	//< 格式或校验错误的指令数量
+
+public:
+	EmulatorStat() {
+		request = reply = drop = bad = invalid = 0;
+	}
+};
+
+class DeviceEmulator : public boost::enable_shared_from_this<DeviceEmulator>, private boost::noncopyable {
+public:
+	DeviceEmulator(const EmulatorParam& param);
+	virtual ~DeviceEmulator();
+
+protected:
+	/* 数据类型 */
+	typedef boost::asio::posix::stream_descriptor stream_descriptor;
+	typedef boost::asio::deadline_timer deadline_timer;
+	typedef boost::shared_ptr<deadline_timer> timerptr;
+	typedef boost::shared_ptr<IOServiceKeep> KeepPtr;
+	typedef boost::shared_ptr<stream_descriptor> StreamPtr;
+	typedef boost::unique_lock<boost::mutex> mutex_lock;
+
+	struct SimDevice {// 单台设备的仿真状态
+		uint8_t idd;		//< 设备编号
+		double vol;			//< 工作电压
+		double cur;			//< 工作电流
+		double thot;		//< 热端温度
+		double coolset;		//< 制冷温度
+		double coolget;		//< 探测器温度
+		string pres;		//< 真空度
+		boost::posix_time::ptime tmlast;	//< 最后一次更新探测器温度的时间
+	};
+	typedef vector<SimDevice> SimDevVec;
+
+protected:
+	/* 成员变量 */
+	EmulatorParam param_;	//< 仿真参数
+	int fdm_, fds_;			//< 伪终端主/从端文件描述符. 保持从端打开, 避免camannex关闭串口后主端读出失败
+	string portname_;		//< 伪终端从端名称
+	KeepPtr keep_;			//< io_service与strand
+	StreamPtr stream_;		//< 伪终端主端
+	char bufrcv_[512];		//< 接收缓冲区
+	int nrcv_;				//< 接收缓冲区中数据长度
+	char bufin_[256];		//< 单次读出缓冲区
+	SimDevVec devs_;		//< 仿真设备
+	unsigned int seed_;		//< 随机数种子
+	EmulatorStat stat_;		//< 统计信息
+	boost::mutex mtxStat_;	//< 统计信息互斥锁
+
+public:
+	/*!
+	 * @brief 创建伪终端
+	 * @return
+	 * 创建结果
+	 * @note
+	 * 不创建线程, 可在fork()之前调用
+	 */
+	bool Open();
+	/*!
+	 * @brief 开始应答指令
+	 * @return
+	 * 启动结果
+	 */
+	bool Start();
+	/*!
+	 * @brief 停止应答并关闭伪终端
+	 */
+	void Stop();
+	/*!
+	 * @brief 查看伪终端从端名称
+	 * @return
+	 * 从端名称, 作为串口名称使用
+	 */
+	const char* GetPortname();
+	/*!
+	 * @brief 查看统计信息
+	 * @return
+	 * 统计信息
+	 */
+	EmulatorStat GetStat();
+
+protected:
+	/*!
+	 * @brief 启动异步读出
+	 */
+	void start_read();
+	/*!
+	 * @brief 处理读出的数据
+	 * @param ec 错误代码
+	 * @param n  读出数据长度
+	 */
+	void handle_read(const boost::system::error_code& ec, size_t n);
+	/*!
+	 * @brief 在strand中关闭伪终端
+	 * @param done 完成标志
+	 */
+	void close_stream(boost::promise<void>* done);
+	/*!
+	 * @brief 从接收缓冲区中提取并处理完整指令
+	 */
+	void process_buffer();
+	/*!
+	 * @brief 处理一条完整指令
+	 * @param idd   设备编号
+	 * @param idf   功能编号
+	 * @param value 指令参数
+	 * @param n     指令参数长度
+	 */
+	void process_request(uint8_t idd, uint8_t idf, const char* value, int n);
+	/*!
+	 * @brief 按设备类型编码应答
+	 * @param idd    设备编号
+	 * @param idf    功能编号
+	 * @param value  应答数据
+	 * @param n      应答数据长度
+	 * @param bad    是否生成错误校验码
+	 * @param output 编码后应答
+	 * @return
+	 * 编码后应答长度
+	 */
+	int encode_reply(uint8_t idd, uint8_t idf, const char* value, int n, bool bad, char* output);
+	/*!
+	 * @brief 在延时结束后发送应答
+	 */
+	void handle_reply(const boost::system::error_code& ec, timerptr timer, boost::shared_array<char> reply, int n);
+	/*!
+	 * @brief 生成[0, 1)均匀分布随机数
+	 */
+	double uniform();
+	/*!
+	 * @brief 查找设备
+	 * @param idd 设备编号
+	 * @return
+	 * 设备仿真状态. 设备不存在时返回NULL
+	 */
+	SimDevice* find_device(uint8_t idd);
+};
+typedef boost::shared_ptr<DeviceEmulator> EmulatorPtr;
+/*!
+ * @brief 工厂函数, 创建仿真器
+ * @param param 仿真参数
+ * @return
+ * 仿真器指针
+ */
+extern EmulatorPtr make_emulator(const EmulatorParam& param);
+
+#endif /* DEVICEEMULATOR_H_ */
@@ -5,21 +5,84 @@
  * @author Xiaomeng Lu
   */
 
+#include <assert.h>
 #include <boost/make_shared.hpp>
 #include <boost/bind.hpp>
 #include "IOServiceKeep.h"
 
-IOServiceKeep::IOServiceKeep() {
+//////////////////////////////////////////////////////////////////////////////
+/*---------------- IOServicePool: 共享线程池 ----------------*/
+IOPoolPtr make_iopool(int nthread) {
+	return boost::make_shared<IOServicePool>(nthread);
+}
+
+IOServicePool::IOServicePool(int nthread) {
+	if (nthread <= 0 && (nthread = boost::thread::hardware_concurrency()) <= 0) nthread = 1;
+	nthread_ = nthread;
 	work_.reset(new work(ios_));
-	thrd_keep_.reset(new boost::thread(boost::bind(&io_service::run, &ios_)));
+	for (int i = 0; i < nthread; ++i)
+		thrds_.create_thread(boost::bind(&io_service::run, &ios_));
 }
 
-IOServiceKeep::~IOServiceKeep() {
+IOServicePool::~IOServicePool() {
+	stop();
+}
+
+void IOServicePool::stop() {
+	// 线程不能等待自身结束: 主程序应在释放通信接口前从池外调用stop()
+	assert(!thrds_.is_this_thread_in());
 	work_.reset();
 	ios_.stop();
-	thrd_keep_->join();
+	thrds_.join_all();
 }
 
-io_service& IOServiceKeep::get_service() {
+io_service& IOServicePool::get_service() {
 	return ios_;
 }
+
+int IOServicePool::get_thread_count() {
+	return nthread_;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/*---------------- IOServiceKeep: 通信接口使用的io_service与strand ----------------*/
+/*
+ * 注入的线程池仅保存弱引用, 由主程序持有并停止. 自动创建的线程池由autoPool持有至进程退出,
+ * 避免最后一个引用在池内线程中释放
+ */
+static boost::weak_ptr<IOServicePool> sharedPool;
+static IOPoolPtr autoPool;
+static boost::mutex mtxPool;
+
+void IOServiceKeep::SetPool(IOPoolPtr pool) {
+	boost::unique_lock<boost::mutex> lck(mtxPool);
+	sharedPool = pool;
+}
+
+IOPoolPtr IOServiceKeep::GetPool() {
+	boost::unique_lock<boost::mutex> lck(mtxPool);
+	IOPoolPtr pool = sharedPool.lock();
+	if (!pool.use_count()) {
+		pool = autoPool = make_iopool();
+		sharedPool = pool;
+	}
+	return pool;
+}
+
+IOServiceKeep::IOServiceKeep() {
+	pool_ = GetPool();
+	strand_.reset(new strand(pool_->get_service()));
+}
+
+IOServiceKeep::~IOServiceKeep() {
+	strand_.reset();
+	pool_.reset();
+}
+
+io_service& IOServiceKeep::get_service() {
+	return pool_->get_service();
+}
+
+IOServiceKeep::strand& IOServiceKeep::get_strand() {
+	return *strand_;
+}
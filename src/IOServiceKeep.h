@@ -7,6 +7,16 @@
  * @li boost::asio::io_service::run()在响应所注册的异步调用后自动退出. 为了避免退出run()函数,
  * 建立ioservice_keep维护其长期有效性
  * @li 使用shared_ptr管理指针
+ * @version 0.2
+ * @note
+ * @li 进程内共享IOServicePool: 一个io_service由固定数量线程执行run(), 线程数量缺省与CPU核数相同
+ * @li IOServiceKeep不再创建私有线程, 改为从共享线程池获取io_service, 并为每个通信接口分配独立strand,
+ * 保证同一接口的回调函数串行执行
+ * @li 主程序可通过IOServiceKeep::SetPool()注入线程池; 未注入时首次使用自动创建
+ * @version 0.3
+ * @note
+ * @li 线程池由主程序调用stop()停止并等待线程结束, 不能在池内线程中停止或释放线程池
+ * @li 自动创建的线程池由进程持有, 在进程退出时停止
  */
 
 #ifndef IOSERVICEKEEP_H_
@@ -15,29 +25,98 @@
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
 #include <boost/smart_ptr.hpp>
+#include <boost/noncopyable.hpp>
 
 using boost::asio::io_service;
 
-class IOServiceKeep : private boost::noncopyable {
+//////////////////////////////////////////////////////////////////////////////
+/*---------------- IOServicePool: 共享线程池 ----------------*/
+class IOServicePool : private boost::noncopyable {
 public:
-	// 构造函数与析构函数
-	IOServiceKeep();
-	virtual ~IOServiceKeep();
+	/*!
+	 * @brief 构造函数
+	 * @param nthread 执行io_service::run()的线程数量. <=0时采用CPU核数
+	 */
+	IOServicePool(int nthread = 0);
+	virtual ~IOServicePool();
 
 protected:
 	// 数据类型
 	typedef io_service::work work;
-	typedef boost::shared_ptr<boost::thread> threadptr;
 
 public:
 	// 属性函数
 	io_service& get_service();
+	/*!
+	 * @brief 查看线程数量
+	 * @return
+	 * 执行io_service::run()的线程数量
+	 */
+	int get_thread_count();
+	/*!
+	 * @brief 停止io_service并等待全部线程结束
+	 * @note
+	 * 须在池外线程(通常为主线程)中调用. 通信接口仍可持有线程池, 但其回调不再执行
+	 */
+	void stop();
 
 private:
 	// 成员变量
 	io_service ios_;		//< io_service对象
 	boost::shared_ptr<work> work_;	//< io_service守护对象
-	threadptr thrd_keep_;			//< 线程
+	boost::thread_group thrds_;		//< 线程组
+	int nthread_;					//< 线程数量
+};
+typedef boost::shared_ptr<IOServicePool> IOPoolPtr;
+/*!
+ * @brief 工厂函数, 创建共享线程池
+ * @param nthread 线程数量. <=0时采用CPU核数
+ * @return
+ * 线程池指针
+ */
+extern IOPoolPtr make_iopool(int nthread = 0);
+
+//////////////////////////////////////////////////////////////////////////////
+/*---------------- IOServiceKeep: 通信接口使用的io_service与strand ----------------*/
+class IOServiceKeep : private boost::noncopyable {
+public:
+	// 构造函数与析构函数
+	IOServiceKeep();
+	virtual ~IOServiceKeep();
+
+public:
+	// 数据类型
+	typedef io_service::strand strand;
+
+public:
+	/*!
+	 * @brief 设置进程内共享线程池
+	 * @param pool 线程池
+	 * @note
+	 * 应在创建任何通信接口之前调用. 已创建的接口继续使用原线程池
+	 */
+	static void SetPool(IOPoolPtr pool);
+	/*!
+	 * @brief 查看进程内共享线程池
+	 * @return
+	 * 线程池指针. 若未设置, 则创建线程数与CPU核数相同的线程池
+	 */
+	static IOPoolPtr GetPool();
+
+public:
+	// 属性函数
+	io_service& get_service();
+	/*!
+	 * @brief 查看与接口绑定的strand
+	 * @return
+	 * strand对象. 经其包装的回调函数串行执行
+	 */
+	strand& get_strand();
+
+private:
+	// 成员变量
+	IOPoolPtr pool_;		//< 共享线程池
+	boost::shared_ptr<strand> strand_;	//< 与接口绑定的strand
 };
 
 #endif /* IOSERVICEKEEP_H_ */
@@ -1,22 +1,30 @@
 /*
  * @file MessageQueue.cpp 定义文件, 基于boost::interprocess::ipc::message_queue封装消息队列
- * @version 0.2
- * @date 2017-10-02
+ * @version 0.5
+ * @date 2026-10-17
  */
 
+#include <errno.h>
 #include <boost/bind.hpp>
 #include <boost/make_shared.hpp>
 #include "MessageQueue.h"
 #include "GLog.h"
 
-#define MQFUNC_SIZE		1024
-
 MessageQueue::MessageQueue() {
 	funcs_.reset(new CallbackFunc[MQFUNC_SIZE]);
+	pldfuncs_.reset(new PayloadFunc[MQFUNC_SIZE]);
+	sem_init(&semlfq_, 0, 0);
 }
 
 MessageQueue::~MessageQueue() {
 	Stop();
+	if (mq_.use_count()) {
+		mq_.reset();
+		message_queue::remove(name_.c_str());
+	}
+	lfq_[0].reset();
+	lfq_[1].reset();
+	sem_destroy(&semlfq_);
 }
 
 bool MessageQueue::RegisterMessage(const long id, const CBSlot& slot) {
@@ -28,25 +36,36 @@ bool MessageQueue::RegisterMessage(const long id, const CBSlot& slot) {
 }
 
 void MessageQueue::PostMessage(const long id, const long p1, const long p2) {
-	if (mq_.unique()) {
-		MSG_UNIT msg(id, p1, p2);
-		mq_->send(&msg, sizeof(MSG_UNIT), 1);
-	}
+	send_message(make_unit(id, p1, p2), false);
 }
 
 void MessageQueue::SendMessage(const long id, const long p1, const long p2) {
-	if (mq_.unique()) {
-		MSG_UNIT msg(id, p1, p2);
-		mq_->send(&msg, sizeof(MSG_UNIT), 10);
-	}
+	send_message(make_unit(id, p1, p2), true);
 }
 
-bool MessageQueue::Start(const char* name) {
+bool MessageQueue::Start(const char* name, bool ipc) {
 	if (thrdmsg_.unique()) return true;
 
 	try {
-		message_queue::remove(name);
-		mq_.reset(new message_queue(boost::interprocess::create_only, name, 1024, sizeof(MSG_UNIT)));
+		if (mq_.use_count()) {// 重新启动: 销毁上次创建的消息队列
+			mq_.reset();
+			message_queue::remove(name_.c_str());
+		}
+		if (lfq_[0].use_count()) {// 重新启动: 丢弃上次停止后投递的消息
+			MSG_UNIT msg;
+			while (!sem_trywait(&semlfq_)) {
+				if (!lfq_[0]->pop(msg)) lfq_[1]->pop(msg);
+			}
+		}
+		if (ipc) {
+			message_queue::remove(name);
+			mq_.reset(new message_queue(boost::interprocess::create_only, name, MQ_CAPACITY, sizeof(MSG_UNIT)));
+			name_ = name;
+		}
+		else if (!lfq_[0].use_count()) {
+			lfq_[0].reset(new lockfree_queue);
+			lfq_[1].reset(new lockfree_queue);
+		}
 		thrdmsg_.reset(new boost::thread(boost::bind(&MessageQueue::thread_message, this)));
 
 		return true;
@@ -57,13 +76,21 @@ bool MessageQueue::Start(const char* name) {
 	}
 }
 
+/*
+ * @note
+ * 其它线程可能仍在投递消息, 队列在析构时才销毁
+ */
 void MessageQueue::Stop() {
-	if (thrdmsg_.unique()) {
-		SendMessage(MSG_QUIT);
+	if (thrdmsg_.unique()) {// MSG_QUIT不可丢弃: 队列满时等待响应线程取出消息
+		MSG_UNIT msg = make_unit(MSG_QUIT, 0, 0);
+		if (mq_.use_count()) mq_->send(&msg, sizeof(MSG_UNIT), 10);
+		else {
+			while (!lfq_[0]->bounded_push(msg)) boost::this_thread::yield();
+			sem_post(&semlfq_);
+		}
 		thrdmsg_->join();
 		thrdmsg_.reset();
 	}
-	if (mq_.unique()) mq_.reset();
 }
 
 void MessageQueue::interrupt_thread(threadptr& thrd) {
@@ -74,16 +101,55 @@ void MessageQueue::interrupt_thread(threadptr& thrd) {
 	}
 }
 
+MessageQueue::MSG_UNIT MessageQueue::make_unit(const long id, const long p1, const long p2) {
+	MSG_UNIT msg;
+	msg.id   = id;
+	msg.par1 = p1;
+	msg.par2 = p2;
+	msg.size = 0;
+	return msg;
+}
+
+/*
+ * @note
+ * 队列满时不等待: 响应线程自身投递消息时, 等待将永不结束
+ */
+void MessageQueue::send_message(const MSG_UNIT& msg, bool urgent) {
+	bool rslt(true);
+
+	if (mq_.use_count()) rslt = mq_->try_send(&msg, sizeof(MSG_UNIT), urgent ? 10 : 1);
+	else if (lfq_[0].use_count()) {
+		if ((rslt = lfq_[urgent ? 0 : 1]->bounded_push(msg))) sem_post(&semlfq_);
+	}
+	if (!rslt) _gLog.Write(LOG_WARN, "MessageQueue", "queue is full, message<%ld> is dropped", msg.id);
+}
+
 void MessageQueue::thread_message() {
 	MSG_UNIT msg;
-	message_queue::size_type szrcv;
-	message_queue::size_type szmsg = sizeof(MSG_UNIT);
-	uint32_t priority;
-	long pos;
 
-	do {
-		mq_->receive(&msg, szmsg, szrcv, priority);
-		if ((pos = msg.id - MSG_USER) >= 0 && pos < MQFUNC_SIZE)
-			(funcs_[pos])(msg.par1, msg.par2);
-	} while(msg.id != MSG_QUIT);
+	if (mq_.unique()) {
+		message_queue::size_type szrcv;
+		message_queue::size_type szmsg = sizeof(MSG_UNIT);
+		uint32_t priority;
+
+		do {
+			mq_->receive(&msg, szmsg, szrcv, priority);
+			dispatch(msg);
+		} while(msg.id != MSG_QUIT);
+	}
+	else {
+		/* 每次sem_post()之前已有一条消息入队, 取得信号量后必然可取出一条消息 */
+		do {
+			while (sem_wait(&semlfq_) && errno == EINTR);
+			if (!lfq_[0]->pop(msg)) lfq_[1]->pop(msg);
+			dispatch(msg);
+		} while(msg.id != MSG_QUIT);
+	}
+}
+
+void MessageQueue::dispatch(const MSG_UNIT& msg) {
+	long pos;
+	if ((pos = msg.id - MSG_USER) < 0 || pos >= MQFUNC_SIZE) return;
+	if (!msg.size) (funcs_[pos])(msg.par1, msg.par2);
+	else if (pldfuncs_[pos] && msg.size <= MSG_PAYLOAD) pldfuncs_[pos](msg.payload.data);
 }
@@ -3,15 +3,43 @@
  * @version 0.2
  * @date 2017-10-02
  * - 优化消息队列实现方式
+ * @version 0.3
+ * @date 2026-10-17
+ * - 缺省采用进程内无锁队列: 高、低优先级各一个boost::lockfree::queue, 信号量唤醒响应线程.
+ *   投递消息不加锁、不分配内存, 无共享内存对象
+ * - 响应线程先处理高优先级队列, 同一优先级按投递顺序处理, 与message_queue一致
+ * - 队列满时投递线程等待, 与message_queue::send一致
+ * - 外部程序需要投递消息时, 以Start(name, true)启用基于共享内存的message_queue
+ * @version 0.4
+ * @date 2026-10-17
+ * - 消息可携带不超过MSG_PAYLOAD字节的POD类型数据, 复制在消息单元内, 投递与响应不分配内存
+ * - 以RegisterMessage<T>()注册的响应函数直接收到T类型数据, 替代以long传递对象指针
+ * - 携带数据的消息仅调用类型化响应函数; 不携带数据的消息仅调用(long, long)响应函数
+ * @version 0.5
+ * @date 2026-10-17
+ * - 队列满时丢弃消息并记录日志, 不再等待: 响应线程内投递的消息不会因队列满而死锁
+ * - Stop()仅停止响应线程, 队列在析构时销毁: 其它线程在Stop()之后投递的消息被丢弃, 不访问已销毁的队列
  */
 
 #ifndef MESSAGEQUEUE_H_
 #define MESSAGEQUEUE_H_
 
+#include <semaphore.h>
+#include <string>
+#include <string.h>
 #include <boost/signals2.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_pod.hpp>
 #include <boost/smart_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/interprocess/ipc/message_queue.hpp>
+#include <boost/lockfree/queue.hpp>
+
+#define MQ_CAPACITY		1024	//< 单一队列容纳的消息数量
+#define MSG_PAYLOAD		64		//< 消息携带数据的最大字节数
+#define MQFUNC_SIZE		1024	//< 消息代码数量
 
 class MessageQueue {
 public:
@@ -25,45 +53,38 @@ protected:
 		MSG_USER = 128		//< 用户消息起始地址
 	};
 
-	struct MSG_UNIT {// 消息单元
+	struct MSG_UNIT {// 消息单元. POD类型: 进程内队列按值复制, 共享内存队列按字节复制
 		long id;		//< 消息代码
 		long par1;	//< 参数(支持两个参数)
 		long par2;
-
-	public:
-		/*!
-		 * @brief 构造函数
-		 */
-		MSG_UNIT() {
-			id = par1 = par2 = 0;
-		}
-
-		/*!
-		 * brief 构造函数
-		 * @param _id   消息代码
-		 * @param _par1 参数1
-		 * @param _par2 参数2
-		 */
-		MSG_UNIT(const long _id, const long _par1 = 0, const long _par2 = 0) {
-			id   = _id;
-			par1 = _par1;
-			par2 = _par2;
-		}
+		long size;	//< 携带数据字节数. 0: 不携带数据
+		union {
+			char data[MSG_PAYLOAD];	//< 携带数据
+			double align_;			//< 对齐
+		} payload;
 	};
 
 	typedef boost::signals2::signal<void (long, long)> CallbackFunc;	//< 消息响应函数类型
 	typedef CallbackFunc::slot_type CBSlot;						//< 响应函数插槽
 	typedef boost::interprocess::message_queue message_queue;	//< 消息队列
 	typedef boost::shared_ptr<message_queue> msgqptr;			//< 消息队列指针
+	typedef boost::function<void (const char*)> PayloadFunc;	//< 携带数据消息的响应函数类型
+	typedef boost::lockfree::queue<MSG_UNIT, boost::lockfree::capacity<MQ_CAPACITY> > lockfree_queue;	//< 进程内队列
+	typedef boost::shared_ptr<lockfree_queue> lfqptr;			//< 进程内队列指针
 	typedef boost::shared_array<CallbackFunc> cbfarray;			//< 回调函数数组
+	typedef boost::shared_array<PayloadFunc> pldarray;			//< 携带数据消息的回调函数数组
 	typedef boost::unique_lock<boost::mutex> mutex_lock;			//< 互斥锁
 	typedef boost::shared_ptr<boost::thread> threadptr;			//< 线程指针
 
 protected:
 	// 成员变量
 	msgqptr mq_;			//< 消息队列
+	std::string name_;	//< 消息队列名称
+	lfqptr lfq_[2];		//< 进程内队列. 0: 高优先级; 1: 低优先级
+	sem_t semlfq_;		//< 进程内队列中的消息数量
 	threadptr thrdmsg_;	//< 消息响应线程
 	cbfarray funcs_;		//< 回调函数
+	pldarray pldfuncs_;	//< 携带数据消息的回调函数
 
 public:
 	// 接口
@@ -89,20 +110,92 @@ public:
 	 * @param p2 参数2
 	 */
 	void SendMessage(const long id, const long p1 = 0, const long p2 = 0);
+	/*!
+	 * @brief 注册携带数据的消息及其响应函数
+	 * @param id      消息代码
+	 * @param handler 响应函数, 参数为消息携带的数据
+	 * @return
+	 * 消息注册结果. 若失败返回false
+	 * @note
+	 * 同一消息只保留最后注册的响应函数
+	 */
+	template <class T>
+	bool RegisterMessage(const long id, const boost::function<void (const T&)>& handler) {
+		BOOST_STATIC_ASSERT(sizeof(T) <= MSG_PAYLOAD);
+		long pos(id - MSG_USER);
+		bool rslt = pos >= 0 && pos < long(MQFUNC_SIZE);
+
+		if (rslt) pldfuncs_[pos] = boost::bind(&MessageQueue::decode<T>, handler, _1);
+		return rslt;
+	}
+	/*!
+	 * @brief 投递携带数据的低优先级消息
+	 * @param id   消息代码
+	 * @param data 数据. 须为POD类型, 不超过MSG_PAYLOAD字节
+	 */
+	template <class T>
+	void PostMessage(const long id, const T& data) {
+		send_message(make_unit(id, data), false);
+	}
+	/*!
+	 * @brief 投递携带数据的高优先级消息
+	 * @param id   消息代码
+	 * @param data 数据. 须为POD类型, 不超过MSG_PAYLOAD字节
+	 */
+	template <class T>
+	void SendMessage(const long id, const T& data) {
+		send_message(make_unit(id, data), true);
+	}
 	/*!
 	 * @brief 创建消息队列并启动监测/响应服务
 	 * @param name 消息队列名称
+	 * @param ipc  true: 采用共享内存中的message_queue, 外部程序可按名称投递消息; false: 采用进程内队列
 	 * @return
 	 * 操作结果. false代表失败
 	 */
-	bool Start(const char* name);
+	bool Start(const char* name, bool ipc = false);
 	/*!
-	 * @brief 停止消息队列监测/响应服务, 并销毁消息队列
+	 * @brief 停止消息队列监测/响应服务
+	 * @note
+	 * 队列保留至析构, 之后投递的消息在队列满后被丢弃
 	 */
 	void Stop();
 
 protected:
 	// 功能函数
+	/*!
+	 * @brief 生成不携带数据的消息
+	 */
+	static MSG_UNIT make_unit(const long id, const long p1, const long p2);
+	/*!
+	 * @brief 生成携带数据的消息
+	 */
+	template <class T>
+	static MSG_UNIT make_unit(const long id, const T& data) {
+		BOOST_STATIC_ASSERT(sizeof(T) <= MSG_PAYLOAD);
+		BOOST_STATIC_ASSERT(boost::is_pod<T>::value);
+		MSG_UNIT msg = make_unit(id, 0, 0);
+		msg.size = sizeof(T);
+		memcpy(msg.payload.data, &data, sizeof(T));
+		return msg;
+	}
+	/*!
+	 * @brief 将携带的数据复制为T类型, 调用响应函数
+	 */
+	template <class T>
+	static void decode(const boost::function<void (const T&)>& handler, const char* data) {
+		T value;
+		memcpy(&value, data, sizeof(T));
+		handler(value);
+	}
+	/*!
+	 * @brief 投递消息
+	 * @param msg    消息
+	 * @param urgent true: 高优先级; false: 低优先级
+	 * @note
+	 * 队列满时丢弃消息
+	 */
+	void send_message(const MSG_UNIT& msg, bool urgent);
 	/*!
 	 * @brief 中止线程
 	 * @param thrd 线程指针
@@ -112,6 +205,11 @@ protected:
 	 * @brief 线程, 监测/响应消息
 	 */
 	void thread_message();
+	/*!
+	 * @brief 响应消息
+	 * @param msg 消息
+	 */
+	void dispatch(const MSG_UNIT& msg);
 };
 
 #endif /* MESSAGEQUEUE_H_ */
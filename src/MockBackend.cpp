@@ -0,0 +1,224 @@
+/**
+ * @file MockBackend.cpp 数据库Web服务(gwebend)仿真器定义文件
+ * @date 2026-10-17
+ * @version 0.1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <algorithm>
+#include <boost/make_shared.hpp>
+#include <boost/bind.hpp>
+#include "MockBackend.h"
+
+#define ACTION_SUFFIX	".action"	//< 有效请求的路径后缀
+
+MockBackendPtr make_mockbackend(const MockParam& param) {
+	return boost::make_shared<MockBackend>(param);
+}
+
+MockBackend::MockBackend(const MockParam& param) {
+	param_ = param;
+	port_  = 0;
+	seed_  = (unsigned int) time(NULL);
+}
+
+MockBackend::~MockBackend() {
+	Stop();
+}
+
+bool MockBackend::Start() {
+	if (acceptor_.use_count()) return false;
+
+	keep_.reset(new IOServiceKeep);
+	try {
+		tcp::endpoint end(boost::asio::ip::address_v4::loopback(), param_.port);
+		acceptor_.reset(new tcp::acceptor(keep_->get_service()));
+		acceptor_->open(end.protocol());
+		acceptor_->set_option(tcp::acceptor::reuse_address(true));
+		acceptor_->bind(end);
+		acceptor_->listen();
+		port_ = acceptor_->local_endpoint().port();
+	}
+	catch(boost::system::system_error& ex) {
+		acceptor_.reset();
+		return false;
+	}
+	keep_->get_strand().post(boost::bind(&MockBackend::start_accept, this));
+	return true;
+}
+
+void MockBackend::Stop() {
+	if (!acceptor_.use_count()) return;
+	if (keep_->get_strand().running_in_this_thread()) close_all(NULL);
+	else {
+		boost::promise<void> done;
+		boost::unique_future<void> future = done.get_future();
+		keep_->get_strand().post(boost::bind(&MockBackend::close_all, this, &done));
+		future.wait();
+	}
+}
+
+uint16_t MockBackend::GetPort() {
+	return port_;
+}
+
+MockStat MockBackend::GetStat() {
+	mutex_lock lck(mtxStat_);
+	return stat_;
+}
+
+void MockBackend::start_accept() {
+	if (!acceptor_.use_count()) return;
+	SessionPtr session = boost::make_shared<Session>(boost::ref(keep_->get_service()));
+	acceptor_->async_accept(session->sock,
+			keep_->get_strand().wrap(boost::bind(&MockBackend::handle_accept, this, session,
+					boost::asio::placeholders::error)));
+}
+
+void MockBackend::handle_accept(SessionPtr session, const boost::system::error_code& ec) {
+	if (!acceptor_.use_count()) return;
+	if (!ec) {
+		boost::system::error_code ec1;
+		session->sock.set_option(tcp::no_delay(true), ec1);
+		sessions_.insert(session);
+		{
+			mutex_lock lck(mtxStat_);
+			++stat_.connection;
+		}
+		start_read(session);
+	}
+	start_accept();
+}
+
+void MockBackend::start_read(SessionPtr session) {
+	boost::asio::async_read_until(session->sock, session->buf, "\r\n\r\n",
+			keep_->get_strand().wrap(boost::bind(&MockBackend::handle_header, this, session,
+					boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+}
+
+void MockBackend::handle_header(SessionPtr session, const boost::system::error_code& ec, size_t n) {
+	if (ec) {
+		close_session(session);
+		return;
+	}
+
+	// 请求行: <方法> <路径> <版本>
+	string header(boost::asio::buffers_begin(session->buf.data()),
+			boost::asio::buffers_begin(session->buf.data()) + n);
+	session->buf.consume(n);
+	session->header = int(n);
+	session->length = 0;
+	session->path.clear();
+	session->close  = !param_.keepalive;
+
+	string::size_type pos = header.find("\r\n"), first, second;
+	string line = header.substr(0, pos);
+	if ((first = line.find(' ')) != string::npos && (second = line.find(' ', first + 1)) != string::npos) {
+		session->path = line.substr(first + 1, second - first - 1);
+		if (line.compare(second + 1, string::npos, "HTTP/1.0") == 0) session->close = true;
+	}
+	// 头字段: 仅关注Content-Length与Connection
+	while (pos != string::npos && pos + 2 < header.size()) {
+		string::size_type next = header.find("\r\n", pos + 2);
+		line = header.substr(pos + 2, next - pos - 2);
+		if (!strncasecmp(line.c_str(), "Content-Length:", 15))
+			session->length = atoi(line.c_str() + 15);
+		else if (!strncasecmp(line.c_str(), "Connection:", 11) && strcasestr(line.c_str() + 11, "close"))
+			session->close = true;
+		pos = next;
+	}
+
+	int remain = session->length - int(session->buf.size());
+	if (remain > 0) {
+		boost::asio::async_read(session->sock, session->buf, boost::asio::transfer_exactly(remain),
+				keep_->get_strand().wrap(boost::bind(&MockBackend::handle_body, this, session,
+						boost::asio::placeholders::error)));
+	}
+	else handle_body(session, boost::system::error_code());
+}
+
+void MockBackend::handle_body(SessionPtr session, const boost::system::error_code& ec) {
+	if (ec) {
+		close_session(session);
+		return;
+	}
+
+	// 批量请求体每行一条数据
+	boost::asio::streambuf::const_buffers_type data = session->buf.data();
+	int nsample(1);
+	if (session->length > 0 && *boost::asio::buffers_begin(data) == '{') {
+		nsample = int(std::count(boost::asio::buffers_begin(data),
+				boost::asio::buffers_begin(data) + session->length, '\n'));
+	}
+	session->buf.consume(session->length);
+
+	const string &path = session->path;
+	int len = int(strlen(ACTION_SUFFIX));
+	bool found = int(path.size()) > len && path.compare(path.size() - len, len, ACTION_SUFFIX) == 0;
+	bool error = found && param_.error > 0.0 && uniform() < param_.error;
+	{
+		mutex_lock lck(mtxStat_);
+		++stat_.request;
+		stat_.bytes += session->header + session->length;
+		if (!found) ++stat_.notfound;
+		else if (error) ++stat_.error;
+		else stat_.sample += nsample;
+	}
+
+	const char *status = !found ? "404 Not Found" : (error ? "500 Internal Server Error" : "200 OK");
+	const char *body   = !found ? "not found" : (error ? "error" : "ok");
+	char buff[256];
+	snprintf(buff, sizeof(buff), "HTTP/1.1 %s\r\nContent-Type: text/plain\r\nContent-Length: %d\r\n%s\r\n%s",
+			status, int(strlen(body)), session->close ? "Connection: close\r\n" : "", body);
+	session->response = buff;
+
+	int delay = param_.latency;
+	if (param_.jitter > 0) delay += int((2.0 * uniform() - 1.0) * param_.jitter);
+	if (delay > 0) {
+		session->timer.expires_from_now(boost::posix_time::millisec(delay));
+		session->timer.async_wait(keep_->get_strand().wrap(boost::bind(&MockBackend::handle_reply, this,
+				session, boost::asio::placeholders::error)));
+	}
+	else handle_reply(session, boost::system::error_code());
+}
+
+void MockBackend::handle_reply(SessionPtr session, const boost::system::error_code& ec) {
+	if (ec || !session->sock.is_open()) return;
+	boost::asio::async_write(session->sock, boost::asio::buffer(session->response),
+			keep_->get_strand().wrap(boost::bind(&MockBackend::handle_write, this, session,
+					boost::asio::placeholders::error)));
+}
+
+void MockBackend::handle_write(SessionPtr session, const boost::system::error_code& ec) {
+	if (ec || session->close) close_session(session);
+	else start_read(session);
+}
+
+void MockBackend::close_session(SessionPtr session) {
+	boost::system::error_code ec;
+	session->timer.cancel(ec);
+	session->sock.shutdown(tcp::socket::shutdown_both, ec);
+	session->sock.close(ec);
+	sessions_.erase(session);
+}
+
+void MockBackend::close_all(boost::promise<void>* done) {
+	boost::system::error_code ec;
+	acceptor_->close(ec);
+	acceptor_.reset();
+	SessionSet sessions;
+	sessions.swap(sessions_);
+	for (SessionSet::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+		(*it)->timer.cancel(ec);
+		(*it)->sock.close(ec);
+	}
+	if (done) done->set_value();
+}
+
+double MockBackend::uniform() {
+	return rand_r(&seed_) / (RAND_MAX + 1.0);
+}
@@ -0,0 +1,170 @@
+/**
+ * @file MockBackend.h 数据库Web服务(gwebend)仿真器声明文件
+ * @date 2026-10-17
+ * @version 0.1
+ * @note
+ * - 在回环地址监听HTTP/1.1请求, 接收DataTransfer与AsyncTransfer上传的multipart表单与批量请求体
+ * - 路径以.action结尾的POST请求视为有效, 应答200; 其它请求应答404
+ * - 可设置应答延时与抖动, 并按比例应答500, 用于测试重试、磁盘缓存与连接复用
+ * - 默认保持连接(keep-alive); 可设置为每个应答后关闭连接, 对比连接复用的效果
+ * - 不处理Expect: 100-continue. 客户端等待超时后发送请求体, 请求仍可完成
+ * - 所有连接共用IOServicePool线程池与同一strand
+ */
+
+#ifndef MOCKBACKEND_H_
+#define MOCKBACKEND_H_
+
+#include <set>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/thread/future.hpp>
+#include "IOServiceKeep.h"
+
+using std::string;
+
+struct MockParam {// 仿真参数
+	uint16_t port;		//< 监听端口. 0: 由系统分配
+	int latency;		//< 应答延时, 量纲: 毫秒
+	int jitter;			//< 应答延时抖动幅度, 量纲: 毫秒
+	double error;		//< 应答500的比例, [0, 1]
+	bool keepalive;		//< 应答后保持连接
+
+public:
+	MockParam() {
+		port      = 0;
+		latency   = 0;
+		jitter    = 0;
+		error     = 0.0;
+		keepalive = true;
+	}
+};
+
+struct MockStat {// 仿真器统计信息
+	uint64_t connection;	//< 接受的连接数量
+	uint64_t request;		//< 收到的请求数量
+	uint64_t sample;		//< 收到的数据条数. 批量请求按行计数
+	uint64_t error;			//< 应答500的数量
+	uint64_t notfound;		//< 应答404的数量
+	uint64_t bytes;			//< 收到的字节数
+
+public:
+	MockStat() {
+		connection = request = sample = error = notfound = bytes = 0;
+	}
+};
+
+class MockBackend : private boost::noncopyable {
+public:
+	MockBackend(const MockParam& param);
+	virtual ~MockBackend();
+
+protected:
+	/* 数据类型 */
+	typedef boost::asio::ip::tcp tcp;
+	typedef boost::asio::deadline_timer deadline_timer;
+	typedef boost::shared_ptr<IOServiceKeep> KeepPtr;
+	typedef boost::unique_lock<boost::mutex> mutex_lock;
+
+	struct Session {// 单个连接
+		tcp::socket sock;				//< 套接字
+		boost::asio::streambuf buf;		//< 接收缓冲区
+		deadline_timer timer;			//< 应答延时定时器
+		int header;			//< 请求头长度
+		int length;			//< 请求体长度
+		bool close;			//< 应答后关闭连接
+		string path;		//< 请求路径
+		string response;	//< 应答
+
+	public:
+		Session(io_service& ios) : sock(ios), timer(ios) {
+			header = length = 0;
+			close  = false;
+		}
+	};
+	typedef boost::shared_ptr<Session> SessionPtr;
+	typedef std::set<SessionPtr> SessionSet;
+
+protected:
+	/* 成员变量 */
+	MockParam param_;		//< 仿真参数
+	KeepPtr keep_;			//< io_service与strand
+	boost::shared_ptr<tcp::acceptor> acceptor_;	//< 监听接口
+	uint16_t port_;			//< 实际监听端口
+	SessionSet sessions_;	//< 已建立的连接
+	unsigned int seed_;		//< 随机数种子
+	MockStat stat_;			//< 统计信息
+	boost::mutex mtxStat_;	//< 统计信息互斥锁
+
+public:
+	/*!
+	 * @brief 在回环地址上开始监听
+	 * @return
+	 * 端口被占用时返回false
+	 */
+	bool Start();
+	/*!
+	 * @brief 停止监听并关闭全部连接
+	 */
+	void Stop();
+	/*!
+	 * @brief 查看实际监听端口
+	 */
+	uint16_t GetPort();
+	/*!
+	 * @brief 查看统计信息
+	 */
+	MockStat GetStat();
+
+protected:
+	/*!
+	 * @brief 等待新的连接
+	 */
+	void start_accept();
+	/*!
+	 * @brief 处理新的连接
+	 */
+	void handle_accept(SessionPtr session, const boost::system::error_code& ec);
+	/*!
+	 * @brief 读取请求头
+	 */
+	void start_read(SessionPtr session);
+	/*!
+	 * @brief 解析请求头, 读取请求体
+	 */
+	void handle_header(SessionPtr session, const boost::system::error_code& ec, size_t n);
+	/*!
+	 * @brief 处理完整请求, 在延时结束后应答
+	 */
+	void handle_body(SessionPtr session, const boost::system::error_code& ec);
+	/*!
+	 * @brief 发送应答
+	 */
+	void handle_reply(SessionPtr session, const boost::system::error_code& ec);
+	/*!
+	 * @brief 应答发送完成
+	 */
+	void handle_write(SessionPtr session, const boost::system::error_code& ec);
+	/*!
+	 * @brief 关闭连接
+	 */
+	void close_session(SessionPtr session);
+	/*!
+	 * @brief 在strand中停止监听并关闭全部连接
+	 * @param done 完成标志
+	 */
+	void close_all(boost::promise<void>* done);
+	/*!
+	 * @brief 生成[0, 1)均匀分布随机数
+	 */
+	double uniform();
+};
+typedef boost::shared_ptr<MockBackend> MockBackendPtr;
+/*!
+ * @brief 工厂函数, 创建仿真器
+ * @param param 仿真参数
+ * @return
+ * 仿真器指针
+ */
+extern MockBackendPtr make_mockbackend(const MockParam& param);
+
+#endif /* MOCKBACKEND_H_ */
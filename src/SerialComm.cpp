@@ -3,6 +3,7 @@
  * @version 0.1
  * @date 2017-10-10
  */
+#include <string.h>
 #include <boost/make_shared.hpp>
 #include "SerialComm.h"
 
@@ -14,9 +15,11 @@ SerialPtr make_serial() {
 
 SerialComm::SerialComm()
 	: port_(keep_.get_service()) {
-	bufrcv_.reset(new char[SERIAL_BUFF_SIZE]);
-	crcrcv_.set_capacity(SERIAL_BUFF_SIZE * 10);
+	baudrate_ = 9600;
+	bufrcv_.reset(new char[SERIAL_BUFF_SIZE * 10]);
+	rdpos_ = wrpos_ = 0;
 	crcsnd_.set_capacity(SERIAL_BUFF_SIZE * 10);
+	writing_ = false;
 }
 
 SerialComm::~SerialComm() {
@@ -28,6 +31,7 @@ bool SerialComm::Open(const string& portname, const int baud_rate) {
 	error_code ec;
 	port_.open(portname, ec);
 	if (!ec) {
+		baudrate_ = baud_rate;
 		port_.set_option(serial_port::baud_rate(baud_rate));
 		port_.set_option(serial_port::stop_bits(serial_port::stop_bits::one));
 		port_.set_option(serial_port::parity(serial_port::parity::none));
@@ -54,11 +58,22 @@ int SerialComm::Lookup(const char* flag, const int len, const int from) {
 	if (!flag || len <= 0 || from < 0) return -1;
 
 	mutex_lock lck(mtxrcv_);
-	int n(crcrcv_.size() - len), pos, i, j;
-	for (pos = from, i = -1; i != len && pos <= n; ++pos) {
-		for (i = 0, j = pos; i < len && flag[i] == crcrcv_[j]; ++i, ++j);
-	}
-	return (i == len) ? (pos - 1) : -1;
+	const char* base = bufrcv_.get() + rdpos_;
+	if (from > wrpos_ - rdpos_) return -1;
+	const char* pos = search(flag, len, base + from);
+	return pos ? int(pos - base) : -1;
+}
+
+io_service& SerialComm::GetService() {
+	return keep_.get_service();
+}
+
+IOServiceKeep::strand& SerialComm::GetStrand() {
+	return keep_.get_strand();
+}
+
+int SerialComm::GetBaudrate() {
+	return baudrate_;
 }
 
 const char* SerialComm::GetErrdesc() {
@@ -69,11 +84,15 @@ int SerialComm::Write(const char* buff, const int len) {
 	if (!buff || len <= 0 || !port_.is_open()) return 0;
 
 	mutex_lock lck(mtxsnd_);
-	int n0(crcsnd_.size()), n(crcsnd_.capacity() - n0), i;
+	int n(crcsnd_.capacity() - crcsnd_.size()), i;
 
 	if (n > len) n = len;
 	for (i = 0; i < n; ++i) crcsnd_.push_back(buff[i]);
-	if (!n0) start_write();
+	// 在strand中启动发送, 避免与读出回调并发操作串口. 发送进行中时由handle_write()继续发送
+	if (n && !writing_) {
+		writing_ = true;
+		keep_.get_strand().post(boost::bind(&SerialComm::start_write, shared_from_this()));
+	}
 	return n;
 }
 
@@ -81,12 +100,37 @@ int SerialComm::Read(char* buff, const int len, const int from) {
 	if (!buff || len <= 0 || from < 0) return 0;
 
 	mutex_lock lck(mtxrcv_);
-	int n0(crcrcv_.size()), n1(from + len), i(0), j(from);
+	int n0(wrpos_ - rdpos_), n1(from + len), n;
 
 	if (n0 > n1) n0 = n1;
-	for (; j < n0; ++i, ++j) buff[i] = crcrcv_[j];
-	if (i) crcrcv_.erase_begin(n0);
-	return i;
+	if ((n = n0 - from) <= 0) return 0;
+	memcpy(buff, bufrcv_.get() + rdpos_ + from, n);
+	rdpos_ += n0;
+	return n;
+}
+
+bool SerialComm::NextFrame(const char* head, const int nhead, const char* tail, const int ntail, Frame& frame) {
+	mutex_lock lck(mtxrcv_);
+	const char *first = bufrcv_.get() + rdpos_, *last;
+	if (head && nhead > 0) {
+		if (!(first = search(head, nhead, first))) {// 丢弃无效数据, 保留可能不完整的起始标志
+			if (wrpos_ - rdpos_ >= nhead) rdpos_ = wrpos_ - nhead + 1;
+			return false;
+		}
+		rdpos_ = first - bufrcv_.get();
+	}
+	if (!tail || ntail <= 0) {// 无结束标志
+		if (!(frame.len = wrpos_ - rdpos_)) return false;
+		frame.data = first;
+		rdpos_ = wrpos_;
+		return true;
+	}
+	if (!(last = search(tail, ntail, first + nhead))) return false;
+
+	frame.data = first;
+	frame.len  = last - first + ntail;
+	rdpos_ += frame.len;
+	return true;
 }
 
 void SerialComm::RegisterRead(const CBSlot& slot) {
@@ -102,9 +146,10 @@ void SerialComm::RegisterWrite(const CBSlot& slot) {
 }
 
 void SerialComm::handle_read(const error_code& ec, int n) {
+	if (ec == error::operation_aborted) return; // 串口已关闭
 	if (!ec) {
 		mutex_lock lock(mtxrcv_);
-		for(int i = 0; i < n; ++i) crcrcv_.push_back(bufrcv_[i]);
+		wrpos_ += n;
 	}
 	else errmsg_ = ec.message();
 	if (!cbrcv_.empty()) cbrcv_((long) this, ec.value());
@@ -112,29 +157,61 @@ void SerialComm::handle_read(const error_code& ec, int n) {
 }
 
 void SerialComm::handle_write(const error_code& ec, int n) {
-	if (!ec) {
+	{
 		mutex_lock lock(mtxsnd_);
-		crcsnd_.erase_begin(n);
+		if (!ec) crcsnd_.erase_begin(n);
+		else {// 丢弃未发送数据, 之后的Write()重新启动发送
+			crcsnd_.clear();
+			writing_ = false;
+		}
 	}
-	else errmsg_ = ec.message();
+	if (ec == error::operation_aborted) return; // 串口已关闭
+	if (ec) errmsg_ = ec.message();
 	if (!cbsnd_.empty()) cbsnd_((long) this, ec.value());
 	if (!ec) start_write();
 }
 
 void SerialComm::start_read() {
 	if (port_.is_open()) {
-		port_.async_read_some(buffer(bufrcv_.get(), SERIAL_BUFF_SIZE),
-				boost::bind(&SerialComm::handle_read, this,
-						placeholders::error, placeholders::bytes_transferred));
+		mutex_lock lock(mtxrcv_);
+		char* buff = bufrcv_.get();
+		int capacity(SERIAL_BUFF_SIZE * 10), n(wrpos_ - rdpos_);
+
+		if (!n) rdpos_ = wrpos_ = 0;
+		else if (capacity - wrpos_ < SERIAL_BUFF_SIZE) {// 空闲区不足
+			if (n > capacity - SERIAL_BUFF_SIZE) {// 长时间未构成完整信息帧, 丢弃较早数据
+				rdpos_ = wrpos_ - (n = capacity - SERIAL_BUFF_SIZE);
+			}
+			memmove(buff, buff + rdpos_, n);
+			rdpos_ = 0;
+			wrpos_ = n;
+		}
+		port_.async_read_some(buffer(buff + wrpos_, capacity - wrpos_),
+				keep_.get_strand().wrap(boost::bind(&SerialComm::handle_read, shared_from_this(),
+						placeholders::error, placeholders::bytes_transferred)));
 	}
 }
 
 void SerialComm::start_write() {
+	mutex_lock lck(mtxsnd_);
 	int n(crcsnd_.size());
 
-	if (n) {
+	if (n && port_.is_open()) {
 		port_.async_write_some(boost::asio::buffer(crcsnd_.linearize(), n),
-				boost::bind(&SerialComm::handle_write, this,
-						placeholders::error, placeholders::bytes_transferred));
+				keep_.get_strand().wrap(boost::bind(&SerialComm::handle_write, shared_from_this(),
+						placeholders::error, placeholders::bytes_transferred)));
+	}
+	else {
+		crcsnd_.clear();
+		writing_ = false;
+	}
+}
+
+const char* SerialComm::search(const char* flag, const int len, const char* from) {
+	const char *last = bufrcv_.get() + wrpos_ - len, *pos;
+	for (pos = from; pos <= last; ++pos) {
+		if (!(pos = (const char*) memchr(pos, flag[0], last - pos + 1))) break;
+		if (len == 1 || !memcmp(pos + 1, flag + 1, len - 1)) return pos;
 	}
+	return NULL;
 }
@@ -9,6 +9,13 @@
  * - 读出数据
  * - 写入数据
  * - 异常处理
+ * @version 0.2
+ * - 接收缓冲区改为连续存储区, async_read_some直接写入空闲区, 不再逐字节复制
+ * - 使用memchr查找起始/结束标志
+ * - 增加NextFrame(): 以只读视图形式提取完整信息帧, 可在一次回调中逐条提取全部信息帧
+ * @version 0.3
+ * - 异步读写回调持有shared_from_this(), 关闭串口后挂起的回调不再访问已释放对象. 须由make_serial()创建
+ * - 由writing_标志保证同一时刻仅有一次async_write_some. 发送出错或串口关闭时丢弃未发送数据
  */
 
 #ifndef SERIALCOMM_H_
@@ -17,6 +24,7 @@
 #include <string>
 #include <boost/signals2.hpp>
 #include <boost/circular_buffer.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include "IOServiceKeep.h"
 
 #define SERIAL_BUFF_SIZE		512
@@ -24,7 +32,7 @@
 using std::string;
 using boost::system::error_code;
 
-class SerialComm {
+class SerialComm : public boost::enable_shared_from_this<SerialComm> {
 public:
 	SerialComm();
 	virtual ~SerialComm();
@@ -40,6 +48,17 @@ public:
 	// 基于boost::signals2声明插槽类型
 	typedef CallbackFunc::slot_type CBSlot;
 
+	struct Frame {// 信息帧视图
+		const char* data;	//< 信息帧在接收缓冲区中的起始地址
+		int len;			//< 信息帧长度, 量纲: 字节
+
+	public:
+		Frame() {
+			data = NULL;
+			len  = 0;
+		}
+	};
+
 protected:
 	/* 数据类型 */
 	typedef boost::unique_lock<boost::mutex> mutex_lock;	//< 互斥锁
@@ -48,15 +67,18 @@ protected:
 
 protected:
 	/* 成员变量 */
-	IOServiceKeep keep_;		//< 提供io_service对象
+	IOServiceKeep keep_;		//< 提供共享io_service对象与strand
 	boost::asio::serial_port port_;	//< 串口
 	string errmsg_;			//< 错误描述
 	CallbackFunc  cbrcv_;	//< receive回调函数
 	CallbackFunc  cbsnd_;	//< send回调函数
 
-	carray bufrcv_;		//< 单条接收缓冲区
-	crcbuff crcrcv_;		//< 循环接收缓冲区
+	carray bufrcv_;		//< 连续接收缓冲区. 有效数据区间: [rdpos_, wrpos_)
+	int rdpos_;			//< 接收缓冲区读出位置
+	int wrpos_;			//< 接收缓冲区写入位置
 	crcbuff crcsnd_;		//< 循环发送缓冲区
+	bool writing_;		//< 发送进行中: 已投递start_write()或async_write_some()尚未完成. 由mtxsnd_保护
+	int baudrate_;		//< 波特率
 	boost::mutex mtxrcv_;	//< 接收互斥锁
 	boost::mutex mtxsnd_;	//< 发送互斥锁
 
@@ -89,6 +111,24 @@ public:
 	 * 标识串第一次出现位置. 若flag不存在则返回-1
 	 */
 	int Lookup(const char* flag, const int len, const int from = 0);
+	/*!
+	 * @brief 查看串口使用的io_service
+	 * @return
+	 * io_service对象
+	 */
+	io_service& GetService();
+	/*!
+	 * @brief 查看与串口绑定的strand
+	 * @return
+	 * strand对象. 串口回调函数在其中串行执行
+	 */
+	IOServiceKeep::strand& GetStrand();
+	/*!
+	 * @brief 查看波特率
+	 * @return
+	 * 打开串口时设置的波特率
+	 */
+	int GetBaudrate();
 	/*!
 	 * @brief 查看错误信息
 	 * @return
@@ -112,6 +152,21 @@ public:
 	 * 实际读出信息长度
 	 */
 	int Read(char* buff, const int len, const int from = 0);
+	/*!
+	 * @brief 从已接收信息中提取下一条完整信息帧
+	 * @param head  起始标志. 为空时信息帧从已接收信息首字节开始
+	 * @param nhead 起始标志长度
+	 * @param tail  结束标志. 为空时全部已接收信息构成一帧, 用于以静默间隔分帧的协议
+	 * @param ntail 结束标志长度
+	 * @param frame 信息帧视图, 包含起始和结束标志
+	 * @return
+	 * 是否提取到完整信息帧
+	 * @note
+	 * - 起始标志之前的无效数据被丢弃, 被提取信息帧视为已读出
+	 * - 视图直接指向接收缓冲区, 在注册的读出回调函数返回前有效
+	 * - 在读出回调函数中循环调用, 可处理一次接收到的多条信息帧
+	 */
+	bool NextFrame(const char* head, const int nhead, const char* tail, const int ntail, Frame& frame);
 	/*!
 	 * @brief 注册read_some回调函数, 处理收到的网络信息
 	 * @param slot 函数插槽
@@ -139,10 +194,23 @@ protected:
 	void handle_write(const error_code& ec, int n);
 	/*!
 	 * @brief 尝试接收串口信息
+	 * @note
+	 * 接收前整理缓冲区: 将未读出数据移至缓冲区起始位置, 保证空闲区不小于SERIAL_BUFF_SIZE
 	 */
 	void start_read();
+	/*!
+	 * @brief 在已接收信息中查找标识串
+	 * @param flag 标识字符串
+	 * @param len  标识字符串长度
+	 * @param from 查找起始地址
+	 * @return
+	 * 标识串起始地址. 若flag不存在则返回NULL
+	 */
+	const char* search(const char* flag, const int len, const char* from);
 	/*!
 	 * @brief 尝试发送缓冲区数据
+	 * @note
+	 * 在strand中执行. 缓冲区为空时清除writing_
 	 */
 	void start_write();
 };
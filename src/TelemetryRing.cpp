@@ -0,0 +1,117 @@
+/**
+ * @file TelemetryRing.cpp 设备监测数据时间序列定义文件
+ * @date 2026-10-16
+ * @version 0.1
+ */
+
+#include <boost/make_shared.hpp>
+#include "TelemetryRing.h"
+
+TrendPtr make_trend(int nchannel, double hours, double resolution) {
+	if (resolution <= 0.0) resolution = 1.0;
+	int capacity = int(hours * 3600.0 / resolution + 0.5);
+	return boost::make_shared<TelemetryRing>(nchannel, capacity > 1 ? capacity : 1, resolution);
+}
+
+TelemetryRing::TelemetryRing(int nchannel, int capacity, double resolution) {
+	nchannel_   = nchannel > 0 ? nchannel : 1;
+	capacity_   = capacity > 0 ? capacity : 1;
+	resolution_ = resolution;
+	head_ = count_ = 0;
+	time_.reset(new double[capacity_]);
+	value_.reset(new float[nchannel_ * capacity_]);
+}
+
+TelemetryRing::~TelemetryRing() {
+}
+
+void TelemetryRing::Append(double t, const float* values) {
+	mutex_lock lck(mtx_);
+	if (count_) {
+		int last = head_ ? head_ - 1 : capacity_ - 1;
+		if (t - time_[last] < resolution_) {// 覆盖最后一条数据的数值
+			/* 保留该条数据的时间标签: 若随覆盖推后, 采样间隔小于分辨率的设备将只保留一条数据.
+			 * 时钟回拨时同样不修改, 保持时间标签单调, 以便二分查找 */
+			for (int i = 0; i < nchannel_; ++i) value_[i * capacity_ + last] = values[i];
+			return;
+		}
+	}
+
+	time_[head_] = t;
+	for (int i = 0; i < nchannel_; ++i) value_[i * capacity_ + head_] = values[i];
+	if (++head_ == capacity_) head_ = 0;
+	if (count_ < capacity_) ++count_;
+}
+
+/*
+ * @note 变化率采用以窗口起点为零点的时间计算, 避免UNIX时间平方损失精度
+ */
+bool TelemetryRing::Query(int channel, double from, TrendStat& stat) {
+	if (channel < 0 || channel >= nchannel_) return false;
+
+	mutex_lock lck(mtx_);
+	int start = lower_bound(from), n = count_ - start;
+	if (n <= 0) return false;
+
+	const float *column = value_.get() + channel * capacity_;
+	int seg[2][2], i, j, k;	// 窗口在存储区中最多分为两段连续区域
+	double t0, dt, v, vmin, vmax, st(0.0), sv(0.0), stt(0.0), stv(0.0);
+
+	seg[0][0] = physical(start);
+	seg[0][1] = seg[0][0] + n;
+	seg[1][0] = seg[1][1] = 0;
+	if (seg[0][1] > capacity_) {
+		seg[1][1] = seg[0][1] - capacity_;
+		seg[0][1] = capacity_;
+	}
+
+	t0 = time_[seg[0][0]];
+	vmin = vmax = column[seg[0][0]];
+	for (k = 0; k < 2; ++k) {
+		for (i = seg[k][0], j = seg[k][1]; i < j; ++i) {
+			v  = column[i];
+			dt = time_[i] - t0;
+			if (v < vmin) vmin = v;
+			else if (v > vmax) vmax = v;
+			st  += dt;
+			sv  += v;
+			stt += dt * dt;
+			stv += dt * v;
+		}
+	}
+
+	stat.count  = n;
+	stat.tstart = t0;
+	stat.tend   = time_[physical(count_ - 1)];
+	stat.min    = vmin;
+	stat.max    = vmax;
+	stat.mean   = sv / n;
+	dt = n * stt - st * st;
+	stat.slope  = n > 1 && dt > 0.0 ? (n * stv - st * sv) / dt : 0.0;
+
+	return true;
+}
+
+int TelemetryRing::GetChannelCount() {
+	return nchannel_;
+}
+
+int TelemetryRing::GetCount() {
+	mutex_lock lck(mtx_);
+	return count_;
+}
+
+int TelemetryRing::physical(int i) {
+	int pos = (count_ < capacity_ ? 0 : head_) + i;
+	return pos < capacity_ ? pos : pos - capacity_;
+}
+
+int TelemetryRing::lower_bound(double t) {
+	int low(0), high(count_), mid;
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (time_[physical(mid)] < t) low = mid + 1;
+		else high = mid;
+	}
+	return low;
+}
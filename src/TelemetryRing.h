@@ -0,0 +1,117 @@
+/**
+ * @file TelemetryRing.h 设备监测数据时间序列声明文件
+ * @date 2026-10-16
+ * @version 0.1
+ * @note
+ * - 固定容量的环形缓冲区, 保存单台设备最近若干小时的监测数据
+ * - 按列存储: 时间标签与各通道数据分别存储在连续数组中, 追加数据的时间复杂度为O(1)
+ * - 相邻数据时间间隔小于分辨率时覆盖最后一条数据, 因此容量 = 时长 / 分辨率
+ * - 按时间窗查询单一通道的最小值、最大值、均值与变化率. 二分查找窗口起点, 遍历窗口内连续数组
+ */
+
+#ifndef TELEMETRYRING_H_
+#define TELEMETRYRING_H_
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_types.hpp>
+#include <boost/smart_ptr.hpp>
+
+struct TrendStat {// 时间窗内单一通道的统计结果
+	int count;			//< 数据数量
+	double tstart;		//< 第一条数据时间, 量纲: 秒, UNIX时间
+	double tend;		//< 最后一条数据时间, 量纲: 秒, UNIX时间
+	double min;			//< 最小值
+	double max;			//< 最大值
+	double mean;		//< 均值
+	double slope;		//< 最小二乘拟合的变化率, 量纲: 单位/秒. 数据少于2条时为0
+
+public:
+	TrendStat() {
+		count = 0;
+		tstart = tend = 0.0;
+		min = max = mean = slope = 0.0;
+	}
+};
+
+class TelemetryRing : private boost::noncopyable {
+public:
+	/*!
+	 * @brief 构造函数
+	 * @param nchannel   通道数量
+	 * @param capacity   容量, 即最多保存的数据条数
+	 * @param resolution 时间分辨率, 量纲: 秒
+	 */
+	TelemetryRing(int nchannel, int capacity, double resolution);
+	virtual ~TelemetryRing();
+
+protected:
+	/* 数据类型 */
+	typedef boost::unique_lock<boost::mutex> mutex_lock;	//< 互斥锁
+
+protected:
+	/* 成员变量 */
+	int nchannel_;		//< 通道数量
+	int capacity_;		//< 容量
+	double resolution_;	//< 时间分辨率, 量纲: 秒
+	int head_;			//< 下一条数据的存储位置
+	int count_;			//< 已存储数据数量
+	boost::scoped_array<double> time_;	//< 时间标签
+	boost::scoped_array<float> value_;	//< 各通道数据. 第i通道存储于[i * capacity_, (i + 1) * capacity_)
+	boost::mutex mtx_;	//< 互斥锁: 追加与查询在不同线程中执行
+
+public:
+	/*!
+	 * @brief 追加一条数据
+	 * @param t      时间标签, 量纲: 秒, UNIX时间
+	 * @param values 各通道数据, 长度不小于通道数量
+	 * @note
+	 * 与最后一条数据的时间间隔小于分辨率(或时钟回拨)时, 覆盖最后一条数据的数值, 其时间标签不变.
+	 * 因此采样间隔小于分辨率时, 每个分辨率间隔仍保存一条数据
+	 */
+	void Append(double t, const float* values);
+	/*!
+	 * @brief 统计时间窗内单一通道的数据
+	 * @param channel 通道序号
+	 * @param from    时间窗起点, 量纲: 秒, UNIX时间. 终点为最后一条数据
+	 * @param stat    统计结果
+	 * @return
+	 * 时间窗内有数据时返回true
+	 */
+	bool Query(int channel, double from, TrendStat& stat);
+	/*!
+	 * @brief 查看通道数量
+	 */
+	int GetChannelCount();
+	/*!
+	 * @brief 查看已存储数据数量
+	 */
+	int GetCount();
+
+protected:
+	/*!
+	 * @brief 将逻辑序号转换为存储位置
+	 * @param i 逻辑序号, 0对应最早的数据
+	 * @return
+	 * 存储位置
+	 */
+	int physical(int i);
+	/*!
+	 * @brief 查找时间不早于t的第一条数据
+	 * @param t 时间
+	 * @return
+	 * 逻辑序号. 全部数据早于t时返回count_
+	 */
+	int lower_bound(double t);
+};
+typedef boost::shared_ptr<TelemetryRing> TrendPtr;
+/*!
+ * @brief 工厂函数, 创建时间序列
+ * @param nchannel   通道数量
+ * @param hours      保存时长, 量纲: 小时
+ * @param resolution 时间分辨率, 量纲: 秒
+ * @return
+ * 时间序列指针
+ */
+extern TrendPtr make_trend(int nchannel, double hours, double resolution);
+
+#endif /* TELEMETRYRING_H_ */
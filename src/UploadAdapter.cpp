@@ -0,0 +1,110 @@
+/**
+ * @file UploadAdapter.cpp 监测数据上传方式定义文件
+ * @date 2026-10-17
+ * @version 0.2
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <boost/make_shared.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
+#include "UploadAdapter.h"
+
+AdapterPtr make_adapter(const string& bulk) {
+	if (bulk.empty()) return boost::make_shared<SampleAdapter>();
+	return boost::make_shared<BulkAdapter>(bulk);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int SampleAdapter::Upload(DataTransfer& db, const UploadSample* samples, int n, char* status) {
+	int i, rslt;
+	for (i = 0, rslt = 0; i < n && !rslt; ++i) {
+		const UploadSample &sample = samples[i];
+		if (sample.type == UPLOAD_TEMPERATURE) {
+			rslt = db.uploadTemperature(sample.gid, sample.uid, sample.cid, sample.voltage, sample.current,
+					sample.thot, sample.coolget, sample.coolset, sample.utc, status);
+		}
+		else {
+			rslt = db.uploadVacuum(sample.gid, sample.uid, sample.cid, sample.voltage, sample.current,
+					sample.pressure, sample.utc, status);
+		}
+	}
+	return rslt ? i - 1 : i;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+BulkAdapter::BulkAdapter(const string& action) {
+	action_ = action;
+	body_.reserve(UPLOAD_BATCH * 192);
+}
+
+/*
+ * @note
+ * 服务器整批拒绝时无法得知被拒绝的数据, 改为逐条上传该批数据: 返回值指向第一条失败数据,
+ * 由DataUploader对其单独计数重试, 不会因一条异常数据丢弃同批的其它数据.
+ * 服务器失效时逐条上传在第一条即失败, 仅多一个请求
+ */
+int BulkAdapter::Upload(DataTransfer& db, const UploadSample* samples, int n, char* status) {
+	body_.clear();
+	for (int i = 0; i < n; ++i) append_line(samples[i]);
+	if (!db.uploadBulk(action_.c_str(), BULK_CONTENT_TYPE, body_.data(), body_.size(), status)) return n;
+	return single_.Upload(db, samples, n, status);
+}
+
+void BulkAdapter::append_string(const char* name, const char* value, size_t size) {
+	static const char hex[] = "0123456789abcdef";
+	const char *end = value + strnlen(value, size);
+
+	body_ += '"';
+	body_ += name;
+	body_ += "\":\"";
+	for (; value != end; ++value) {
+		unsigned char ch = *value;
+		if (ch == '"' || ch == '\\') {
+			body_ += '\\';
+			body_ += ch;
+		}
+		else if (ch < 0x20) {
+			body_ += "\\u00";
+			body_ += hex[ch >> 4];
+			body_ += hex[ch & 0x0F];
+		}
+		else body_ += ch;
+	}
+	body_ += "\",";
+}
+
+/*
+ * @note JSON不能表示inf与nan, 以null代替
+ */
+void BulkAdapter::append_number(const char* name, const char* fmt, double value) {
+	char buff[32];
+	int n;
+
+	body_ += '"';
+	body_ += name;
+	body_ += "\":";
+	if (!boost::math::isfinite(value)) body_ += "null";
+	else if ((n = snprintf(buff, sizeof(buff), fmt, value)) > 0)
+		body_.append(buff, n < int(sizeof(buff)) ? n : int(sizeof(buff)) - 1);
+	else body_ += "null";
+	body_ += ',';
+}
+
+void BulkAdapter::append_line(const UploadSample& sample) {
+	body_ += sample.type == UPLOAD_TEMPERATURE ? "{\"type\":\"temperature\"," : "{\"type\":\"vacuum\",";
+	append_string("groupId", sample.gid, sizeof(sample.gid));
+	append_string("unitId",  sample.uid, sizeof(sample.uid));
+	append_string("camId",   sample.cid, sizeof(sample.cid));
+	append_string("time",    sample.utc, sizeof(sample.utc));
+	append_number("voltage", "%.3f", sample.voltage);
+	append_number("current", "%.3f", sample.current);
+	if (sample.type == UPLOAD_TEMPERATURE) {
+		append_number("thot",    "%.2f", sample.thot);
+		append_number("coolget", "%.2f", sample.coolget);
+		append_number("coolset", "%.2f", sample.coolset);
+	}
+	else append_number("pressure", "%g", sample.pressure);
+	body_[body_.size() - 1] = '}';
+	body_ += '\n';
+}
@@ -0,0 +1,95 @@
+/**
+ * @file UploadAdapter.h 监测数据上传方式声明文件
+ * @date 2026-10-17
+ * @version 0.1
+ * @note
+ * - DataUploader通过UploadAdapter上传一批数据, 上传方式可替换
+ * - SampleAdapter: 每条数据一个multipart请求, 对应uploadTemperature.action与uploadVacuum.action.
+ *   服务器未提供批量接口时采用
+ * - BulkAdapter: 一批数据编码为JSON Lines(每行一个JSON对象), 以一个请求上传. 服务器整批接收或整批拒绝
+ * @version 0.2
+ * @note
+ * - BulkAdapter: 字符串按JSON规则转义, 非有限数值编码为null
+ * - BulkAdapter: 整批被拒绝后逐条上传该批数据, 定位失败数据
+ */
+
+#ifndef UPLOADADAPTER_H_
+#define UPLOADADAPTER_H_
+
+#include <string>
+#include <boost/smart_ptr.hpp>
+#include "DataUploader.h"
+
+#define BULK_CONTENT_TYPE	"application/x-ndjson"	//< 批量请求体类型
+
+class UploadAdapter : private boost::noncopyable {
+public:
+	virtual ~UploadAdapter() {}
+
+public:
+	/*!
+	 * @brief 上传一批数据
+	 * @param db      数据库访问接口
+	 * @param samples 监测数据
+	 * @param n       数据数量
+	 * @param status  错误信息
+	 * @return
+	 * 从首条起连续上传成功的数据数量. 小于n时, status为第一条失败数据的错误信息
+	 */
+	virtual int Upload(DataTransfer& db, const UploadSample* samples, int n, char* status) = 0;
+};
+typedef boost::shared_ptr<UploadAdapter> AdapterPtr;
+
+class SampleAdapter : public UploadAdapter {
+public:
+	int Upload(DataTransfer& db, const UploadSample* samples, int n, char* status);
+};
+
+class BulkAdapter : public UploadAdapter {
+public:
+	/*!
+	 * @brief 构造函数
+	 * @param action 服务器批量上传动作, 如uploadBulk.action
+	 */
+	BulkAdapter(const string& action);
+
+protected:
+	/* 成员变量 */
+	string action_;	//< 服务器批量上传动作
+	string body_;	//< 请求体. 在批次之间复用存储空间
+	SampleAdapter single_;	//< 整批被拒绝时逐条上传
+
+public:
+	int Upload(DataTransfer& db, const UploadSample* samples, int n, char* status);
+
+protected:
+	/*!
+	 * @brief 将一条数据编码为一行JSON, 追加至请求体
+	 * @param sample 监测数据
+	 */
+	void append_line(const UploadSample& sample);
+	/*!
+	 * @brief 向请求体追加一个字符串字段, 字符串按JSON规则转义
+	 * @param name  字段名
+	 * @param value 字段值
+	 * @param size  字段值存储空间长度
+	 */
+	void append_string(const char* name, const char* value, size_t size);
+	/*!
+	 * @brief 向请求体追加一个数值字段
+	 * @param name  字段名
+	 * @param fmt   格式
+	 * @param value 字段值. 非有限数值编码为null
+	 */
+	void append_number(const char* name, const char* fmt, double value);
+};
+
+/*!
+ * @brief 工厂函数, 创建上传方式
+ * @param bulk 服务器批量上传动作. 空: 逐条上传
+ * @return
+ * 上传方式指针
+ */
+extern AdapterPtr make_adapter(const string& bulk);
+
+#endif /* UPLOADADAPTER_H_ */
@@ -0,0 +1,227 @@
+/**
+ * @file UploadSpool.cpp 上传失败监测数据的磁盘缓存定义文件
+ * @date 2026-10-16
+ * @version 0.1
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <boost/make_shared.hpp>
+#include <boost/filesystem.hpp>
+#include "UploadSpool.h"
+
+#define SPOOL_MAGIC		"CAMSPOOL"	//< 文件标志
+#define SPOOL_VERSION	1			//< 文件格式版本
+#define SPOOL_COMMIT	0x5350A5A5	//< 记录提交标志
+#define SPOOL_HEADSIZE	64			//< 文件头占用字节数
+
+UploadSpool::UploadSpool(const string& dir, int budget) {
+	dir_     = dir;
+	maxseg_  = int((int64_t) budget * 1024 * 1024 / SPOOL_SEGMENT);
+	if (maxseg_ < 2) maxseg_ = 2;
+	pending_ = 0;
+	dropped_ = 0;
+}
+
+UploadSpool::~UploadSpool() {
+	Close();
+}
+
+bool UploadSpool::Open() {
+	Close();
+	if (access(dir_.c_str(), F_OK)) mkdir(dir_.c_str(), 0755);	// 创建目录
+	if (access(dir_.c_str(), W_OK | X_OK)) return false;
+
+	// 查找已有段文件
+	namespace fs = boost::filesystem;
+	std::vector<uint32_t> seqs;
+	boost::system::error_code ec;
+	for (fs::directory_iterator it(dir_, ec), end; !ec && it != end; it.increment(ec)) {
+		unsigned int seq;
+		char tail;
+		if (sscanf(it->path().filename().string().c_str(), "spool-%08x.dat%c", &seq, &tail) == 1)
+			seqs.push_back(seq);
+	}
+	std::sort(seqs.begin(), seqs.end());
+
+	for (std::vector<uint32_t>::iterator it = seqs.begin(); it != seqs.end(); ++it) {
+		SegmentPtr seg = map_segment(*it, false);
+		if (!seg.use_count()) {
+			remove(segment_path(*it).c_str());
+			continue;
+		}
+		// 提交标志与校验和有效的连续记录. 之后的记录未完整写入
+		SpoolHeader *header = seg->header;
+		uint32_t w;
+		for (w = 0; w < header->capacity && seg->record[w].commit == SPOOL_COMMIT
+				&& seg->record[w].check == checksum(seg->record[w].sample); ++w);
+		seg->write = w;
+		if (header->read > w) header->read = w;
+		if (header->read == w && (w == header->capacity || it + 1 != seqs.end())) {// 已回放完成
+			seg.reset();
+			remove(segment_path(*it).c_str());
+			continue;
+		}
+		pending_ += w - header->read;
+		segments_.push_back(seg);
+	}
+	while (int(segments_.size()) > maxseg_) remove_front();
+
+	return true;
+}
+
+void UploadSpool::Close() {
+	Flush();
+	segments_.clear();
+	pending_ = 0;
+}
+
+bool UploadSpool::Append(const UploadSample& sample) {
+	if (segments_.empty() || segments_.back()->write >= segments_.back()->header->capacity) {
+		uint32_t seq = segments_.empty() ? 0 : segments_.back()->seq + 1;
+		SegmentPtr seg = map_segment(seq, true);
+		if (!seg.use_count()) return false;
+		if (segments_.size()) segments_.back()->region.flush(0, 0, true);
+		segments_.push_back(seg);
+		while (int(segments_.size()) > maxseg_) remove_front();	// 超出磁盘预算: 丢弃最早的数据
+	}
+
+	Segment &seg = *segments_.back();
+	SpoolRecord &rec = seg.record[seg.write];
+	memcpy(&rec.sample, &sample, sizeof(UploadSample));
+	rec.check  = checksum(rec.sample);
+	__sync_synchronize();	// 数据写入后再写入提交标志
+	rec.commit = SPOOL_COMMIT;
+	++seg.write;
+	++pending_;
+
+	return true;
+}
+
+int UploadSpool::Peek(SampleVec& batch, int max) {
+	int n(0);
+	batch.clear();
+	for (SegmentQueue::iterator it = segments_.begin(); it != segments_.end() && n < max; ++it) {
+		Segment &seg = **it;
+		for (uint32_t i = seg.header->read; i < seg.write && n < max; ++i, ++n)
+			batch.push_back(seg.record[i].sample);
+	}
+	return n;
+}
+
+void UploadSpool::Consume(int n) {
+	while (n > 0 && !segments_.empty()) {
+		Segment &seg = *segments_.front();
+		int m = std::min(n, int(seg.write - seg.header->read));
+		seg.header->read += m;
+		pending_ -= m;
+		n -= m;
+		// 正在写入的段文件保留至写满
+		if (seg.header->read == seg.write && (segments_.size() > 1 || seg.write == seg.header->capacity))
+			remove_front();
+		else if (!m) break;
+	}
+}
+
+void UploadSpool::Flush() {
+	if (segments_.size()) {
+		segments_.front()->region.flush(0, 0, true);
+		if (segments_.size() > 1) segments_.back()->region.flush(0, 0, true);
+	}
+}
+
+int UploadSpool::GetPending() {
+	return pending_;
+}
+
+uint64_t UploadSpool::GetDropped() {
+	return dropped_;
+}
+
+UploadSpool::SegmentPtr UploadSpool::map_segment(uint32_t seq, bool create) {
+	string path = segment_path(seq);
+	uint32_t capacity = (SPOOL_SEGMENT - SPOOL_HEADSIZE) / sizeof(SpoolRecord);
+	SegmentPtr seg;
+
+	if (create) {// 创建文件: 文件内容初始为0, 即全部记录无提交标志
+		int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) return seg;
+		bool success = !ftruncate(fd, SPOOL_SEGMENT);
+		close(fd);
+		if (!success) return seg;
+	}
+	else {
+		struct stat st;
+		if (stat(path.c_str(), &st) || st.st_size != SPOOL_SEGMENT) return seg;
+	}
+
+	try {
+		file_mapping file(path.c_str(), boost::interprocess::read_write);
+		mapped_region region(file, boost::interprocess::read_write, 0, SPOOL_SEGMENT);
+		seg = boost::make_shared<Segment>();
+		seg->region.swap(region);
+	}
+	catch(boost::interprocess::interprocess_exception& ex) {
+		return SegmentPtr();
+	}
+
+	char *base = (char*) seg->region.get_address();
+	seg->seq    = seq;
+	seg->path   = path;
+	seg->header = (SpoolHeader*) base;
+	seg->record = (SpoolRecord*) (base + SPOOL_HEADSIZE);
+	seg->write  = 0;
+	if (create) {
+		SpoolHeader *header = seg->header;
+		memcpy(header->magic, SPOOL_MAGIC, sizeof(header->magic));
+		header->version  = SPOOL_VERSION;
+		header->recsize  = sizeof(SpoolRecord);
+		header->capacity = capacity;
+		header->read     = 0;
+	}
+	else {// 格式不一致的文件视为无效
+		SpoolHeader *header = seg->header;
+		if (memcmp(header->magic, SPOOL_MAGIC, sizeof(header->magic))
+				|| header->version != SPOOL_VERSION
+				|| header->recsize != sizeof(SpoolRecord)
+				|| header->capacity != capacity)
+			seg.reset();
+	}
+	return seg;
+}
+
+void UploadSpool::remove_front() {
+	SegmentPtr seg = segments_.front();
+	int left = seg->write - seg->header->read;
+	pending_ -= left;
+	dropped_ += left;
+	string path = seg->path;
+	segments_.pop_front();
+	seg.reset();	// 解除映射后删除文件
+	remove(path.c_str());
+}
+
+string UploadSpool::segment_path(uint32_t seq) {
+	char name[32];
+	sprintf(name, "spool-%08x.dat", seq);
+	boost::filesystem::path path = dir_;
+	path /= name;
+	return path.string();
+}
+
+/*
+ * @note FNV-1a. 记录以memcpy写入, 填充字节与校验和一致
+ */
+uint32_t UploadSpool::checksum(const UploadSample& sample) {
+	const unsigned char *p = (const unsigned char*) &sample;
+	uint32_t h = 2166136261U;
+	for (size_t i = 0; i < sizeof(UploadSample); ++i) {
+		h ^= p[i];
+		h *= 16777619U;
+	}
+	return h;
+}
@@ -0,0 +1,147 @@
+/**
+ * @file UploadSpool.h 上传失败监测数据的磁盘缓存声明文件
+ * @date 2026-10-16
+ * @version 0.1
+ * @note
+ * - 数据库服务器不可用时, 监测数据追加写入内存映射的段文件, 服务器恢复后按序回放
+ * - 段文件大小固定为SPOOL_SEGMENT, 文件名为spool-<序号>.dat. 总容量超出磁盘预算时删除最早的段文件
+ * - 每条记录最后写入提交标志, 程序崩溃时不完整的记录被忽略
+ * - 段文件头记录已回放位置, 回放后更新. 重启后从该位置继续回放, 最多重复上传最后一批数据
+ * - 全部段文件回放完成后删除
+ * - 非线程安全, 仅由DataUploader的上传线程访问
+ */
+
+#ifndef UPLOADSPOOL_H_
+#define UPLOADSPOOL_H_
+
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <boost/smart_ptr.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "DataUploader.h"
+
+#define SPOOL_SEGMENT		(1024 * 1024)	//< 段文件大小, 量纲: 字节
+
+class UploadSpool : private boost::noncopyable {
+public:
+	/*!
+	 * @brief 构造函数
+	 * @param dir    段文件所在目录
+	 * @param budget 磁盘预算, 量纲: MB
+	 */
+	UploadSpool(const string& dir, int budget = SPOOL_BUDGET);
+	virtual ~UploadSpool();
+
+public:
+	/* 数据类型 */
+	typedef std::vector<UploadSample> SampleVec;	//< 数据集合
+
+protected:
+	struct SpoolHeader {// 段文件头
+		char magic[8];		//< 文件标志
+		uint32_t version;	//< 文件格式版本
+		uint32_t recsize;	//< 单条记录字节数
+		uint32_t capacity;	//< 记录容量
+		uint32_t read;		//< 已回放记录数量
+	};
+
+	struct SpoolRecord {// 单条记录
+		uint32_t commit;	//< 提交标志, 最后写入
+		uint32_t check;		//< 校验和
+		UploadSample sample;	//< 监测数据
+	};
+
+	typedef boost::interprocess::file_mapping file_mapping;
+	typedef boost::interprocess::mapped_region mapped_region;
+
+	struct Segment {// 段文件
+		uint32_t seq;			//< 序号
+		string path;			//< 文件路径
+		mapped_region region;	//< 内存映射区
+		SpoolHeader *header;	//< 文件头
+		SpoolRecord *record;	//< 记录区
+		uint32_t write;			//< 已写入记录数量
+	};
+	typedef boost::shared_ptr<Segment> SegmentPtr;
+	typedef std::deque<SegmentPtr> SegmentQueue;
+
+protected:
+	/* 成员变量 */
+	string dir_;			//< 段文件所在目录
+	int maxseg_;			//< 段文件最大数量
+	SegmentQueue segments_;	//< 段文件, 按序号排列
+	int pending_;			//< 尚未回放的记录数量
+	uint64_t dropped_;		//< 因超出磁盘预算丢弃的记录数量
+
+public:
+	/*!
+	 * @brief 创建目录并恢复已有段文件
+	 * @return
+	 * 目录不可访问时返回false
+	 */
+	bool Open();
+	/*!
+	 * @brief 关闭全部段文件
+	 */
+	void Close();
+	/*!
+	 * @brief 追加一条记录
+	 * @param sample 监测数据
+	 * @return
+	 * 创建段文件失败时返回false
+	 */
+	bool Append(const UploadSample& sample);
+	/*!
+	 * @brief 从回放位置起复制记录, 不移动回放位置
+	 * @param batch 记录存储区
+	 * @param max   最大记录数量
+	 * @return
+	 * 复制的记录数量
+	 */
+	int Peek(SampleVec& batch, int max);
+	/*!
+	 * @brief 移动回放位置, 删除已回放完成的段文件
+	 * @param n 已回放记录数量
+	 */
+	void Consume(int n);
+	/*!
+	 * @brief 将已修改的映射区异步写入磁盘
+	 */
+	void Flush();
+	/*!
+	 * @brief 查看尚未回放的记录数量
+	 */
+	int GetPending();
+	/*!
+	 * @brief 查看因超出磁盘预算丢弃的记录数量
+	 */
+	uint64_t GetDropped();
+
+protected:
+	/*!
+	 * @brief 映射段文件
+	 * @param seq    序号
+	 * @param create true: 创建新文件; false: 打开已有文件
+	 * @return
+	 * 段文件. 文件无效时返回空指针
+	 */
+	SegmentPtr map_segment(uint32_t seq, bool create);
+	/*!
+	 * @brief 删除最早的段文件
+	 */
+	void remove_front();
+	/*!
+	 * @brief 生成段文件路径
+	 */
+	string segment_path(uint32_t seq);
+	/*!
+	 * @brief 计算监测数据校验和
+	 */
+	static uint32_t checksum(const UploadSample& sample);
+};
+typedef boost::shared_ptr<UploadSpool> SpoolPtr;
+
+#endif /* UPLOADSPOOL_H_ */
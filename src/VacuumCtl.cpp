@@ -7,13 +7,16 @@
 #include <boost/make_shared.hpp>
 #include <boost/format.hpp>
 #include <stdlib.h>
+#include <boost/algorithm/string.hpp>
 #include "AMath.h"
 #include "VacuumCtl.h"
 #include "GLog.h"
 using namespace boost::posix_time;
 
 //////////////////////////////////////////////////////////////////////////////
-static uint8_t VACUUM_MONITOR[] = { VFID_READ_CUR, VFID_READ_PRES, VFID_READ_VOL };
+static uint8_t VACUUM_MONITOR[] = { VFID_READ_CUR, VFID_READ_PRES, VFID_READ_VOL };	//< 缺省监测列表
+
+static const char* VACUUM_TREND[] = { "voltage", "current", "pressure" };	//< 时间序列通道名称
 
 VacuumCPtr make_vacuum() {
 	return boost::make_shared<VacuumCtl>();
@@ -22,9 +25,13 @@ VacuumCPtr make_vacuum() {
 VacuumCtl::VacuumCtl() {
 	tail_ = "\r";
 	ntail_ = tail_.size();
+
+	int n = sizeof(VACUUM_MONITOR) / sizeof(uint8_t);
+	for (int i = 0; i < n; ++i) SetPollRate(VACUUM_MONITOR[i]);
 }
 
 VacuumCtl::~VacuumCtl() {
+	Stop(); // 先于派生类成员析构停止状态机
 }
 
 void VacuumCtl::check_data(int nDev) {
@@ -34,16 +41,6 @@ void VacuumCtl::check_data(int nDev) {
 	}
 }
 
-void VacuumCtl::generate_directive(uint8_t idd) {
-	int n = sizeof(VACUUM_MONITOR) / sizeof(uint8_t);
-	uint8_t idf;
-	for (int i = 0; i < n; ++i) {
-		Directive one(idf = VACUUM_MONITOR[i]);
-		one.len = ControllerBase::encode_data(idd, idf, one.msg);
-		append_directive(one);
-	}
-}
-
 int VacuumCtl::encode_data(uint8_t idd, uint8_t idf, const char *value, int n, char *output) {
 	int i(-1);
 	uint8_t lrc(0), t, base_0(0x30), base_1(0x37);
@@ -70,23 +67,25 @@ int VacuumCtl::encode_data(uint8_t idd, uint8_t idf, const char *value, int n, c
 	return i;
 }
 
-int VacuumCtl::decode_data(int len) {
+int VacuumCtl::decode_data(const char *frame, int len, uint8_t& idd, uint8_t& idf) {
 	if ((len < 12)) return -1;	// 格式错误
+	if ((len - 4) / 2 >= 32) return -2;	// 数据超出存储区
 
 	int first(6), last(len - 5), i, j;
-	Directive one = drct_.front();
-	string strval;
-	char *ptr = bufrcv_.get();
-	uint8_t idd, idf;
+	char strval[32];
+	const char *ptr = frame;
 
 	idd = decode_uint8(ptr[0], ptr[1]);
-	idf = one.idf;
-	for (i = first, j = 0; i <= last; i += 2, ++j) strval += decode_uint8(ptr[i], ptr[i + 1]);
+	idf = drctCur_.idf;	// 应答不含功能编号, 取自已发送指令
+	for (i = first, j = 0; i <= last; i += 2, ++j) strval[j] = decode_uint8(ptr[i], ptr[i + 1]);
+	strval[j] = 0;
+	// 功能编号取自当前指令: 无待应答指令或设备编号不符时(如迟到的应答)无法确定数据含义
+	if (!busy_ || idd != drctCur_.idd) return 0;
 
 	VacuumData *data = find_device(idd);
 	if (data) {// 分类处理
-		if      (idf == VFID_READ_CUR)  data->set_current(atof(strval.c_str()));
-		else if (idf == VFID_READ_VOL)  data->set_voltage(atof(strval.c_str()));
+		if      (idf == VFID_READ_CUR)  data->set_current(atof(strval));
+		else if (idf == VFID_READ_VOL)  data->set_voltage(atof(strval));
 		else if (idf == VFID_READ_PRES) data->set_pressure(strval);
 	}
 
@@ -99,33 +98,53 @@ void VacuumCtl::write_log() {
 		VacuumData& data = data_[i];
 		if (!data.dirty) continue;
 		data.dirty = false;
-		_gLog.Write("Cooler<%d>: (Voltage, Current, Pressure) = %.1f  %.1f  %s",
+		_gLog.Write("Vacuum<%d>: (Voltage, Current, Pressure) = %.1f  %.1f  %s",
 				data.idd, data.vol, data.cur, data.pres.c_str());
 	}
 }
 
+/*
+ * @note 尚未读出气压的设备不上传
+ */
 void VacuumCtl::upload_database() {
+	string now = to_iso_extended_string(second_clock::universal_time());
+	int n = data_.size();
+	UploadSample sample;
 
+	sample.type = UPLOAD_VACUUM;
+	strncpy(sample.gid, grpid_.c_str(), sizeof(sample.gid) - 1);
+	strncpy(sample.utc, now.c_str(), sizeof(sample.utc) - 1);
+	for (int i = 0; i < n; ++i) {
+		VacuumData& x = data_[i];
+		if (x.pres.empty()) continue;
+		sprintf(sample.uid, "%03d", x.idd / 10);
+		sprintf(sample.cid, "%03d", x.idd);
+		sample.voltage  = x.vol;
+		sample.current  = x.cur;
+		sample.pressure = atof(x.pres.c_str());
+		db_->Push(sample);
+	}
 }
 
 void VacuumCtl::network_respond() {
 	int n = data_.size(), len;
-	boost::format fmt("%03d");
-	apvacuum proto = boost::make_shared<ascii_proto_vacuum>();
-	uint8_t idd;
-	const char *tosend;
+	ascii_proto_vacuum proto;
+	char uid[8], cid[8], tosend[ASCII_LINE_MAX];
 
+	proto.gid = grpid_;
 	for (int i = 0; i < n; ++i) {
 		VacuumData& data = data_[i];
-		proto->gid = grpid_;
-		proto->uid = (fmt % (data.idd / 10)).str();
-		proto->cid = (fmt % data.idd).str();
-		proto->voltage = data.vol;
-		proto->current = data.cur;
-		proto->pressure= data.pres;
-		tosend = ascproto_->CompactVacuum(proto, len);
-		tcp_->Write(tosend, len);
+		sprintf(uid, "%03d", data.idd / 10);
+		sprintf(cid, "%03d", data.idd);
+		proto.uid = uid;
+		proto.cid = cid;
+		proto.voltage = data.vol;
+		proto.current = data.cur;
+		proto.pressure= data.pres;
+		if ((len = ascproto_->SerializeVacuum(proto, tosend, ASCII_LINE_MAX)))
+			tcp_->Write(tosend, len, false, 0x200 | data.idd); // 键值: 设备类型与编号
 	}
+	tcp_->Flush(); // 全部设备的数据合并发送
 }
 
 VacuumData* VacuumCtl::find_device(uint8_t idd) {
@@ -133,3 +152,22 @@ VacuumData* VacuumCtl::find_device(uint8_t idd) {
 	for (i = 0; i < n && data_[i].idd != idd; ++i);
 	return i == n ? NULL : &data_[i];
 }
+
+int VacuumCtl::trend_width() {
+	return sizeof(VACUUM_TREND) / sizeof(char*);
+}
+
+int VacuumCtl::trend_channel(const string& name) {
+	int n = trend_width(), i;
+	for (i = 0; i < n && !boost::iequals(name, VACUUM_TREND[i]); ++i);
+	return i == n ? -1 : i;
+}
+
+bool VacuumCtl::trend_sample(uint8_t idd, float* values) {
+	VacuumData *data = find_device(idd);
+	if (!data || data->pres.empty()) return false;
+	values[0] = data->vol;
+	values[1] = data->cur;
+	values[2] = atof(data->pres.c_str());
+	return true;
+}
@@ -5,6 +5,12 @@
  * - 维护串口连接
  * - 维护设备
  * - 监测压力与电压、电流
+ *
+ * @version 0.2
+ * - 在时间序列中保存电压、电流与压力
+ *
+ * @version 0.3
+ * - 通过DataUploader异步、批量上传电压、电流与压力至数据库
  */
 
 #ifndef VACUUMCTL_H_
@@ -30,6 +36,12 @@ struct VacuumData {// 单真空控制器数据
 	double vol;		//< 实时电压
 
 public:
+	VacuumData() {
+		dirty = false;
+		idd = 0;
+		cur = vol = 0.0;
+	}
+
 	void set_current(double value) {
 		if (value != cur) {
 			cur = value;
@@ -69,11 +81,6 @@ protected:
 	 * @param nDev 设备数量
 	 */
 	void check_data(int nDev);
-	/*!
-	 * @brief 为指定设备生成控制指令
-	 * @param idd 设备编号
-	 */
-	void generate_directive(uint8_t idd);
 	/*!
 	 * @brief 依照串口通信协议, 对数据进行编码
 	 * @param idd    设备编号
@@ -89,14 +96,17 @@ protected:
 	int encode_data(uint8_t idd, uint8_t idf, const char *value, int n, char *output);
 	/*!
 	 * @brief 解码数据串
+	 * @param frame  待解码数据串, 包含起始和结束标志
 	 * @param len    待解码数据串长度, 量纲: 字节
+	 * @param idd    解码得到的设备编号
+	 * @param idf    解码得到的功能编号
 	 * @return
 	 * 数据串解码结果
 	 *  0: 成功
 	 * -1: 长度不足
 	 * -2: 数据长度不足
 	 */
-	int decode_data(int len);
+	int decode_data(const char *frame, int len, uint8_t& idd, uint8_t& idf);
 	/*!
 	 * @brief 在日志中记录最新工作状态
 	 */
@@ -116,6 +126,27 @@ protected:
 	 * 与设备编号对应的数据存储区指针
 	 */
 	VacuumData* find_device(uint8_t idd);
+	/*!
+	 * @brief 查看时间序列的通道数量
+	 * @return
+	 * 通道数量
+	 */
+	int trend_width();
+	/*!
+	 * @brief 查找通道名称对应的通道序号
+	 * @param name 通道名称: voltage, current, pressure
+	 * @return
+	 * 通道序号. -1表示无效名称
+	 */
+	int trend_channel(const string& name);
+	/*!
+	 * @brief 采集设备当前各通道数据
+	 * @param idd    设备编号
+	 * @param values 各通道数据
+	 * @return
+	 * 设备数据有效时返回true
+	 */
+	bool trend_sample(uint8_t idd, float* values);
 };
 typedef boost::shared_ptr<VacuumCtl> VacuumCPtr;
 extern VacuumCPtr make_vacuum();
@@ -8,6 +8,7 @@
 #include <boost/asio.hpp>
 #include "globaldef.h"
 #include "GLog.h"
+#include "IOServiceKeep.h"
 #include "AnnexControl.h"
 #include "daemon.h"
 
@@ -41,16 +42,22 @@ int main(int argc, char** argv) {
 		}
 
 		_gLog.Write("Try to launch %s %s %s as daemon", DAEMON_NAME, DAEMON_VERSION, DAEMON_AUTHORITY);
-		// 主程序入口
-		AnnexControl ac(&ios);
-		if (ac.StartService()) {
-			_gLog.Write("Daemon goes running");
-			ios.run();
-			ac.StopService();
-		}
-		else {
-			_gLog.Write(LOG_FAULT, NULL, "Fail to launch %s", DAEMON_NAME);
+		// 串口与网络接口共用线程池. 须在创建守护进程之后创建线程
+		IOPoolPtr pool = make_iopool();
+		IOServiceKeep::SetPool(pool);
+		_gLog.Write("I/O thread pool: %d threads", pool->get_thread_count());
+		{// 主程序入口
+			AnnexControl ac(&ios);
+			if (ac.StartService()) {
+				_gLog.Write("Daemon goes running");
+				ios.run();
+				ac.StopService();
+			}
+			else {
+				_gLog.Write(LOG_FAULT, NULL, "Fail to launch %s", DAEMON_NAME);
+			}
 		}
+		pool->stop(); // 在主线程中停止线程池并等待I/O线程结束
 		_gLog.Write("Daemon stopped");
 	}
 
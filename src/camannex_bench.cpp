@@ -0,0 +1,343 @@
+/**
+ Name        : camannex_bench.cpp 串口轮询性能测试程序
+ Author      : Xiaomeng Lu
+ Version     : 0.1
+ Copyright   : SVOM Group, NAOC
+ Description : 在仿真串口上运行温控/真空控制接口, 统计监测轮次耗时、指令往返时间、
+               信息帧吞吐率及单帧CPU时间与内存分配次数
+ @note
+ - 仿真器运行于子进程, 统计结果仅包含控制接口所在进程
+ - 子进程须在创建任何线程之前fork
+ - 控制接口日志写入文件(-L), 标准输出仅包含统计结果
+ */
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include "globaldef.h"
+#include "GLog.h"
+#include "AllocCounter.h"
+#include "IOServiceKeep.h"
+#include "DeviceEmulator.h"
+#include "CoolerCtl.h"
+#include "VacuumCtl.h"
+#include "TelemetryRing.h"
+
+using std::string;
+using std::vector;
+
+GLog _gLog(stderr);
+
+//////////////////////////////////////////////////////////////////////////////
+/*---------------- 往返时间采样 ----------------*/
+class RTTSampler {
+public:
+	RTTSampler() {
+		samples_.reserve(1 << 20);
+		enable_ = false;
+	}
+
+protected:
+	vector<double> samples_;	//< 往返时间, 量纲: 毫秒
+	bool enable_;				//< 采样标志
+	boost::mutex mtx_;			//< 互斥锁
+
+public:
+	void Enable(bool enable) {
+		boost::unique_lock<boost::mutex> lck(mtx_);
+		if ((enable_ = enable)) samples_.clear();
+	}
+
+	/*!
+	 * @brief 控制接口回调函数, 记录成功指令的往返时间
+	 * @note
+	 * 预分配存储区, 采样过程不分配内存
+	 */
+	void OnTrace(long, const ControllerBase::CommandResult& rslt) {
+		boost::unique_lock<boost::mutex> lck(mtx_);
+		if (enable_ && rslt.success && samples_.size() < samples_.capacity()) samples_.push_back(rslt.rtt);
+	}
+
+	/*!
+	 * @brief 计算分位数
+	 * @param q 分位, [0, 1]
+	 * @return
+	 * 往返时间分位数, 量纲: 毫秒
+	 */
+	double Percentile(double q) {
+		boost::unique_lock<boost::mutex> lck(mtx_);
+		if (samples_.empty()) return 0.0;
+		std::sort(samples_.begin(), samples_.end());
+		int i = int(q * (samples_.size() - 1) + 0.5);
+		return samples_[i];
+	}
+};
+
+//////////////////////////////////////////////////////////////////////////////
+struct BenchParam {// 测试参数
+	string type;		//< 设备类型: cooler, rtu, vacuum
+	string logfile;		//< 测试过程中的日志文件
+	int ndev;			//< 单串口设备数量
+	int baudrate;		//< 波特率, 用于计算帧间隔与应答时限
+	double period;		//< 监测周期, 量纲: 秒
+	int warmup;			//< 预热时间, 量纲: 秒
+	int duration;		//< 单次测试时间, 量纲: 秒
+	vector<int> ports;	//< 串口数量序列
+};
+
+static double CPUSeconds() {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1E-6;
+}
+
+/*!
+ * @brief 在前nport个仿真串口上执行一次测试
+ */
+void RunBench(const BenchParam& param, const vector<string>& portnames, int nport) {
+	vector<CtlBasePtr> ctls;
+	RTTSampler sampler;
+	const ControllerBase::CmdSlot& slot = boost::bind(&RTTSampler::OnTrace, &sampler, _1, _2);
+	int i, j;
+
+	for (i = 0; i < nport; ++i) {
+		CtlBasePtr one;
+		if (param.type == "vacuum") one = make_vacuum();
+		else {
+			CoolCPtr cooler = make_cooler();
+			cooler->SetRTU(param.type == "rtu");
+			one = cooler;
+		}
+		one->RegisterTrace(slot);
+		if (one->Start(portnames[i], param.baudrate)) {
+			printf("failed to open %s\n", portnames[i].c_str());
+			one->Stop();
+			break;
+		}
+		// 全部监测项采用同一周期, 使每轮监测包含全部指令
+		const uint8_t cooler_idf[] = { CFID_READ_VOL, CFID_READ_CUR, CFID_READ_T1, CFID_READ_T2, CFID_READ_COOLSET };
+		const uint8_t vacuum_idf[] = { VFID_READ_CUR, VFID_READ_PRES, VFID_READ_VOL };
+		if (param.type == "vacuum") {
+			for (j = 0; j < 3; ++j) one->SetPollRate(vacuum_idf[j], param.period, param.period);
+		}
+		else {
+			for (j = 0; j < 5; ++j) one->SetPollRate(cooler_idf[j], param.period, param.period);
+		}
+		for (j = 1; j <= param.ndev; ++j) one->AddDevice(uint8_t(j));
+		ctls.push_back(one);
+	}
+	if (int(ctls.size()) != nport) {// 停止已启动的控制接口, 释放定时器持有的对象引用
+		for (i = 0; i < int(ctls.size()); ++i) ctls[i]->Stop();
+		return;
+	}
+
+	boost::this_thread::sleep_for(boost::chrono::seconds(param.warmup));
+	// 开始统计
+	vector<ControllerBase::PortStat> stat0(nport);
+	for (i = 0; i < nport; ++i) stat0[i] = ctls[i]->GetStat();
+	sampler.Enable(true);
+	unsigned long alloc0 = AllocCount();
+	double cpu0 = CPUSeconds();
+	boost::posix_time::ptime t0 = boost::posix_time::microsec_clock::universal_time();
+
+	boost::this_thread::sleep_for(boost::chrono::seconds(param.duration));
+
+	double cpu1 = CPUSeconds();
+	unsigned long alloc1 = AllocCount();
+	boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
+	sampler.Enable(false);
+
+	ControllerBase::PortStat total;
+	double tsweepMax(0.0);
+	for (i = 0; i < nport; ++i) {
+		ControllerBase::PortStat one = ctls[i]->GetStat();
+		total.sent    += one.sent    - stat0[i].sent;
+		total.reply   += one.reply   - stat0[i].reply;
+		total.timeout += one.timeout - stat0[i].timeout;
+		total.retry   += one.retry   - stat0[i].retry;
+		total.invalid += one.invalid - stat0[i].invalid;
+		total.sweep   += one.sweep   - stat0[i].sweep;
+		total.tsweep  += one.tsweep  - stat0[i].tsweep;
+		if (one.tsweepMax > tsweepMax) tsweepMax = one.tsweepMax;
+	}
+	for (i = 0; i < nport; ++i) ctls[i]->Stop();
+
+	double elapsed = (t1 - t0).total_microseconds() * 1E-6;
+	double frames  = double(total.reply);
+	printf("%5d  %6lu  %8.1f %8.1f  %7.2f %7.2f %7.2f %7.2f  %9.1f  %8.1f  %8.1f  %6lu %6lu %6lu\n",
+			nport, (unsigned long) total.sweep,
+			total.sweep ? total.tsweep / total.sweep : 0.0, tsweepMax,
+			sampler.Percentile(0.5), sampler.Percentile(0.9), sampler.Percentile(0.99), sampler.Percentile(1.0),
+			frames / elapsed,
+			frames > 0 ? (cpu1 - cpu0) * 1E6 / frames : 0.0,
+			frames > 0 ? (alloc1 - alloc0) / frames : 0.0,
+			(unsigned long) total.retry, (unsigned long) total.timeout, (unsigned long) total.invalid);
+	fflush(stdout);
+}
+
+/*!
+ * @brief 检查监测数据时间序列: 采样间隔小于分辨率时, 每个分辨率间隔仍应保存一条数据
+ * @return
+ * 保存的数据条数约为时长/分辨率时返回true
+ */
+bool CheckTrend() {
+	const double resolution = 10.0, interval = 1.0;
+	const int n = 120;
+	TrendPtr trend = make_trend(1, 1.0, resolution);
+	float value;
+	int expect = int(n * interval / resolution + 0.5);
+
+	for (int i = 0; i < n; ++i) {
+		value = float(i);
+		trend->Append(1E9 + i * interval, &value);
+	}
+	int rows = trend->GetCount();
+	bool ok = rows >= expect - 1 && rows <= expect + 1;
+	printf("trend check: %d samples at %.1f s, resolution %.1f s: %d rows, expect %d. %s\n",
+			n, interval, resolution, rows, expect, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+void Usage() {
+	printf("Usage: camannex_bench [options]\n");
+	printf("  -t <type>      device type: cooler, rtu or vacuum. default: cooler\n");
+	printf("  -p <list>      comma separated port counts. default: 1,10,100\n");
+	printf("  -n <devices>   devices per port. default: 2\n");
+	printf("  -r <baud>      baud rate. default: 9600\n");
+	printf("  -P <seconds>   poll period of every function. default: 1\n");
+	printf("  -w <seconds>   warm-up time of each run. default: 3\n");
+	printf("  -d <seconds>   measuring time of each run. default: 10\n");
+	printf("  -l <ms>        emulated reply latency. default: 2\n");
+	printf("  -j <ms>        emulated reply jitter. default: 1\n");
+	printf("  -D <ratio>     ratio of dropped replies. default: 0\n");
+	printf("  -B <ratio>     ratio of replies with bad checksum, rtu only. default: 0\n");
+	printf("  -L <file>      log file of the controllers during the runs. default: camannex_bench.log\n");
+}
+
+/*!
+ * @brief 主程序
+ * @param argc 参数数量
+ * @param argv 参数列表
+ */
+int main(int argc, char** argv) {
+	BenchParam param;
+	EmulatorParam emuparam;
+	string ports("1,10,100");
+	int ch, i;
+
+	param.type     = "cooler";
+	param.logfile  = "camannex_bench.log";
+	param.ndev     = 2;
+	param.baudrate = 9600;
+	param.period   = 1.0;
+	param.warmup   = 3;
+	param.duration = 10;
+	emuparam.latency = 2;
+	emuparam.jitter  = 1;
+	while ((ch = getopt(argc, argv, "t:p:n:r:P:w:d:l:j:D:B:L:h")) != -1) {
+		switch (ch) {
+		case 't': param.type       = optarg;       break;
+		case 'p': ports            = optarg;       break;
+		case 'n': param.ndev       = atoi(optarg); break;
+		case 'r': param.baudrate   = atoi(optarg); break;
+		case 'P': param.period     = atof(optarg); break;
+		case 'w': param.warmup     = atoi(optarg); break;
+		case 'd': param.duration   = atoi(optarg); break;
+		case 'l': emuparam.latency = atoi(optarg); break;
+		case 'j': emuparam.jitter  = atoi(optarg); break;
+		case 'D': emuparam.drop    = atof(optarg); break;
+		case 'B': emuparam.bad     = atof(optarg); break;
+		case 'L': param.logfile    = optarg;       break;
+		default:
+			Usage();
+			return 1;
+		}
+	}
+	if      (param.type == "cooler") emuparam.type = EMU_COOLER_ASCII;
+	else if (param.type == "rtu")    emuparam.type = EMU_COOLER_RTU;
+	else if (param.type == "vacuum") emuparam.type = EMU_VACUUM;
+	else {
+		Usage();
+		return 1;
+	}
+	emuparam.ndev = param.ndev;
+	for (char *tok = strtok(&ports[0], ","); tok; tok = strtok(NULL, ",")) {
+		if ((i = atoi(tok)) > 0) param.ports.push_back(i);
+	}
+	if (param.ports.empty() || param.ndev <= 0 || param.duration <= 0) {
+		Usage();
+		return 1;
+	}
+	if (emuparam.bad > 0.0 && emuparam.type != EMU_COOLER_RTU) {// 其它模式下控制接口不校验应答
+		printf("-B requires -t rtu: replies are checked by CRC only in modbus RTU mode\n");
+		return 1;
+	}
+
+	if (!CheckTrend()) return 4;
+	// 控制接口日志写入文件, 避免与统计结果混杂
+	if (!freopen(param.logfile.c_str(), "w", stderr)) {
+		printf("failed to open log file %s: %s\n", param.logfile.c_str(), strerror(errno));
+		return 1;
+	}
+
+	struct rlimit rl;
+	if (!getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	// 创建仿真串口并在子进程中运行仿真器
+	int nmax = *std::max_element(param.ports.begin(), param.ports.end());
+	vector<EmulatorPtr> emus;
+	vector<string> portnames;
+	for (i = 0; i < nmax; ++i) {
+		EmulatorPtr one = make_emulator(emuparam);
+		if (!one->Open()) {
+			printf("failed to create pseudo terminal #%d: %s\n", i, strerror(errno));
+			return 2;
+		}
+		emus.push_back(one);
+		portnames.push_back(one->GetPortname());
+	}
+
+	int fdpipe[2];
+	pid_t pid;
+	if (pipe(fdpipe) || (pid = fork()) < 0) {
+		printf("failed to start emulator: %s\n", strerror(errno));
+		return 3;
+	}
+	if (pid == 0) {// 子进程: 运行仿真器直至父进程关闭管道
+		char c;
+		close(fdpipe[1]);
+		IOPoolPtr pool = make_iopool();
+		IOServiceKeep::SetPool(pool);
+		for (i = 0; i < nmax; ++i) emus[i]->Start();
+		while (read(fdpipe[0], &c, 1) > 0);
+		for (i = 0; i < nmax; ++i) emus[i]->Stop();
+		pool->stop();
+		_exit(0);
+	}
+	close(fdpipe[0]);
+	emus.clear(); // 关闭父进程持有的伪终端主端
+
+	IOPoolPtr pool = make_iopool();
+	IOServiceKeep::SetPool(pool);
+	printf("%s %s: %s x %d devices, %d baud, period %.1f s, %d threads, %d s per run, log %s\n",
+			DAEMON_NAME, DAEMON_VERSION, param.type.c_str(), param.ndev, param.baudrate, param.period,
+			pool->get_thread_count(), param.duration, param.logfile.c_str());
+	printf("%5s  %6s  %8s %8s  %7s %7s %7s %7s  %9s  %8s  %8s  %6s %6s %6s\n",
+			"ports", "sweeps", "sweep_ms", "max_ms", "rtt_p50", "rtt_p90", "rtt_p99", "rtt_max",
+			"frames/s", "cpu_us/f", "alloc/f", "retry", "tmout", "inval");
+	for (vector<int>::iterator it = param.ports.begin(); it != param.ports.end(); ++it)
+		RunBench(param, portnames, *it);
+	pool->stop();
+
+	close(fdpipe[1]);
+	waitpid(pid, NULL, 0);
+	return 0;
+}
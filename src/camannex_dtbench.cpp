@@ -0,0 +1,431 @@
+/**
+ Name        : camannex_dtbench.cpp 数据库上传性能测试程序
+ Author      : Xiaomeng Lu
+ Version     : 0.1
+ Copyright   : SVOM Group, NAOC
+ Description : 以仿真Web服务测试DataTransfer与AsyncTransfer的上传性能, 统计请求率、数据率、
+               单请求耗时分位数及单请求内存分配次数. 对比以下上传方式:
+               - new:   每个请求创建DataTransfer, 不复用连接
+               - reuse: 复用一个DataTransfer及其连接
+               - bulk:  复用连接, 以BulkAdapter批量上传
+               - async: AsyncTransfer并发上传
+               - file:  AsyncTransfer以流方式并发上传文件, 另行统计总速率与单次传输速率
+ @note
+ - 仿真服务运行于子进程, 统计结果仅包含上传所在进程
+ - 子进程须在创建任何线程之前fork
+ - 内存分配次数包含operator new与libcurl通过curl_global_init_mem()登记的分配函数
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <curl/curl.h>
+#include "globaldef.h"
+#include "GLog.h"
+#include "AllocCounter.h"
+#include "IOServiceKeep.h"
+#include "MockBackend.h"
+#include "DataTransfer.h"
+#include "AsyncTransfer.h"
+#include "UploadAdapter.h"
+#include "data.h"
+
+using std::string;
+using std::vector;
+using namespace boost::posix_time;
+
+GLog _gLog(stderr);
+
+//////////////////////////////////////////////////////////////////////////////
+/*---------------- libcurl内存分配计数 ----------------*/
+static void* CurlMalloc(size_t size) {
+	CountAlloc();
+	return malloc(size);
+}
+
+static void CurlFree(void* ptr) {
+	free(ptr);
+}
+
+static void* CurlRealloc(void* ptr, size_t size) {
+	CountAlloc();
+	return realloc(ptr, size);
+}
+
+static char* CurlStrdup(const char* str) {
+	CountAlloc();
+	return strdup(str);
+}
+
+static void* CurlCalloc(size_t nmemb, size_t size) {
+	CountAlloc();
+	return calloc(nmemb, size);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+struct BenchParam {// 测试参数
+	string url;			//< 服务器根地址
+	string bulk;		//< 批量上传动作
+	int count;			//< 每种方式上传的数据条数
+	int batch;			//< 批量上传单批数据条数
+	int depth;			//< 异步上传并发请求数量
+	int nfile;			//< 文件上传数量
+	int filesize;		//< 文件大小, 量纲: KB
+	int parallel;		//< 文件上传并发上限
+	vector<string> modes;	//< 上传方式序列
+};
+
+struct BenchResult {// 单种方式测试结果
+	int request;		//< 请求数量
+	int sample;			//< 上传成功的数据条数
+	int fail;			//< 失败请求数量
+	double elapsed;		//< 耗时, 量纲: 秒
+	unsigned long alloc;	//< 内存分配次数
+	vector<double> latency;	//< 单请求耗时, 量纲: 毫秒
+	vector<double> rate;	//< 单次文件传输速率, 量纲: 字节/秒
+	double bytes;			//< 文件上传字节数
+
+public:
+	BenchResult() {
+		request = sample = fail = 0;
+		elapsed = 0.0;
+		alloc   = 0;
+		bytes   = 0.0;
+	}
+
+	/*!
+	 * @brief 计算分位数
+	 * @param q 分位, [0, 1]
+	 */
+	double Percentile(double q) {
+		if (latency.empty()) return 0.0;
+		std::sort(latency.begin(), latency.end());
+		return latency[int(q * (latency.size() - 1) + 0.5)];
+	}
+};
+
+static UploadSample SampleAt(int i) {
+	UploadSample sample;
+	sample.type    = UPLOAD_TEMPERATURE;
+	strcpy(sample.gid, "001");
+	strcpy(sample.uid, "001");
+	sprintf(sample.cid, "%03d", i % 100 + 1);
+	strcpy(sample.utc, "2026-10-17T00:00:00");
+	sample.voltage = 11.9;
+	sample.current = 2.5;
+	sample.thot    = 20.1;
+	sample.coolget = -40.0 + (i % 10) * 0.01;
+	sample.coolset = -40.0;
+	return sample;
+}
+
+static double MillisecSince(const ptime& t0) {
+	return (microsec_clock::universal_time() - t0).total_microseconds() * 1E-3;
+}
+
+/*!
+ * @brief 同步逐条上传
+ * @param reuse true: 复用一个DataTransfer; false: 每个请求创建DataTransfer
+ */
+void RunSample(const BenchParam& param, bool reuse, BenchResult& rslt) {
+	boost::shared_ptr<DataTransfer> db;
+	SampleAdapter adapter;
+	char status[1024];
+
+	for (int i = 0; i < param.count; ++i) {
+		UploadSample sample = SampleAt(i);
+		ptime t0 = microsec_clock::universal_time();
+		if (!reuse || !db.use_count()) db.reset(new DataTransfer(param.url.c_str()));
+		if (adapter.Upload(*db, &sample, 1, status) == 1) ++rslt.sample;
+		else ++rslt.fail;
+		++rslt.request;
+		rslt.latency.push_back(MillisecSince(t0));
+	}
+}
+
+/*!
+ * @brief 同步批量上传
+ */
+void RunBulk(const BenchParam& param, BenchResult& rslt) {
+	DataTransfer db(param.url.c_str());
+	BulkAdapter adapter(param.bulk);
+	vector<UploadSample> samples(param.batch);
+	char status[1024];
+
+	for (int i = 0; i < param.count; i += param.batch) {
+		int n = std::min(param.batch, param.count - i);
+		for (int j = 0; j < n; ++j) samples[j] = SampleAt(i + j);
+		ptime t0 = microsec_clock::universal_time();
+		if (adapter.Upload(db, &samples[0], n, status) == n) rslt.sample += n;
+		else ++rslt.fail;
+		++rslt.request;
+		rslt.latency.push_back(MillisecSince(t0));
+	}
+}
+
+/*!
+ * @brief 异步并发上传
+ */
+class AsyncRunner {
+public:
+	AsyncRunner(BenchResult& rslt) : rslt_(rslt) {
+		inflight_ = 0;
+	}
+
+protected:
+	BenchResult& rslt_;
+	int inflight_;				//< 尚未完成的请求数量
+	boost::mutex mtx_;
+	boost::condition_variable cv_;
+
+public:
+	void Run(const BenchParam& param) {
+		AsyncTransferPtr transfer = make_async_transfer(param.url);
+		for (int i = 0; i < param.count; ++i) {
+			UploadSample sample = SampleAt(i);
+			{
+				boost::unique_lock<boost::mutex> lck(mtx_);
+				while (inflight_ >= param.depth) cv_.wait(lck);
+				++inflight_;
+			}
+			transfer->UploadTemperature(sample.gid, sample.uid, sample.cid, sample.voltage, sample.current,
+					sample.thot, sample.coolget, sample.coolset, sample.utc,
+					boost::bind(&AsyncRunner::OnDone, this, microsec_clock::universal_time(), _1, _2));
+		}
+		boost::unique_lock<boost::mutex> lck(mtx_);
+		while (inflight_) cv_.wait(lck);
+	}
+
+	void OnDone(const ptime& t0, int code, const string&) {
+		boost::unique_lock<boost::mutex> lck(mtx_);
+		if (code == GWAC_SUCCESS) ++rslt_.sample;
+		else ++rslt_.fail;
+		++rslt_.request;
+		rslt_.latency.push_back(MillisecSince(t0));
+		--inflight_;
+		cv_.notify_one();
+	}
+
+	/*!
+	 * @brief 在临时目录中创建文件并全部提交, 由AsyncTransfer限制并发数量
+	 */
+	void RunFile(const BenchParam& param) {
+		char dir[] = "/tmp/dtbench.XXXXXX";
+		if (!mkdtemp(dir)) {
+			printf("failed to create temporary directory: %s\n", strerror(errno));
+			return;
+		}
+		string path = string(dir) + "/";
+		vector<string> names;
+		vector<char> block(1024, 'x');
+		char name[32];
+		int i, j;
+		for (i = 0; i < param.nfile; ++i) {
+			sprintf(name, "preview%04d.jpg", i);
+			FILE *fp = fopen((path + name).c_str(), "wb");
+			if (!fp) break;
+			for (j = 0; j < param.filesize; ++j) fwrite(&block[0], 1, block.size(), fp);
+			fclose(fp);
+			names.push_back(name);
+		}
+
+		AsyncTransferPtr transfer = make_async_transfer(param.url);
+		transfer->SetParallel(param.parallel);
+		AsyncTransfer::StringMap params, files;
+		params.insert(std::make_pair("fileType", "impre"));
+		inflight_ = int(names.size());
+		for (i = 0; i < int(names.size()); ++i) {
+			files.clear();
+			files.insert(std::make_pair("fileUpload", names[i]));
+			transfer->UploadFiles(SEND_FITS_PREVIEW_URL, params, path.c_str(), files,
+					boost::bind(&AsyncRunner::OnFileDone, this, _1, _2, _3));
+		}
+		{
+			boost::unique_lock<boost::mutex> lck(mtx_);
+			while (inflight_) cv_.wait(lck);
+		}
+
+		for (i = 0; i < int(names.size()); ++i) unlink((path + names[i]).c_str());
+		rmdir(dir);
+	}
+
+	void OnFileDone(int code, const string&, const AsyncTransfer::TransferStat& stat) {
+		boost::unique_lock<boost::mutex> lck(mtx_);
+		if (code == GWAC_SUCCESS) {
+			++rslt_.sample;
+			rslt_.bytes += stat.bytes;
+			rslt_.rate.push_back(stat.rate);
+		}
+		else ++rslt_.fail;
+		++rslt_.request;
+		rslt_.latency.push_back(stat.seconds * 1E3);
+		--inflight_;
+		cv_.notify_one();
+	}
+};
+
+/*!
+ * @brief 以一种方式执行测试并输出结果
+ */
+void RunBench(const BenchParam& param, const string& mode) {
+	BenchResult rslt;
+	rslt.latency.reserve(param.count);
+	unsigned long alloc0 = AllocCount();
+	ptime t0 = microsec_clock::universal_time();
+
+	if      (mode == "new")   RunSample(param, false, rslt);
+	else if (mode == "reuse") RunSample(param, true, rslt);
+	else if (mode == "bulk")  RunBulk(param, rslt);
+	else if (mode == "async") {
+		AsyncRunner runner(rslt);
+		runner.Run(param);
+	}
+	else if (mode == "file") {
+		AsyncRunner runner(rslt);
+		runner.RunFile(param);
+	}
+	else {
+		printf("%-6s  unknown mode\n", mode.c_str());
+		return;
+	}
+
+	rslt.elapsed = MillisecSince(t0) * 1E-3;
+	rslt.alloc   = AllocCount() - alloc0;
+	printf("%-6s  %7d  %7d  %5d  %9.1f  %9.1f  %7.2f %7.2f %7.2f  %8.1f  %8.2f\n",
+			mode.c_str(), rslt.request, rslt.sample, rslt.fail,
+			rslt.request / rslt.elapsed, rslt.sample / rslt.elapsed,
+			rslt.Percentile(0.5), rslt.Percentile(0.99), rslt.Percentile(1.0),
+			rslt.request ? double(rslt.alloc) / rslt.request : 0.0,
+			rslt.sample ? double(rslt.alloc) / rslt.sample : 0.0);
+	if (rslt.rate.size()) {
+		std::sort(rslt.rate.begin(), rslt.rate.end());
+		printf("%-6s  %d x %d KB, parallel %d: %.1f MB/s in total, per transfer min %.1f p50 %.1f max %.1f MB/s\n",
+				"", param.nfile, param.filesize, param.parallel, rslt.bytes / rslt.elapsed / 1048576.0,
+				rslt.rate.front() / 1048576.0, rslt.rate[rslt.rate.size() / 2] / 1048576.0,
+				rslt.rate.back() / 1048576.0);
+	}
+	fflush(stdout);
+}
+
+void Usage() {
+	printf("Usage: camannex_dtbench [options]\n");
+	printf("  -u <url>       root url of an external server. default: start camannex_mockweb's backend\n");
+	printf("  -m <list>      comma separated modes: new, reuse, bulk, async, file. default: new,reuse,bulk,async\n");
+	printf("  -n <samples>   samples uploaded by each mode. default: 2000\n");
+	printf("  -b <batch>     samples per bulk request. default: %d\n", UPLOAD_BATCH);
+	printf("  -a <action>    bulk upload action. default: uploadBulk.action\n");
+	printf("  -c <depth>     concurrent requests of async mode. default: 16\n");
+	printf("  -f <files>     files uploaded by file mode. default: 16\n");
+	printf("  -F <KB>        size of every file. default: 4096\n");
+	printf("  -P <n>         concurrent file uploads. default: 4\n");
+	printf("  -l <ms>        emulated server latency. default: 0\n");
+	printf("  -j <ms>        emulated server jitter. default: 0\n");
+	printf("  -e <ratio>     ratio of emulated http 500 replies. default: 0\n");
+	printf("  -k             emulated server closes connection after every reply\n");
+}
+
+/*!
+ * @brief 主程序
+ * @param argc 参数数量
+ * @param argv 参数列表
+ */
+int main(int argc, char** argv) {
+	BenchParam param;
+	MockParam mockparam;
+	string modes("new,reuse,bulk,async");
+	int ch;
+
+	param.bulk     = "uploadBulk.action";
+	param.count    = 2000;
+	param.batch    = UPLOAD_BATCH;
+	param.depth    = 16;
+	param.nfile    = 16;
+	param.filesize = 4096;
+	param.parallel = 4;
+	while ((ch = getopt(argc, argv, "u:m:n:b:a:c:f:F:P:l:j:e:kh")) != -1) {
+		switch (ch) {
+		case 'u': param.url           = optarg;       break;
+		case 'm': modes               = optarg;       break;
+		case 'n': param.count         = atoi(optarg); break;
+		case 'b': param.batch         = atoi(optarg); break;
+		case 'a': param.bulk          = optarg;       break;
+		case 'c': param.depth         = atoi(optarg); break;
+		case 'f': param.nfile         = atoi(optarg); break;
+		case 'F': param.filesize      = atoi(optarg); break;
+		case 'P': param.parallel      = atoi(optarg); break;
+		case 'l': mockparam.latency   = atoi(optarg); break;
+		case 'j': mockparam.jitter    = atoi(optarg); break;
+		case 'e': mockparam.error     = atof(optarg); break;
+		case 'k': mockparam.keepalive = false;        break;
+		default:
+			Usage();
+			return 1;
+		}
+	}
+	for (char *tok = strtok(&modes[0], ","); tok; tok = strtok(NULL, ",")) param.modes.push_back(tok);
+	if (param.modes.empty() || param.count <= 0 || param.batch <= 0 || param.depth <= 0
+			|| param.nfile <= 0 || param.filesize < 0) {
+		Usage();
+		return 1;
+	}
+	curl_global_init_mem(CURL_GLOBAL_ALL, CurlMalloc, CurlFree, CurlRealloc, CurlStrdup, CurlCalloc);
+
+	int fdpipe[2], fdport[2];
+	pid_t pid(0);
+	if (param.url.empty()) {// 在子进程中运行仿真服务, 经管道返回端口
+		if (pipe(fdpipe) || pipe(fdport) || (pid = fork()) < 0) {
+			printf("failed to start mock backend: %s\n", strerror(errno));
+			return 3;
+		}
+		if (pid == 0) {// 子进程: 运行仿真服务直至父进程关闭管道
+			char c;
+			close(fdpipe[1]);
+			close(fdport[0]);
+			IOPoolPtr pool = make_iopool();
+			IOServiceKeep::SetPool(pool);
+			MockBackendPtr backend = make_mockbackend(mockparam);
+			uint16_t port = backend->Start() ? backend->GetPort() : 0;
+			if (write(fdport[1], &port, sizeof(port)) != sizeof(port)) _exit(1);
+			close(fdport[1]);
+			while (read(fdpipe[0], &c, 1) > 0);
+			backend->Stop();
+			pool->stop();
+			_exit(0);
+		}
+		close(fdpipe[0]);
+		close(fdport[1]);
+		uint16_t port(0);
+		if (read(fdport[0], &port, sizeof(port)) != sizeof(port) || !port) {
+			printf("failed to start mock backend\n");
+			close(fdpipe[1]);
+			waitpid(pid, NULL, 0);
+			return 3;
+		}
+		close(fdport[0]);
+		char url[64];
+		sprintf(url, "http://127.0.0.1:%d/", port);
+		param.url = url;
+	}
+
+	IOPoolPtr pool = make_iopool();
+	IOServiceKeep::SetPool(pool);
+	printf("%s %s: %s, %d samples per mode, batch %d, depth %d, latency %d ms, %s\n",
+			DAEMON_NAME, DAEMON_VERSION, param.url.c_str(), param.count, param.batch, param.depth,
+			mockparam.latency, mockparam.keepalive ? "keep-alive" : "close");
+	printf("%-6s  %7s  %7s  %5s  %9s  %9s  %7s %7s %7s  %8s  %8s\n",
+			"mode", "request", "sample", "fail", "req/s", "sample/s", "p50_ms", "p99_ms", "max_ms",
+			"alloc/rq", "alloc/sp");
+	for (vector<string>::iterator it = param.modes.begin(); it != param.modes.end(); ++it)
+		RunBench(param, *it);
+	pool->stop();
+
+	if (pid > 0) {
+		close(fdpipe[1]);
+		waitpid(pid, NULL, 0);
+	}
+	return 0;
+}
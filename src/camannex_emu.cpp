@@ -0,0 +1,151 @@
+/**
+ Name        : camannex_emu.cpp 温控器与真空计仿真程序
+ Author      : Xiaomeng Lu
+ Version     : 0.1
+ Copyright   : SVOM Group, NAOC
+ Description : 创建伪终端并仿真温控器或真空计, 用于无硬件条件下测试camannex及其负载能力
+ */
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include "IOServiceKeep.h"
+#include "DeviceEmulator.h"
+
+typedef vector<EmulatorPtr> EmulatorVec;
+
+/*!
+ * @brief 显示使用说明
+ */
+void Usage() {
+	printf("Usage: camannex_emu [options]\n");
+	printf("  -t <type>     device type: cooler, rtu or vacuum. default: cooler\n");
+	printf("  -p <ports>    number of pseudo serial ports. default: 1\n");
+	printf("  -n <devices>  devices per port, ID from 1. default: 2\n");
+	printf("  -l <ms>       reply latency. default: 5\n");
+	printf("  -j <ms>       reply latency jitter. default: 0\n");
+	printf("  -d <ratio>    ratio of dropped replies, [0, 1]. default: 0\n");
+	printf("  -b <ratio>    ratio of replies with bad checksum, [0, 1], rtu only. default: 0\n");
+	printf("  -o <dir>      create symbolic links <dir>/ttyEMU<N> to the ports\n");
+	printf("  -s <seconds>  interval of statistics output. default: 10\n");
+}
+
+/*!
+ * @brief 定时输出统计信息
+ */
+void PrintStat(const boost::system::error_code& ec, boost::asio::deadline_timer* timer, int interval,
+		EmulatorVec* emus) {
+	if (ec) return;
+
+	EmulatorStat total;
+	for (EmulatorVec::iterator it = emus->begin(); it != emus->end(); ++it) {
+		EmulatorStat one = (*it)->GetStat();
+		total.request += one.request;
+		total.reply   += one.reply;
+		total.drop    += one.drop;
+		total.bad     += one.bad;
+		total.invalid += one.invalid;
+	}
+	printf("%s  request: %lu  reply: %lu  drop: %lu  bad: %lu  invalid: %lu\n",
+			boost::posix_time::to_simple_string(boost::posix_time::second_clock::local_time()).c_str(),
+			(unsigned long) total.request, (unsigned long) total.reply, (unsigned long) total.drop,
+			(unsigned long) total.bad, (unsigned long) total.invalid);
+	fflush(stdout);
+
+	timer->expires_at(timer->expires_at() + boost::posix_time::seconds(interval));
+	timer->async_wait(boost::bind(&PrintStat, boost::asio::placeholders::error, timer, interval, emus));
+}
+
+/*!
+ * @brief 主程序
+ * @param argc 参数数量
+ * @param argv 参数列表
+ */
+int main(int argc, char** argv) {
+	EmulatorParam param;
+	string type("cooler"), linkdir;
+	int nport(1), interval(10), ch;
+
+	param.ndev = 2;
+	while ((ch = getopt(argc, argv, "t:p:n:l:j:d:b:o:s:h")) != -1) {
+		switch (ch) {
+		case 't': type           = optarg;       break;
+		case 'p': nport          = atoi(optarg); break;
+		case 'n': param.ndev     = atoi(optarg); break;
+		case 'l': param.latency  = atoi(optarg); break;
+		case 'j': param.jitter   = atoi(optarg); break;
+		case 'd': param.drop     = atof(optarg); break;
+		case 'b': param.bad      = atof(optarg); break;
+		case 'o': linkdir        = optarg;       break;
+		case 's': interval       = atoi(optarg); break;
+		default:
+			Usage();
+			return 1;
+		}
+	}
+	if      (type == "cooler") param.type = EMU_COOLER_ASCII;
+	else if (type == "rtu")    param.type = EMU_COOLER_RTU;
+	else if (type == "vacuum") param.type = EMU_VACUUM;
+	else {
+		Usage();
+		return 1;
+	}
+	if (nport <= 0 || param.ndev <= 0 || param.ndev > 255 || interval <= 0) {
+		Usage();
+		return 1;
+	}
+	if (param.bad > 0.0 && param.type != EMU_COOLER_RTU) {
+		printf("-b requires -t rtu: camannex checks reply checksums only in modbus RTU mode\n");
+		return 1;
+	}
+
+	// 每个串口占用两个文件描述符
+	struct rlimit rl;
+	if (!getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	EmulatorVec emus;
+	boost::format fmt("%s/ttyEMU%d");
+	for (int i = 0; i < nport; ++i) {
+		EmulatorPtr one = make_emulator(param);
+		if (!one->Open()) {
+			printf("failed to create pseudo terminal #%d: %s\n", i, strerror(errno));
+			return 2;
+		}
+		if (!linkdir.empty()) {
+			string path = (fmt % linkdir % i).str();
+			unlink(path.c_str());
+			if (symlink(one->GetPortname(), path.c_str()))
+				printf("failed to create link %s: %s\n", path.c_str(), strerror(errno));
+		}
+		printf("%s\n", one->GetPortname());
+		emus.push_back(one);
+	}
+	fflush(stdout);
+
+	IOPoolPtr pool = make_iopool();
+	IOServiceKeep::SetPool(pool);
+	for (EmulatorVec::iterator it = emus.begin(); it != emus.end(); ++it) (*it)->Start();
+
+	io_service ios;
+	boost::asio::signal_set signals(ios, SIGINT, SIGTERM);
+	signals.async_wait(boost::bind(&io_service::stop, &ios));
+	boost::asio::deadline_timer timer(ios);
+	timer.expires_from_now(boost::posix_time::seconds(interval));
+	timer.async_wait(boost::bind(&PrintStat, boost::asio::placeholders::error, &timer, interval, &emus));
+	ios.run();
+
+	for (EmulatorVec::iterator it = emus.begin(); it != emus.end(); ++it) (*it)->Stop();
+	pool->stop();
+	if (!linkdir.empty()) {
+		for (int i = 0; i < nport; ++i) unlink((fmt % linkdir % i).str().c_str());
+	}
+	return 0;
+}
@@ -0,0 +1,97 @@
+/**
+ Name        : camannex_mockweb.cpp 数据库Web服务仿真程序
+ Author      : Xiaomeng Lu
+ Version     : 0.1
+ Copyright   : SVOM Group, NAOC
+ Description : 在回环地址仿真gwebend的*.action接口, 用于无数据库服务器条件下测试上传、重试与磁盘缓存
+ */
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "IOServiceKeep.h"
+#include "MockBackend.h"
+
+/*!
+ * @brief 显示使用说明
+ */
+void Usage() {
+	printf("Usage: camannex_mockweb [options]\n");
+	printf("  -p <port>     listen port on 127.0.0.1. default: 0, assigned by system\n");
+	printf("  -l <ms>       reply latency. default: 0\n");
+	printf("  -j <ms>       reply latency jitter. default: 0\n");
+	printf("  -e <ratio>    ratio of replies with http code 500, [0, 1]. default: 0\n");
+	printf("  -c            close connection after every reply\n");
+	printf("  -s <seconds>  interval of statistics output. default: 10\n");
+}
+
+/*!
+ * @brief 定时输出统计信息
+ */
+void PrintStat(const boost::system::error_code& ec, boost::asio::deadline_timer* timer, int interval,
+		MockBackendPtr backend) {
+	if (ec) return;
+
+	MockStat stat = backend->GetStat();
+	printf("%s  connection: %lu  request: %lu  sample: %lu  error: %lu  notfound: %lu  bytes: %lu\n",
+			boost::posix_time::to_simple_string(boost::posix_time::second_clock::local_time()).c_str(),
+			(unsigned long) stat.connection, (unsigned long) stat.request, (unsigned long) stat.sample,
+			(unsigned long) stat.error, (unsigned long) stat.notfound, (unsigned long) stat.bytes);
+	fflush(stdout);
+
+	timer->expires_at(timer->expires_at() + boost::posix_time::seconds(interval));
+	timer->async_wait(boost::bind(&PrintStat, boost::asio::placeholders::error, timer, interval, backend));
+}
+
+/*!
+ * @brief 主程序
+ * @param argc 参数数量
+ * @param argv 参数列表
+ */
+int main(int argc, char** argv) {
+	MockParam param;
+	int interval(10), ch;
+
+	while ((ch = getopt(argc, argv, "p:l:j:e:cs:h")) != -1) {
+		switch (ch) {
+		case 'p': param.port      = uint16_t(atoi(optarg)); break;
+		case 'l': param.latency   = atoi(optarg); break;
+		case 'j': param.jitter    = atoi(optarg); break;
+		case 'e': param.error     = atof(optarg); break;
+		case 'c': param.keepalive = false;        break;
+		case 's': interval        = atoi(optarg); break;
+		default:
+			Usage();
+			return 1;
+		}
+	}
+	if (param.latency < 0 || param.error < 0.0 || param.error > 1.0 || interval <= 0) {
+		Usage();
+		return 1;
+	}
+
+	IOPoolPtr pool = make_iopool();
+	IOServiceKeep::SetPool(pool);
+	MockBackendPtr backend = make_mockbackend(param);
+	if (!backend->Start()) {
+		printf("failed to listen on port %d\n", param.port);
+		return 2;
+	}
+	// 首行为服务器根地址, 可直接用作DataTransfer的rootUrl
+	printf("http://127.0.0.1:%d/\n", backend->GetPort());
+	fflush(stdout);
+
+	io_service ios;
+	boost::asio::signal_set signals(ios, SIGINT, SIGTERM);
+	signals.async_wait(boost::bind(&io_service::stop, &ios));
+	boost::asio::deadline_timer timer(ios);
+	timer.expires_from_now(boost::posix_time::seconds(interval));
+	timer.async_wait(boost::bind(&PrintStat, boost::asio::placeholders::error, &timer, interval, backend));
+	ios.run();
+
+	backend->Stop();
+	pool->stop();
+	return 0;
+}
@@ -7,6 +7,7 @@
 
 #include <string>
 #include <vector>
+#include <stdlib.h>
 #include <boost/property_tree/xml_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/algorithm/string.hpp>
@@ -17,27 +18,56 @@
 using std::string;
 using std::vector;
 
+struct PollConfig {// 监测指令轮询周期
+	int funcID;			//< 功能编号
+	double period;		//< 设备状态稳定时的周期, 量纲: 秒. <=0时不轮询
+	double fast;		//< 设备状态变化时的周期, 量纲: 秒. <=0时与period相同
+};
+typedef vector<PollConfig> PollCfgVec;
+
 struct Annex {// 附件串口配置信息
 	string portName;		//< 串口名称
 	int baudRate;		//< 波特率
+	string mode;		//< 通信模式: ASCII或RTU. 仅用于温控
 	int n;				//< 设备数量
 	vector<uint8_t> idd;	//< 设备ID
+	PollCfgVec poll;		//< 轮询周期. 未列出的功能编号采用缺省周期
 };
 typedef vector<Annex> AnnexVec;
 
+struct ServerAddr {// 控制服务器地址
+	string host;		//< IP地址或主机名
+	uint16_t port;		//< 服务端口
+};
+typedef vector<ServerAddr> ServerVec;
+
 struct param_config {// 软件配置参数
 	string groupid;			//< 组标志
+	bool ipcMQ;				//< 消息队列采用共享内存, 供外部程序投递消息
 	bool bServer;			//< 是否启用网络通信
-	string ipServer;		//< 服务器IP地址
-	uint16_t portServer;	//< 服务器端口
+	ServerVec servers;		//< 服务器列表, 按顺序尝试连接
+	int timeoutServer;		//< 单个服务器的连接超时, 量纲: 秒
+	double retryMin;		//< 全部服务器连接失败后的首次重试间隔, 量纲: 秒
+	double retryMax;		//< 重试间隔上限, 量纲: 秒. 重试间隔按2倍递增
+	int queueServer;		//< 发送队列容量, 量纲: 条
+	string policyServer;	//< 发送队列已满时的处理策略: DropNewest, DropOldest或Coalesce
 	bool enableDB;			//< 数据库启用标志
 	string urlDB;			//< 数据库访问地址
+	int queueDB;			//< 数据库上传队列容量. 队列已满时丢弃最早的数据
+	string bulkDB;			//< 数据库批量上传动作. 空: 逐条上传
+	int batchDB;			//< 单次上传的最大数据数量
+	double latencyDB;		//< 数据在上传队列中等待凑批的最长时间, 量纲: 秒
+	string spoolDB;			//< 上传失败数据的磁盘缓存目录. 空: 不缓存
+	int spoolBudget;		//< 磁盘缓存预算, 量纲: MB
+	int replayRate;			//< 磁盘缓存回放速率, 量纲: 条/秒
 	AnnexVec cooler;		//< 温控参数
 	AnnexVec vacuum;		//< 真空度参数
 	bool enableNTP;			//< NTP启用标志
 	string hostNTP;			//< NTP服务器IP地址
 	uint16_t portNTP;		//< NTP服务器端口
 	int  maxDiffNTP;		//< 采用自动校正时钟策略时, 本机时钟与NTP时钟所允许的最大偏差, 量纲: 毫秒
+	double trendHours;		//< 内存中保存监测数据的时长, 量纲: 小时. <=0时不保存
+	double trendResolution;	//< 监测数据时间分辨率, 量纲: 秒
 
 public:
 	/*!
@@ -59,20 +89,40 @@ public:
 		pt.add("Description", "config parameters of annex software for GWAC-GY camera");
 		pt.add("date", to_iso_string(second_clock::universal_time()));
 		pt.add("GroupID", groupid = "001");
+		pt.add("MessageQueue.<xmlattr>.IPC", ipcMQ = false);
 		pt.add("Server.<xmlattr>.Enable", bServer = false);
-		pt.add("Server.<xmlattr>.IP", ipServer = "172.28.1.11");
-		pt.add("Server.<xmlattr>.Port", portServer = 4016);
+		pt.add("Server.<xmlattr>.Queue", queueServer = 128);
+		pt.add("Server.<xmlattr>.Policy", policyServer = "Coalesce");
+		pt.add("Server.<xmlattr>.Timeout",  timeoutServer = 5);
+		pt.add("Server.<xmlattr>.RetryMin", retryMin = 1.0);
+		pt.add("Server.<xmlattr>.RetryMax", retryMax = 60.0);
+		servers.clear();
+		ServerAddr addr;
+		ptree& node0 = pt.add("Server.Host", "");
+		node0.add("<xmlattr>.IP",   addr.host = "172.28.1.11");
+		node0.add("<xmlattr>.Port", addr.port = 4016);
+		servers.push_back(addr);
 		pt.add("Database.<xmlattr>.Enable", enableDB = true);
 		pt.add("Database.<xmlattr>.URL",    urlDB    = "http://172.28.8.8:8080/gwebend/");
+		pt.add("Database.<xmlattr>.Queue",  queueDB  = 1024);
+		pt.add("Database.<xmlattr>.Bulk",   bulkDB   = "");
+		pt.add("Database.<xmlattr>.Batch",  batchDB  = 32);
+		pt.add("Database.<xmlattr>.Latency", latencyDB = 1.0);
+		pt.add("Database.<xmlattr>.Spool",  spoolDB  = "/var/spool/camannex");
+		pt.add("Database.<xmlattr>.Budget", spoolBudget = 64);
+		pt.add("Database.<xmlattr>.Replay", replayRate  = 20);
 		pt.add("NTP.<xmlattr>.Enable",  enableNTP = false);
 		pt.add("NTP.<xmlattr>.IP",      hostNTP = "172.28.1.3");
 		pt.add("NTP.<xmlattr>.Port",    portNTP = 123);
 		pt.add("NTP.<xmlattr>.MaxDiff", maxDiffNTP = 5);
+		pt.add("Trend.<xmlattr>.Hours",      trendHours = 24.0);
+		pt.add("Trend.<xmlattr>.Resolution", trendResolution = 10.0);
 
 		ptree& node1 = pt.add("Cooler", "");
 		Annex acool;
 		node1.add("SerialPort.<xmlattr>.Name",     acool.portName = "/dev/ttyS0");
 		node1.add("SerialPort.<xmlattr>.BaudRate", acool.baudRate = 9600);
+		node1.add("SerialPort.<xmlattr>.Mode",     acool.mode = "ASCII");
 		node1.add("DeviceNumber", acool.n = 2);
 		for (i = 1; i <= acool.n; ++i) {
 			uint8_t idd = uint8_t(i);
@@ -80,6 +130,9 @@ public:
 			node1.add(idkey.str(), idd);
 			acool.idd.push_back(idd);
 		}
+		// 探测器温度: 制冷过程中每秒读取; 制冷温度: 每5分钟读取
+		add_poll(node1, acool, 0x23, 20.0, 1.0);
+		add_poll(node1, acool, 0x15, 300.0, 0.0);
 		cooler.push_back(acool);
 
 		ptree& node2 = pt.add("Vacuum", "");
@@ -132,15 +185,44 @@ public:
 			read_xml(filepath, pt, boost::property_tree::xml_parser::trim_whitespace);
 
 			groupid    = pt.get("GroupID", "001");
+			ipcMQ      = pt.get("MessageQueue.<xmlattr>.IPC", false);
 			bServer    = pt.get("Server.<xmlattr>.Enable", false);
-			ipServer   = pt.get("Server.<xmlattr>.IP",   "172.28.1.11");
-			portServer = pt.get("Server.<xmlattr>.Port", 4016);
+			timeoutServer = pt.get("Server.<xmlattr>.Timeout",  5);
+			retryMin      = pt.get("Server.<xmlattr>.RetryMin", 1.0);
+			retryMax      = pt.get("Server.<xmlattr>.RetryMax", 60.0);
+			servers.clear();
+			if (pt.get_child_optional("Server")) {
+				BOOST_FOREACH(ptree::value_type const &child, pt.get_child("Server")) {
+					if (!boost::iequals(child.first, "Host")) continue;
+					ServerAddr addr;
+					addr.host = child.second.get("<xmlattr>.IP",   "");
+					addr.port = child.second.get("<xmlattr>.Port", 4016);
+					if (!addr.host.empty()) servers.push_back(addr);
+				}
+			}
+			if (servers.empty()) {// 兼容单服务器配置: <Server IP= Port=/>
+				ServerAddr addr;
+				addr.host = pt.get("Server.<xmlattr>.IP",   "172.28.1.11");
+				addr.port = pt.get("Server.<xmlattr>.Port", 4016);
+				servers.push_back(addr);
+			}
+			queueServer  = pt.get("Server.<xmlattr>.Queue",  128);
+			policyServer = pt.get("Server.<xmlattr>.Policy", "Coalesce");
 			enableDB   = pt.get("Database.<xmlattr>.Enable",  true);
 			urlDB      = pt.get("Database.<xmlattr>.URL",     "http://172.28.8.8:8080/gwebend/");
+			queueDB    = pt.get("Database.<xmlattr>.Queue",   1024);
+			bulkDB     = pt.get("Database.<xmlattr>.Bulk",    "");
+			batchDB    = pt.get("Database.<xmlattr>.Batch",   32);
+			latencyDB  = pt.get("Database.<xmlattr>.Latency", 1.0);
+			spoolDB    = pt.get("Database.<xmlattr>.Spool",   "/var/spool/camannex");
+			spoolBudget = pt.get("Database.<xmlattr>.Budget", 64);
+			replayRate  = pt.get("Database.<xmlattr>.Replay", 20);
 			enableNTP  = pt.get("NTP.<xmlattr>.Enable",  false);
 			hostNTP    = pt.get("NTP.<xmlattr>.IP",      "172.28.1.3");
 			portNTP    = pt.get("NTP.<xmlattr>.Port",    123);
 			maxDiffNTP = pt.get("NTP.<xmlattr>.MaxDiff", 5);
+			trendHours      = pt.get("Trend.<xmlattr>.Hours",      24.0);
+			trendResolution = pt.get("Trend.<xmlattr>.Resolution", 10.0);
 
 			BOOST_FOREACH(ptree::value_type const &child, pt.get_child("")) {
 				bc = boost::iequals(child.first, "Cooler");
@@ -151,12 +233,22 @@ public:
 
 					one.portName = child.second.get("SerialPort.<xmlattr>.Name", "/dev/ttyS0");
 					one.baudRate = child.second.get("SerialPort.<xmlattr>.BaudRate", 9600);
+					one.mode     = child.second.get("SerialPort.<xmlattr>.Mode", "ASCII");
 					one.n        = child.second.get("DeviceNumber", 1);
 					for (i = 1; i <= one.n; ++i) {
 						idkey % i;
 						uint8_t idd = child.second.get(idkey.str(), i);
 						one.idd.push_back(idd);
 					}
+					BOOST_FOREACH(ptree::value_type const &grand, child.second) {
+						if (!boost::iequals(grand.first, "Poll")) continue;
+						PollConfig poll;
+						// 功能编号可采用十六进制, 如0x23
+						poll.funcID = strtol(grand.second.get("<xmlattr>.FuncID", "0").c_str(), NULL, 0);
+						poll.period = grand.second.get("<xmlattr>.Period", 20.0);
+						poll.fast   = grand.second.get("<xmlattr>.Fast",   0.0);
+						if (poll.funcID > 0 && poll.funcID < 256) one.poll.push_back(poll);
+					}
 					if (bc) cooler.push_back(one);
 					else    vacuum.push_back(one);
 				}
@@ -166,6 +258,27 @@ public:
 			InitFile(filepath);
 		}
 	}
+
+protected:
+	/*!
+	 * @brief 在设备配置中添加一项轮询周期
+	 * @param node   设备配置节点
+	 * @param annex  设备配置参数
+	 * @param funcID 功能编号
+	 * @param period 设备状态稳定时的周期, 量纲: 秒
+	 * @param fast   设备状态变化时的周期, 量纲: 秒
+	 */
+	void add_poll(boost::property_tree::ptree& node, Annex& annex, int funcID, double period, double fast) {
+		using boost::property_tree::ptree;
+
+		PollConfig poll;
+		ptree& child = node.add("Poll", "");
+		child.add("<xmlattr>.FuncID", (boost::format("0x%02X") % funcID).str());
+		child.add("<xmlattr>.Period", poll.period = period);
+		child.add("<xmlattr>.Fast",   poll.fast = fast);
+		poll.funcID = funcID;
+		annex.poll.push_back(poll);
+	}
 };
 
 #endif // PARAMETER_H_
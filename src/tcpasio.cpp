@@ -3,6 +3,7 @@
  */
 
 #include <boost/lexical_cast.hpp>
+#include <vector>
 #include "tcpasio.h"
 
 using std::string;
@@ -14,10 +15,14 @@ TcpCPtr maketcp_client() {// 工厂函数, 创建TcpCPtr
 }
 
 TCPClient::TCPClient()
-	: sock_(keep_.get_service()) {
+	: sock_(keep_.get_service()), resolver_(keep_.get_service()), tmconn_(keep_.get_service()) {
+	connecting_ = false;
 	bytercv_ = 0;
 	bufrcv_.reset(new char[TCP_PACK_SIZE]);
 	usebuf_ = false;
+	capacity_ = TCP_QUEUE_DEPTH;
+	policy_   = TCP_COALESCE;
+	writing_  = false;
 }
 
 TCPClient::~TCPClient() {
@@ -29,31 +34,49 @@ tcp::socket& TCPClient::GetSocket() {
 }
 
 /*
- * @note 同步方式连接服务器
+ * @note 同步方式连接服务器, 依次尝试解析得到的全部地址
  */
 bool TCPClient::Connect(const string& host, const uint16_t port) {
 	tcp::resolver resolver(keep_.get_service());
 	tcp::resolver::query query(host, boost::lexical_cast<string>(port));
-	tcp::resolver::iterator itertor = resolver.resolve(query);
 	error_code ec;
-	sock_.connect(*itertor, ec);
-	return (!ec && IsOpen());
+	tcp::resolver::iterator itertor = resolver.resolve(query, ec);
+	if (!ec) connect(sock_, itertor, ec);
+	if (ec || !IsOpen()) return false;
+
+	socket_base::keep_alive option(true);
+	sock_.set_option(option, ec);
+	keep_.get_strand().post(boost::bind(&TCPClient::start_read, shared_from_this()));
+	return true;
 }
 
 /*
  * @note 异步方式连接服务器, 由回调函数监测连接结果
  */
-void TCPClient::AsyncConnect(const string& host, const uint16_t port) {
-	tcp::resolver resolver(keep_.get_service());
+void TCPClient::AsyncConnect(const string& host, const uint16_t port, const int timeout) {
 	tcp::resolver::query query(host, boost::lexical_cast<string>(port));
-	tcp::resolver::iterator itertor = resolver.resolve(query);
 
-	sock_.async_connect(*itertor,
-			boost::bind(&TCPClient::handle_connect, this, placeholders::error));
+	connecting_ = true;
+	if (timeout > 0) {
+		tmconn_.expires_from_now(boost::posix_time::seconds(timeout));
+		tmconn_.async_wait(keep_.get_strand().wrap(boost::bind(&TCPClient::handle_timeout, shared_from_this(),
+				placeholders::error)));
+	}
+	resolver_.async_resolve(query,
+			keep_.get_strand().wrap(boost::bind(&TCPClient::handle_resolve, shared_from_this(),
+					placeholders::error, placeholders::iterator)));
 }
 
+/*
+ * @note 主动关闭后不再调用回调函数
+ */
 int TCPClient::Close() {
 	error_code ec;
+	cbconn_.disconnect_all_slots();
+	cbrcv_.disconnect_all_slots();
+	cbsnd_.disconnect_all_slots();
+	resolver_.cancel();
+	tmconn_.cancel(ec);
 	if (sock_.is_open()) sock_.close(ec);
 	return ec.value();
 }
@@ -68,17 +91,22 @@ bool TCPClient::IsOpen() {
 void TCPClient::UseBuffer(bool usebuf) {
 	if (usebuf_ != usebuf) {
 		usebuf_ = usebuf;
-		if (usebuf_) {
-			crcrcv_.set_capacity(TCP_PACK_SIZE * 10);
-			crcsnd_.set_capacity(TCP_PACK_SIZE * 10);
-		}
-		else {
-			crcrcv_.clear();
-			crcsnd_.clear();
-		}
+		if (usebuf_) crcrcv_.set_capacity(TCP_PACK_SIZE * 10);
+		else crcrcv_.clear();
 	}
 }
 
+void TCPClient::SetQueue(int capacity, int policy) {
+	mutex_lock lck(mtxsnd_);
+	capacity_ = capacity > 0 ? capacity : TCP_QUEUE_DEPTH;
+	policy_   = (policy == TCP_DROP_NEWEST || policy == TCP_DROP_OLDEST) ? policy : TCP_COALESCE;
+}
+
+TcpQueueStat TCPClient::GetQueueStat() {
+	mutex_lock lck(mtxsnd_);
+	return stat_;
+}
+
 /*
  * @note UseBuffer()应在建立连接前仅调用一次
  */
@@ -151,24 +179,80 @@ int TCPClient::Read(char* buff, const int len, const int from) {
 	return i;
 }
 
-int TCPClient::Write(const char* buff, const int len) {
+int TCPClient::Write(const char* buff, const int len, const bool flush, const int key) {
+	if (!buff || len <= 0) return 0;
+
+	carray data(new char[len]);
+	memcpy(data.get(), buff, len);
+	return Write(data, len, flush, key);
+}
+
+/*
+ * @note 存储区由队列持有引用, 发送完成后释放
+ */
+int TCPClient::Write(const carray& buff, const int len, const bool flush, const int key) {
 	if (!buff || len <= 0) return 0;
 
 	mutex_lock lck(mtxsnd_);
-	int n;
-	if (usebuf_) {
-		int n0(crcsnd_.size()), i;
-		if ((n = crcsnd_.capacity() - n0) > len) n = len;
-		for (i = 0; i < n; ++i) crcsnd_.push_back(buff[i]);
-		if (!n0 && n) start_write();
+	message msg;
+	msg.data = buff;
+	msg.size = len;
+	msg.key  = key;
+	++stat_.queued;
+
+	msgque::iterator it = queue_.end();
+	if (policy_ == TCP_COALESCE && key >= 0) {// 替换同一键值的待发送消息
+		for (it = queue_.begin(); it != queue_.end() && it->key != key; ++it);
+		if (it != queue_.end()) {
+			*it = msg;
+			++stat_.coalesced;
+		}
 	}
+	if (it == queue_.end()) {
+		if (int(queue_.size()) >= capacity_) {
+			++stat_.dropped;
+			if (policy_ == TCP_DROP_NEWEST) return 0;
+			queue_.pop_front();
+		}
+		queue_.push_back(msg);
+	}
+	if (flush && !writing_) {
+		writing_ = true;
+		keep_.get_strand().post(boost::bind(&TCPClient::start_write, shared_from_this()));
+	}
+	return len;
+}
+
+void TCPClient::Flush() {
+	mutex_lock lck(mtxsnd_);
+	if (!writing_ && !queue_.empty()) {
+		writing_ = true;
+		keep_.get_strand().post(boost::bind(&TCPClient::start_write, shared_from_this()));
+	}
+}
+
+void TCPClient::handle_resolve(const error_code& ec, tcp::resolver::iterator it) {
+	if (ec) handle_connect(ec);
 	else {
-		n = sock_.write_some(buffer(buff, len));
+		async_connect(sock_, it,
+				keep_.get_strand().wrap(boost::bind(&TCPClient::handle_connect, shared_from_this(), placeholders::error)));
 	}
-	return n;
+}
+
+/*
+ * @note 定时器已到期的回调可能在取消之后执行, 由connecting_判定连接是否已结束
+ */
+void TCPClient::handle_timeout(const error_code& ec) {
+	if (ec || !connecting_) return;
+	error_code ec1;
+	resolver_.cancel();
+	sock_.close(ec1);
 }
 
 void TCPClient::handle_connect(const error_code& ec) {
+	error_code ec1;
+	connecting_ = false;
+	tmconn_.cancel(ec1);
 	if (!cbconn_.empty()) cbconn_((const long) this, ec.value());
 	if (!ec) {
 		socket_base::keep_alive option(true);
@@ -187,9 +271,17 @@ void TCPClient::handle_read(const error_code& ec, int n) {
 }
 
 void TCPClient::handle_write(const error_code& ec, int n) {
+	{
+		mutex_lock lck(mtxsnd_);
+		if (ec) {// 连接已断开, 丢弃待发送消息
+			stat_.dropped += sending_.size() + queue_.size();
+			queue_.clear();
+			writing_ = false;
+		}
+		else stat_.sent += sending_.size();
+		sending_.clear();
+	}
 	if (!ec) {
-		mutex_lock lock(mtxsnd_);
-		crcsnd_.erase_begin(n);
 		if (!cbsnd_.empty()) cbsnd_((const long) this, n);
 		start_write();
 	}
@@ -198,18 +290,35 @@ void TCPClient::handle_write(const error_code& ec, int n) {
 void TCPClient::start_read() {
 	if (sock_.is_open()) {
 		sock_.async_read_some(buffer(bufrcv_.get(), TCP_PACK_SIZE),
-				boost::bind(&TCPClient::handle_read, this,
-						placeholders::error, placeholders::bytes_transferred));
+				keep_.get_strand().wrap(boost::bind(&TCPClient::handle_read, shared_from_this(),
+						placeholders::error, placeholders::bytes_transferred)));
 	}
 }
 
+/*
+ * @note
+ * 在strand中执行. 由writing_保证同一时刻仅有一次async_write,
+ * 其间进入队列的消息在本次发送完成后合并发送
+ */
 void TCPClient::start_write() {
-	int n(crcsnd_.size());
-	if (n) {
-		sock_.async_write_some(buffer(crcsnd_.linearize(), n),
-				boost::bind(&TCPClient::handle_write, this,
-						placeholders::error, placeholders::bytes_transferred));
+	mutex_lock lck(mtxsnd_);
+	if (queue_.empty() || !sock_.is_open()) {
+		if (!sock_.is_open()) {
+			stat_.dropped += queue_.size();
+			queue_.clear();
+		}
+		writing_ = false;
+		return;
 	}
+
+	sending_.swap(queue_);
+	std::vector<const_buffer> buffers;
+	buffers.reserve(sending_.size());
+	for (msgque::iterator it = sending_.begin(); it != sending_.end(); ++it)
+		buffers.push_back(buffer(it->data.get(), it->size));
+	async_write(sock_, buffers,
+			keep_.get_strand().wrap(boost::bind(&TCPClient::handle_write, shared_from_this(),
+					placeholders::error, placeholders::bytes_transferred)));
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -252,7 +361,7 @@ void TCPServer::start_accept() {
 	if (acceptor_.is_open()) {
 		TcpCPtr client = maketcp_client();
 		acceptor_.async_accept(client->GetSocket(),
-				boost::bind(&TCPServer::handle_accept, this, client, placeholders::error));
+				keep_.get_strand().wrap(boost::bind(&TCPServer::handle_accept, this, client, placeholders::error)));
 	}
 }
 
@@ -10,14 +10,33 @@
  * - 支持无缓冲工作模式
  * - 客户端建立连接后设置KEEP_ALIVE
  * - 优化缓冲区操作
+ * @version 0.4
+ * - 使用进程内共享线程池, 回调函数经由接口私有strand串行执行
+ * @version 0.5
+ * - 发送改为消息队列: 每条消息使用引用计数存储区, 发送完成后释放
+ * - 同一时刻仅一次async_write; 其间进入队列的消息在下一次发送时以scatter/gather方式合并为一次系统调用
+ * - Write()不再阻塞调用线程. 可暂缓发送, 由Flush()统一启动, 使批量消息合并发送
+ * - 循环缓冲区仅用于接收
+ * @version 0.6
+ * - 发送队列按消息数量限定容量, 队列已满时按策略丢弃最新或最早的消息
+ * - 合并策略: 新消息替换队列中键值相同(同一设备)且尚未发送的消息, 保证数据新鲜
+ * - 统计进入队列、发送完成、丢弃与被合并的消息数量
+ * @version 0.7
+ * - AsyncConnect()异步解析地址, 按顺序尝试解析得到的全部地址, 可设置连接超时
+ * - Connect()同样尝试全部地址, 连接成功后启动接收
+ * - 异步操作持有TCPClient共享指针, 对象在全部回调完成后析构. 须由maketcp_client()创建
+ * - Close()断开全部回调函数
  */
 
 #ifndef TCPASIO_H_
 #define TCPASIO_H_
 
 #include <boost/signals2.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/circular_buffer.hpp>
 #include <string>
+#include <deque>
 #include "IOServiceKeep.h"
 
 using boost::asio::ip::tcp;
@@ -26,8 +45,27 @@ using boost::system::error_code;
 //////////////////////////////////////////////////////////////////////////////
 /*---------------- TCPClient: 客户端 ----------------*/
 #define TCP_PACK_SIZE	1500		//< TCP包容量, 量纲: 字节
+#define TCP_QUEUE_DEPTH	128		//< 发送队列缺省容量, 量纲: 条
 
-class TCPClient {
+enum {// 发送队列已满时的处理策略
+	TCP_DROP_NEWEST,	//< 丢弃新消息
+	TCP_DROP_OLDEST,	//< 丢弃队列中最早的消息
+	TCP_COALESCE		//< 新消息替换队列中键值相同的消息; 队列仍满时丢弃最早的消息
+};
+
+struct TcpQueueStat {// 发送队列统计
+	uint64_t queued;	//< 进入队列的消息数量
+	uint64_t sent;		//< 发送完成的消息数量
+	uint64_t dropped;	//< 因队列已满或连接断开丢弃的消息数量
+	uint64_t coalesced;	//< 被新消息替换的消息数量
+
+public:
+	TcpQueueStat() {
+		queued = sent = dropped = coalesced = 0;
+	}
+};
+
+class TCPClient : public boost::enable_shared_from_this<TCPClient> {
 public:
 	TCPClient();
 	virtual ~TCPClient();
@@ -45,11 +83,21 @@ protected:
 	typedef boost::circular_buffer<char> crcbuff;	//< 循环缓冲区
 	typedef boost::shared_array<char> carray;	//< 字符型数组
 
+	struct message {// 待发送消息
+		carray data;	//< 消息存储区
+		int size;		//< 消息长度, 量纲: 字节
+		int key;		//< 合并键值. <0: 不合并
+	};
+	typedef std::deque<message> msgque;	//< 消息队列
+
 protected:
 	friend class TCPServer;
 	// 成员变量
-	IOServiceKeep keep_;	//< 提供io_service对象
+	IOServiceKeep keep_;	//< 提供共享io_service对象与strand
 	tcp::socket   sock_;	//< 套接字
+	tcp::resolver resolver_;	//< 地址解析
+	boost::asio::deadline_timer tmconn_;	//< 连接超时定时器
+	bool connecting_;	//< 异步连接进行中
 	CallbackFunc  cbconn_;	//< connect回调函数
 	CallbackFunc  cbrcv_;	//< receive回调函数
 	CallbackFunc  cbsnd_;	//< send回调函数
@@ -58,7 +106,12 @@ protected:
 	int bytercv_;	//< 已接收信息长度
 	carray bufrcv_;	//< 单条接收缓冲区
 	crcbuff crcrcv_;		//< 循环接收缓冲区
-	crcbuff crcsnd_;		//< 循环发送缓冲区
+	msgque queue_;		//< 待发送消息队列
+	msgque sending_;	//< 发送中消息, 在发送完成前保持存储区有效
+	int capacity_;		//< 发送队列容量, 量纲: 条
+	int policy_;		//< 队列已满时的处理策略
+	bool writing_;		//< 发送进行中或已投递
+	TcpQueueStat stat_;	//< 发送队列统计
 	boost::mutex mtxrcv_;	//< 接收互斥锁
 	boost::mutex mtxsnd_;	//< 发送互斥锁
 
@@ -80,10 +133,13 @@ public:
 	bool Connect(const std::string& host, const uint16_t port);
 	/*!
 	 * @brief 异步方式尝试连接服务器
-	 * @param host 服务器地址或名称
-	 * @param port 服务端口
+	 * @param host    服务器地址或名称
+	 * @param port    服务端口
+	 * @param timeout 连接超时, 量纲: 秒. <=0: 不限时
+	 * @note
+	 * 解析与连接均为异步操作, 结果由connect回调函数通知
 	 */
-	void AsyncConnect(const std::string& host, const uint16_t port);
+	void AsyncConnect(const std::string& host, const uint16_t port, const int timeout = 0);
 	/*!
 	 * @brief 关闭套接字
 	 * @return
@@ -99,10 +155,20 @@ public:
 	 */
 	bool IsOpen();
 	/*!
-	 * @brief 启用或禁用TCPClient自带缓冲区功能
+	 * @brief 启用或禁用TCPClient自带接收缓冲区功能
 	 * @param usebuf true启用, false禁用
 	 */
 	void UseBuffer(bool usebuf = true);
+	/*!
+	 * @brief 设置发送队列
+	 * @param capacity 队列容量, 量纲: 条. 不含正在发送的消息
+	 * @param policy   队列已满时的处理策略: TCP_DROP_NEWEST, TCP_DROP_OLDEST或TCP_COALESCE
+	 */
+	void SetQueue(int capacity, int policy);
+	/*!
+	 * @brief 查看发送队列统计
+	 */
+	TcpQueueStat GetQueueStat();
 	/*!
 	 * @brief 注册connect回调函数, 处理与服务器的连接结果
 	 * @param slot 函数插槽
@@ -144,13 +210,29 @@ public:
 	 */
 	int Read(char* buff, const int len, const int from = 0);
 	/*!
-	 * @brief 发送指定数据
-	 * @param buff 待发送数据存储区指针
-	 * @param len  待发送数据长度
+	 * @brief 复制数据并加入发送队列
+	 * @param buff  待发送数据存储区指针
+	 * @param len   待发送数据长度
+	 * @param flush 立即启动发送. false: 由后续Write()或Flush()启动
+	 * @param key   合并键值, 通常为设备标识. <0: 不合并
+	 * @return
+	 * 进入队列的数据长度. 消息被丢弃时返回0
+	 */
+	int Write(const char* buff, const int len, const bool flush = true, const int key = -1);
+	/*!
+	 * @brief 将数据加入发送队列, 不复制
+	 * @param buff  待发送数据存储区. 调用者在发送完成前不应修改其内容
+	 * @param len   待发送数据长度
+	 * @param flush 立即启动发送
+	 * @param key   合并键值. <0: 不合并
 	 * @return
-	 * 实际发送数据长度
+	 * 进入队列的数据长度. 消息被丢弃时返回0
+	 */
+	int Write(const carray& buff, const int len, const bool flush = true, const int key = -1);
+	/*!
+	 * @brief 启动发送队列中的数据
 	 */
-	int Write(const char* buff, const int len);
+	void Flush();
 
 protected:
 	// 功能
@@ -160,6 +242,17 @@ protected:
 	 * @param ec 错误代码
 	 */
 	void handle_connect(const error_code& ec);
+	/*!
+	 * @brief 处理地址解析结果, 依次尝试连接全部地址
+	 * @param ec 错误代码
+	 * @param it 解析得到的地址
+	 */
+	void handle_resolve(const error_code& ec, tcp::resolver::iterator it);
+	/*!
+	 * @brief 连接超时, 终止解析或连接
+	 * @param ec 错误代码
+	 */
+	void handle_timeout(const error_code& ec);
 	/*!
 	 * @brief 处理收到的网络信息
 	 * @param ec 错误代码
@@ -177,7 +270,7 @@ protected:
 	 */
 	void start_read();
 	/*!
-	 * @brief 尝试发送缓冲区数据
+	 * @brief 将队列中全部消息合并为一次异步发送
 	 */
 	void start_write();
 };
@@ -205,7 +298,7 @@ public:
 
 protected:
 	// 成员变量
-	IOServiceKeep keep_;		//< 提供io_service对象
+	IOServiceKeep keep_;		//< 提供共享io_service对象与strand
 	tcp::acceptor acceptor_;	//< 服务套接口
 	CallbackFunc  cbaccept_;	//< accept回调函数
 